@@ -0,0 +1,509 @@
+"""Evaluates instance config at build time
+
+The result is emitted as static const initializers, so that config is
+ready without any parsing at startup. Only things known at build time can
+be baked: variables set at runtime (``-D``), custom conversion functions
+and inheritance are not supported.
+"""
+import os.path
+from collections import OrderedDict
+
+import yaml
+
+from . import load
+from .util import parse_int, parse_float
+from .cutil import varname, typename, array_indexes, array_columns
+from .cutil import packed_bools, int_range, inline_size
+from .cutil import choices, choice_value, format_segments
+from .cast import *
+
+true_values = {'true', 'y', 'yes', 'on'}
+false_values = {'false', 'n', 'no', 'off'}
+
+
+class BakeError(Exception):
+
+    def __init__(self, node, message, *args):
+        mark = node.start_mark
+        super(BakeError, self).__init__(
+            "Error at {0}:{1}[{2}]: {3}".format(mark.name, mark.line+1,
+                mark.column, message.format(*args)))
+
+
+class InstanceLoader(yaml.Loader):
+    """Composes instance config, resolving ``!Include`` like libcoyaml does
+
+    Anchors are global for all included files, so are shared between
+    loaders
+    """
+
+    def __init__(self, stream, anchors):
+        super(InstanceLoader, self).__init__(stream)
+        self.anchors = anchors
+        self.all_anchors = anchors
+
+    def compose_document(self):
+        self.get_event()
+        node = self.compose_node(None, None)
+        self.get_event()
+        self.anchors = self.all_anchors
+        return node
+
+    def compose_node(self, parent, index):
+        node = super(InstanceLoader, self).compose_node(parent, index)
+        if isinstance(node, yaml.ScalarNode) and node.tag == '!Include':
+            if not node.value:
+                raise BakeError(node, "Empty filename in ``!Include''")
+            node = compose_file(os.path.join(basedir(node), node.value),
+                self.all_anchors)
+        return node
+
+
+def compose_file(filename, anchors):
+    with open(filename, 'rb') as f:
+        loader = InstanceLoader(f, anchors)
+        try:
+            return loader.get_single_node()
+        finally:
+            loader.dispose()
+
+
+def basedir(node):
+    return os.path.dirname(node.start_mark.name)
+
+
+def explicit_tag(node):
+    return node.tag if node.tag.startswith('!') else None
+
+
+class Initializer(object):
+    """Builds static initializers for the structures of the config"""
+
+    def __init__(self, cfg, ast=None):
+        self.cfg = cfg
+        self.prefix = cfg.name
+        self.ast = ast
+        self.counter = 0
+
+    def defaults(self, members):
+        """Returns initializer of a structure with `members` set to defaults
+
+        Per-use defaults of nested structures are folded into the result
+        """
+        return StrValue(**self._fields(members, self._defaults(members)))
+
+    # Defaults
+
+    def _defaults(self, item, default=None):
+        if default is None and hasattr(item, 'default_'):
+            default = item.default_
+        if isinstance(item, dict):
+            return OrderedDict((k, self._defaults(v,
+                default.get(k) if default else None))
+                for k, v in item.items())
+        elif isinstance(item, (load.Int, load.UInt)):
+            return parse_int(default) if default is not None else 0
+        elif isinstance(item, load.Float):
+            return parse_float(default) if default is not None else 0.0
+        elif isinstance(item, (load.String, load.File, load.Dir,
+                               load.Format)):
+            return default
+        elif isinstance(item, load.Bool):
+            return bool(default)
+        elif isinstance(item, (load.Choice, load.Flags)):
+            return choice_value(item, default)
+        elif isinstance(item, load.Struct):
+            return self._struct_defaults(self.cfg.types[item.type],
+                getattr(item, 'default_', {}))
+        elif isinstance(item, (load.Array, load.Mapping)):
+            return []
+        return None
+
+    def _struct_defaults(self, utype, defaults):
+        res = OrderedDict()
+        if hasattr(utype, 'tagname'):
+            res[utype.tagname] = getattr(utype, 'defaulttag', 0)
+        for k, v in utype.members.items():
+            if not isinstance(defaults, dict):
+                current = defaults if k == 'value' else None
+            else:
+                current = defaults.get(k)
+            res[k] = self._defaults(v, current)
+        return res
+
+    # Initializers
+
+    def _fields(self, members, values):
+        res = OrderedDict()
+        packed = packed_bools(members)
+        for k, item in members.items():
+            if k in packed:
+                # Whole word is set, bits are at the position of the first
+                word, bit = packed[k]
+                current = res[word].value if word in res else 0
+                res[word] = Int(current | (bool(values[k]) << bit))
+                continue
+            self._field(res, varname(k), item, values[k])
+        return res
+
+    def _field(self, res, name, item, value):
+        if isinstance(item, dict):
+            fields = self._fields(item, value)
+            if fields:
+                res[name] = StrValue(**fields)
+        elif isinstance(item, (load.Int, load.UInt, load.Choice, load.Flags)):
+            res[name] = Int(value)
+        elif isinstance(item, load.Float):
+            res[name] = Float(float(value))
+        elif isinstance(item, load.Bool):
+            res[name] = Ident('TRUE') if value else Ident('FALSE')
+        elif isinstance(item, (load.String, load.File, load.Dir)):
+            if value is None:
+                res[name] = NULL
+                res[name+'_len'] = Int(0)
+            elif len(value.encode('utf-8')) < inline_size(item):
+                res[name] = NULL
+                res[name+'_len'] = Int(len(value.encode('utf-8')))
+                res[name+'_inline'] = String(value)
+            else:
+                res[name] = String(value)
+                res[name+'_len'] = Int(len(value.encode('utf-8')))
+        elif isinstance(item, load.Format):
+            if value is None:
+                res[name] = NULL
+                res[name+'_len'] = Int(0)
+                return
+            # Segments are compiled here, so defaults and baked values
+            # need no parsing at startup
+            segments = format_segments(item, value)
+            res[name] = String(value)
+            res[name+'_len'] = Int(len(value.encode('utf-8')))
+            if segments:
+                res[name+'_tpl'] = StrValue(
+                    count=Int(len(segments)),
+                    segments=Compound(Typename('coyaml_segment_t'), Arr([
+                        StrValue(placeholder=Int(ph), value=String(text),
+                            len=Int(len(text.encode('utf-8'))))
+                        for ph, text in segments ])))
+        elif isinstance(item, load.Struct):
+            utype = self.cfg.types[item.type]
+            fields = OrderedDict()
+            if hasattr(utype, 'tagname'):
+                fields[varname(utype.tagname)] = Int(value[utype.tagname])
+            fields.update(self._fields(utype.members, value))
+            if fields:
+                res[name] = StrValue(**fields)
+        elif isinstance(item, load.Array):
+            elements = [(('value', item.element, v),) for v in value]
+            for member, unique in array_indexes(self.cfg, item):
+                seen = set()
+                for v in value:
+                    key = v.get(member) if isinstance(v, dict) else None
+                    if unique and key is not None and key in seen:
+                        raise ValueError("Duplicate {0} {1!r} in array {2!r}"
+                            .format(member, key, name))
+                    seen.add(key)
+            capacity = int(getattr(item, 'capacity', 0))
+            if capacity:
+                if len(elements) > capacity:
+                    raise ValueError("Array {0!r} can't contain more than "
+                        "{1} elements".format(name, capacity))
+                if elements:
+                    res[name] = Arr(self._element_values(elements))
+                res[name+'_len'] = Int(len(elements))
+            else:
+                res[name], res[name+'_len'] = self._elements(
+                    '{0}_a_{1}'.format(self.prefix, typename(item.element)),
+                    elements)
+            columns = array_columns(self.cfg, item)
+            if columns and value:
+                res[name+'_columns'] = StrValue(**OrderedDict(
+                    (varname(member), self._column(ctype,
+                        [v[member] for v in value]))
+                    for member, ctype in columns))
+        elif isinstance(item, load.Mapping):
+            res[name], res[name+'_len'] = self._elements(
+                '{0}_m_{1}_{2}'.format(self.prefix,
+                    typename(item.key_element), typename(item.value_element)),
+                [(('key', item.key_element, k),
+                  ('value', item.value_element, v)) for k, v in value])
+        elif isinstance(item, load.VoidPtr):
+            res[name] = NULL
+
+    def _column(self, ctype, values):
+        self.counter += 1
+        name = '{0}_baked_{1}'.format(self.prefix, self.counter)
+        if ctype == 'double':
+            items = [Float(float(v)) for v in values]
+        else:
+            items = [Int(int(v)) for v in values]
+        self.ast(VarAssign(Typename('const '+ctype), name, Arr(items),
+            static=True, array=(None,), aligned=True))
+        return Coerce(Typename(ctype+' *'), Ident(name))
+
+    def _elements(self, tname, elements):
+        # Elements are contiguous, but linked the same as when parsed
+        if not elements:
+            return NULL, Int(0)
+        self.counter += 1
+        name = '{0}_baked_{1}'.format(self.prefix, self.counter)
+        self.ast(VarAssign(Typename('const '+tname+'_t'), name,
+            Arr(self._element_values(elements, name)),
+            static=True, array=(None,)))
+        return (Coerce(Typename('struct '+tname+'_s *'), Ident(name)),
+            Int(len(elements)))
+
+    def _element_values(self, elements, name=None):
+        # Elements of the array `name` are linked, inline ones are not
+        items = []
+        for i, members in enumerate(elements):
+            fields = OrderedDict()
+            if name is not None and i+1 < len(elements):
+                fields['head'] = StrValue(next=Coerce(Typename('void *'),
+                    Ref(Subscript(Ident(name), Int(i+1)))))
+            for fname, item, value in members:
+                self._field(fields, fname, item, value)
+            items.append(StrValue(**fields))
+        return items
+
+
+class Baker(Initializer):
+
+    def __init__(self, cfg, filename):
+        super(Baker, self).__init__(cfg)
+        self.filename = filename
+        self.anchors = {}
+
+    def evaluate(self):
+        root = compose_file(self.filename, self.anchors)
+        values = self._defaults(self.cfg.data)
+        self._owners = []
+        self._group(self.cfg.data, root, values)
+        return values
+
+    def make(self, ast):
+        """Emits element arrays into `ast` followed by the main structure"""
+        values = self.evaluate()
+        self.ast = ast
+        fields = self._fields(self.cfg.data, values)
+        ast(VarAssign(Typename('const '+self.prefix+'_main_t'),
+            self.prefix+'_baked', StrValue(**fields)))
+
+    # Instance, the same as parser.c does
+
+    def _pairs(self, node, seen=None):
+        # Flattens ``<<`` merges, first of the duplicate keys wins
+        if seen is None:
+            seen = set()
+        for knode, vnode in node.value:
+            if isinstance(knode, yaml.ScalarNode) and knode.value == '<<':
+                if isinstance(vnode, yaml.MappingNode):
+                    merge = [vnode]
+                elif isinstance(vnode, yaml.SequenceNode):
+                    merge = vnode.value
+                else:
+                    raise BakeError(vnode,
+                        "Can merge only mapping or sequence of mappings")
+                for m in merge:
+                    if not isinstance(m, yaml.MappingNode):
+                        raise BakeError(m, "Can only merge mappings")
+                    for pair in self._pairs(m, seen):
+                        yield pair
+                continue
+            if isinstance(knode, yaml.ScalarNode):
+                if knode.value in seen:
+                    continue
+                seen.add(knode.value)
+            yield knode, vnode
+
+    def _group(self, members, node, target):
+        if not isinstance(node, yaml.MappingNode):
+            raise BakeError(node, "Mapping expected")
+        for knode, vnode in self._pairs(node):
+            if not isinstance(knode, yaml.ScalarNode):
+                raise BakeError(knode, "Scalar key expected")
+            key = knode.value
+            if key.startswith('_'):
+                continue
+            if key == '=':
+                key = 'value'
+            if key not in members or key.startswith('_'):
+                raise BakeError(knode, "Unexpected key ``{0}''", key)
+            target[key] = self._value(members[key], vnode, target[key])
+
+    def _value(self, item, node, current):
+        if isinstance(item, dict):
+            self._group(item, node, current)
+            return current
+        elif isinstance(item, load.Struct):
+            self._usertype(self.cfg.types[item.type], node, current)
+            return current
+        elif isinstance(item, load.Array):
+            if not isinstance(node, yaml.SequenceNode):
+                raise BakeError(node, "Sequence expected")
+            return [self._value(item.element, el,
+                self._defaults(item.element)) for el in node.value]
+        elif isinstance(item, load.Mapping):
+            if not isinstance(node, yaml.MappingNode):
+                raise BakeError(node, "Mapping expected")
+            return [(self._value(item.key_element, k,
+                        self._defaults(item.key_element)),
+                     self._value(item.value_element, v,
+                        self._defaults(item.value_element)))
+                    for k, v in self._pairs(node)]
+        elif isinstance(item, load.Flags):
+            if not isinstance(node, yaml.SequenceNode):
+                raise BakeError(node, "Sequence expected")
+            res = 0
+            for el in node.value:
+                res |= 1 << self._choice(item, el)
+            return res
+        if not isinstance(node, yaml.ScalarNode):
+            raise BakeError(node, "Scalar expected")
+        try:
+            if isinstance(item, (load.Int, load.UInt)):
+                val = parse_int(self._eval(node, node.value))
+                if isinstance(item, load.UInt) and val < 0:
+                    raise BakeError(node,
+                        "Value must be greater or equal to zero")
+                self._check_range(item, node, val, parse_int)
+                return val
+            elif isinstance(item, load.Float):
+                val = parse_float(self._eval(node, node.value))
+                self._check_range(item, node, val, parse_float)
+                return val
+        except TypeError as e:
+            raise BakeError(node, str(e))
+        if isinstance(item, load.Bool):
+            if node.value.lower() in true_values:
+                return True
+            elif node.value.lower() in false_values:
+                return False
+            raise BakeError(node, "Option value ``{0}'' is not boolean",
+                node.value)
+        elif isinstance(item, (load.String, load.Format)):
+            return self._string(node)
+        elif isinstance(item, (load.File, load.Dir)):
+            return node.value
+        elif isinstance(item, load.Choice):
+            return self._choice(item, node)
+        raise BakeError(node, "Type {0} can't be baked",
+            item.__class__.__name__)
+
+    def _choice(self, item, node):
+        if not isinstance(node, yaml.ScalarNode):
+            raise BakeError(node, "Scalar expected")
+        names = choices(item)
+        if node.value not in names:
+            raise BakeError(node, "Unknown choice ``{0}''", node.value)
+        return names.index(node.value)
+
+    def _check_range(self, item, node, val, parse):
+        if isinstance(item, (load.Int, load.UInt)):
+            low, high = int_range(item)
+        else:
+            low = parse(item.min) if hasattr(item, 'min') else None
+            high = parse(item.max) if hasattr(item, 'max') else None
+        if high is not None and val > high:
+            raise BakeError(node,
+                "Value must be less than or equal to {0}", high)
+        if low is not None and val < low:
+            raise BakeError(node,
+                "Value must be greater than or equal to {0}", low)
+
+    def _string(self, node, tag=True):
+        tag = explicit_tag(node) if tag else None
+        if tag == '!FromFile':
+            fn = os.path.join(basedir(node), node.value)
+            try:
+                with open(fn, 'rb') as f:
+                    return f.read().decode('utf-8')
+            except (IOError, UnicodeDecodeError) as e:
+                raise BakeError(node, "Can't read file ``{0}'': {1}", fn, e)
+        elif tag == '!Raw':
+            return node.value
+        elif tag:
+            raise BakeError(node, "Unknown tag ``{0}''", tag)
+        return self._eval(node, node.value)
+
+    def _eval(self, node, value):
+        # Substitutes scalar anchors, the same as coyaml_eval_str(),
+        # variables set at runtime can't be known here
+        if '$' not in value:
+            return value
+        res = []
+        i = 0
+        while i < len(value):
+            c = value[i]
+            if c == '\\':
+                if i+1 >= len(value):
+                    raise BakeError(node, "Backslash at the end of value")
+                res.append(value[i+1])
+                i += 2
+                continue
+            if c != '$':
+                res.append(c)
+                i += 1
+                continue
+            i += 1
+            if value[i:i+1] == '{':
+                raise BakeError(node,
+                    "Expressions are not supported in baked config")
+            start = i
+            while i < len(value) and (value[i].isalnum() or value[i] == '_'):
+                i += 1
+            name = value[start:i]
+            if not name:
+                res.append('$')
+                continue
+            anchor = self.anchors.get(name)
+            if anchor is None:
+                raise BakeError(node, "Variable ``{0}'' is not known "
+                    "at build time", name)
+            if not isinstance(anchor, yaml.ScalarNode):
+                raise BakeError(node, "You can only substitute a scalar "
+                    "variable, use ``*'' to dereference complex anchors")
+            res.append(anchor.value)
+        return ''.join(res)
+
+    def _usertype(self, utype, node, target):
+        if isinstance(node, yaml.ScalarNode):
+            conv = getattr(utype, 'convert', None)
+            if conv is None:
+                raise BakeError(node, "Scalar is not allowed for {0}",
+                    utype.name)
+            if conv != 'coyaml_tagged_scalar':
+                raise BakeError(node, "Conversion function {0} can't be "
+                    "used in baked config", conv)
+            self._tag(utype, node, target)
+            # Tag is already consumed, so ``!FromFile`` doesn't apply
+            target['value'] = self._string(node, tag=False)
+        elif isinstance(node, yaml.SequenceNode):
+            self._tag(utype, node, target)
+            target['value'] = self._value(utype.members['value'], node,
+                target['value'])
+        else:
+            self._tag(utype, node, target)
+            if utype.inheritance and self._owners \
+                and self._owners[-1] == utype.name:
+                raise BakeError(node,
+                    "Inheritance is not supported in baked config")
+            self._owners.append(utype.name)
+            self._group(utype.members, node, target)
+            self._owners.pop()
+
+    def _tag(self, utype, node, target):
+        tag = explicit_tag(node)
+        tags = getattr(utype, 'tags', {})
+        if tag is None:
+            if tags:
+                if not hasattr(utype, 'defaulttag'):
+                    raise BakeError(node, "Tag is required for {0}",
+                        utype.name)
+                target[utype.tagname] = utype.defaulttag
+            return
+        for k, v in tags.items():
+            if '!'+k == tag:
+                target[utype.tagname] = v
+                return
+        raise BakeError(node, "Unknown tag ``{0}''", tag)
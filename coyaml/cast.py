@@ -6,19 +6,20 @@ from collections import OrderedDict
 __all__ = [
     'VSpace',
     'CommentBlock',
-    'Include', 'StdInclude', 'Define', 'Ifdef', 'Ifndef', 'Endif', 'Macro',
+    'Include', 'StdInclude', 'Define', 'Ifdef', 'Ifndef', 'Else', 'Endif',
+    'Macro',
     'Ident',
-    'TypeDef', 'Typename', 'Struct', 'AnonStruct', 'Void',
+    'TypeDef', 'Typename', 'Struct', 'AnonStruct', 'AnonUnion', 'Void',
     'Enum', 'EnumItem', 'EnumVal',
-    'Param', 'Var', 'FVar', 'VarAssign', 'Assign',
+    'Param', 'Var', 'BitField', 'Anonymous', 'FVar', 'VarAssign', 'Assign',
     'Arr', 'ArrArr', 'StrValue',
     'Member', 'Dot', 'Subscript', 'Ref', 'Deref',
     'Expression', 'Statement',
-    'For', 'If', 'Return',
+    'For', 'If', 'While', 'Switch', 'Case', 'Break', 'Continue', 'Return',
     'Func', 'Function', 'Call',
-    'Int', 'Float', 'String', 'Coerce',
+    'Int', 'Float', 'String', 'Coerce', 'Compound',
     'Add', 'Mul', 'Div', 'Sub', 'Not', 'Ternary',
-    'Gt', 'Lt', 'Ge', 'Le', 'Eq', 'Neq', 'And', 'Or',
+    'Gt', 'Lt', 'Ge', 'Le', 'Eq', 'Neq', 'And', 'Or', 'BitOr',
     'NULL',
     ]
 
@@ -137,6 +138,13 @@ class Or(Node):
         ])
     line_format = '{left} || {right}'
 
+class BitOr(Node):
+    __slots__ = OrderedDict([
+        ('left', lazy.Expression),
+        ('right', lazy.Expression),
+        ])
+    line_format = '{left} | {right}'
+
 class Ternary(Node):
     __slots__ = OrderedDict([
         ('cond', lazy.Expression),
@@ -172,7 +180,7 @@ class Typename(Node):
         (?:(?:unsigned|signed)\s+)?
         (?:char|short|int|long|bool|float|double|void|\w+_t|\w+_fun|\w+_enum|FILE)
         \s*(?:\*\s*)* |
-        struct\s+\w+
+        (?:const\s+)?struct\s+\w+
         \s*(?:\*\s*)*
         $''', re.X)
     def __init__(self, value):
@@ -183,7 +191,8 @@ class Void(Node):
     __slots__ = {}
     line_format = 'void'
 
-_type = (Typename, Void, lazy.Struct, lazy.AnonStruct, lazy.Enum)
+_type = (Typename, Void, lazy.Struct, lazy.AnonStruct, lazy.AnonUnion,
+    lazy.Enum)
 
 class Coerce(Node):
     __slots__ = OrderedDict([
@@ -192,6 +201,14 @@ class Coerce(Node):
         ])
     line_format = '({type}){expr}'
 
+class Compound(Node):
+    # Array compound literal, has static storage in initializers
+    __slots__ = OrderedDict([
+        ('type', _type),
+        ('items', lazy.Arr),
+        ])
+    line_format = '({type}[]){items}'
+
 class CommentBlock(Node):
     __slots__ = OrderedDict([
         ('lines', List(str)),
@@ -246,6 +263,11 @@ class Ifndef(Node):
     top = True
     line_format = '#ifndef {name}'
 
+class Else(Node):
+    __slots__ = {}
+    top = True
+    line_format = '#else'
+
 class Endif(Node):
     __slots__ = OrderedDict([
         ('name', Ident),
@@ -259,17 +281,47 @@ class Var(Node):
         ('name', Ident),
         ('array', tuple),
         ('static', bool),
+        ('extern', bool),
+        ('aligned', bool),
         ])
     top = True
-    line_format = '{static }{type} {name}{array};'
+    line_format = '{static }{type} {name}{array}{ aligned};'
+
+    def fmt_aligned(self):
+        if getattr(self, 'aligned', None):
+            return 'COYAML_ALIGNED'
+        return ''
 
     def fmt_static(self):
-        return 'static' if getattr(self, 'static', None) else ''
+        if getattr(self, 'static', None):
+            return 'static'
+        if getattr(self, 'extern', None):
+            return 'extern'
+        return ''
 
     def fmt_array(self):
-        return ''.join('[]' if a is None else '[{0:d}]'.format(a)
+        return ''.join('[]' if a is None else '[{0}]'.format(a)
             for a in getattr(self, 'array', ()))
 
+class BitField(Var):
+    __slots__ = OrderedDict([
+        ('type', _type),
+        ('name', Ident),
+        ('bits', int),
+        ])
+    top = True
+    line_format = '{type} {name}:{bits};'
+
+    def fmt_bits(self):
+        return str(self.bits)
+
+class Anonymous(Var):
+    __slots__ = OrderedDict([
+        ('type', _type),
+        ])
+    top = True
+    line_format = '{type}{ aligned};'
+
 class Int(Node):
     __slots__ = OrderedDict([
         ('value', int),
@@ -290,9 +342,9 @@ class String(Node):
 class Expression(Node):
     __slots__ = OrderedDict([
         ('expr', (Ident, Int, Float, String, Dot, Member, Ref, Deref, Subscript,
-            Add, Sub, Mul, Div, Not, Coerce,
-            Lt, Gt, Le, Ge, Eq, Neq, And, Or, Ternary,
-            lazy.Call, lazy.StrValue, lazy.Assign)),
+            Add, Sub, Mul, Div, Not, Coerce, Compound,
+            Lt, Gt, Le, Ge, Eq, Neq, And, Or, BitOr, Ternary,
+            lazy.Call, lazy.StrValue, lazy.Arr, lazy.Assign)),
         ])
     line_format = '{expr}'
 
@@ -339,9 +391,10 @@ class VarAssign(Var):
         ('expr', (Expression, Arr)),
         ('array', tuple),
         ('static', bool),
+        ('aligned', bool),
         ])
     top = True
-    line_format = '{static }{type} {name}{array} = {expr};'
+    line_format = '{static }{type} {name}{array}{ aligned} = {expr};'
 
 class Return(Var):
     __slots__ = OrderedDict([
@@ -389,6 +442,13 @@ class AnonStruct(Node):
     block_start = 'struct {{'
     block_end = '}}'
 
+class AnonUnion(Node):
+    __slots__ = OrderedDict([
+        ('body', List(Var)),
+        ])
+    block_start = 'union {{'
+    block_end = '}}'
+
 class EnumItem(Node):
     __slots__ = OrderedDict([
         ('name', Ident),
@@ -470,6 +530,43 @@ class If(Node):
     block_start = 'if({cond}) {{'
     block_end = '}}'
 
+class While(Node):
+    __slots__ = OrderedDict([
+        ('cond', Expression),
+        ('body', List(Node)),
+        ])
+    top = True
+    block_start = 'while({cond}) {{'
+    block_end = '}}'
+
+class Switch(Node):
+    __slots__ = OrderedDict([
+        ('expr', Expression),
+        ('body', List(lazy.Case)),
+        ])
+    top = True
+    block_start = 'switch({expr}) {{'
+    block_end = '}}'
+
+class Case(Node):
+    __slots__ = OrderedDict([
+        ('label', Expression),
+        ('body', List(Node)),
+        ])
+    top = True
+    block_start = 'case {label}: {{'
+    block_end = '}}'
+
+class Break(Node):
+    __slots__ = {}
+    top = True
+    line_format = 'break;'
+
+class Continue(Node):
+    __slots__ = {}
+    top = True
+    line_format = 'continue;'
+
 lazy.fix(globals())
 
 NULL = Ident('NULL')
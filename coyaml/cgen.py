@@ -1,10 +1,17 @@
+import copy
+from functools import reduce
 import textwrap
-from collections import defaultdict
+from collections import defaultdict, OrderedDict
 
-from . import load, core
+from . import load, core, bake
 from .util import builtin_conversions, parse_int, parse_float, nested
 from .cutil import varname, string, typename, cbool
+from .cutil import array_indexes, array_columns, int_width, int_range
+from .cutil import packed_bools, inline_size, fnv1a, perfect_hash
+from .cutil import choices, choice_typename, regex_flags, array_set
+from .cutil import parsed_type, address_port, format_strftime, mapping_indexed
 from .cast import *
+from .textast import Ast
 
 cmdline_template = """\
 Usage:
@@ -35,6 +42,20 @@ scalar_types = {
     load.Float: lambda val: Float(parse_float(val)),
     load.VoidPtr: lambda val: NULL,
     }
+# Stored by generated group parsers, others are parsed by the runtime
+direct_types = {
+    load.Int,
+    load.UInt,
+    load.Float,
+    load.Bool,
+    }
+limit_names = {
+    'max_input_bytes',
+    'max_events',
+    'max_depth',
+    'max_arena_bytes',
+    'max_includes',
+    }
 string_types = {
     load.String,
     load.File,
@@ -51,6 +72,28 @@ def mem2dotname(mem):
     else:
         raise NotImplementedError(mem)
 
+def _renamed(mem, name):
+    # Member next to `mem` in the same structure
+    if isinstance(mem, Dot):
+        return Dot(mem.source, name)
+    return Member(mem.source, name)
+
+def _rebased(mem, base):
+    # Path of the member of a structure from the structure at `base`
+    if base is None:
+        return mem
+    if isinstance(mem, Dot):
+        return Dot(_rebased(mem.source, base), mem.name)
+    return Dot(base, mem.name)
+
+def _suffixed(mem, suffix):
+    return _renamed(mem, mem.name.value + suffix)
+
+def _pack_bools(members):
+    # Marks booleans which are bits of a word, see `packed_bools()`
+    for k, (word, bit) in packed_bools(members).items():
+        members[k].bitfield = (word, bit)
+
 def bitmask(*args):
     res = 0
     for i, v in enumerate(args):
@@ -94,15 +137,23 @@ class MappingEl(object):
     def nextflag(self):
         return 0
 
+def _text(nodes):
+    ast = Ast()
+    ast.body.extend(nodes)
+    return str(ast)
+
 class GenCCode(object):
 
-    def __init__(self, cfg):
+    def __init__(self, cfg, bake=None, shards=1):
         self.cfg = cfg
         self.prefix = cfg.name
+        self.bake = bake
+        self.shards = shards
 
     def _vars(self, ast, decl=False):
         items = ('group', 'string', 'file', 'dir', 'int', 'uint', 'float',
-            'custom', 'mapping', 'array', 'bool')
+            'custom', 'mapping', 'array', 'bool', 'choice', 'flags', 'regex',
+            'address', 'cidr', 'stringset', 'format')
         if decl:
             for i in items:
                 ast(Var('coyaml_'+i+'_t',
@@ -135,12 +186,7 @@ class GenCCode(object):
                         vars.content.remove(item)
                         break
 
-    def _next_default_fun(self):
-        self.default_fun_no += 1
-        return self.default_fun_no
-
     def make(self, ast):
-        self.default_fun_no = 0
         ast(CommentBlock(
             'THIS IS AUTOGENERATED FILE',
             'DO NOT EDIT!!!',
@@ -151,19 +197,30 @@ class GenCCode(object):
         ast(StdInclude('stdio.h'))
         ast(StdInclude('errno.h'))
         ast(StdInclude('strings.h'))
+        ast(StdInclude('string.h'))
         ast(Include(self.cfg.targetname+'.h'))
         ast(VSpace())
         self.lasttran = 0
         self._vars(ast.zone('transitions'), decl=True)
         ast(VSpace())
+        ast.zone('parser_decls')
+        ast(VSpace())
         ast.zone('usertypes')
         ast(VSpace())
+        ast.zone('defaults')
+        ast(VSpace())
         vars = ast.zone('vars')
         ast(VSpace())
         cli = ast.zone('cli')
         ast(VSpace())
+        ast.zone('lookup')
+        ast(VSpace())
+        ast.zone('paths')
+        ast(VSpace())
+        ast.zone('parsers')
         with nested(*self._vars(vars, decl=False)):
             self.visit_hier(ast)
+            self.make_paths(ast.zone('paths'))
 
         self.make_options(cli)
         self.make_environ(vars)
@@ -178,14 +235,14 @@ class GenCCode(object):
                     Call('malloc', [ Call('sizeof', [ mainstr ])])))))
             with init(If(Not(Ident('res')), ast.block())) as if_:
                 if_(Return(Ident('NULL')))
-            init(Statement(Call('bzero', [ Ident('res'),
+            init(Statement(Call('memcpy', [ Ident('res'),
+                Ref(Ident(self.prefix+'_main_default')),
                 Call('sizeof', [ mainstr ]) ])))
             with init(If(Not(Ident('ptr')), init.block())) as if_:
                 if_(Statement(Assign(Dot(Member(Ident('res'), 'head'),
                     'free_object'), Ident('TRUE'))))
             init(Statement(Call('obstack_init', [
                 Ref(Dot(Member(Ident('res'), 'head'), 'pieces'))])))
-            init(Statement(Call(self.prefix + '_defaults', [ Ident('res') ])))
             init(Return(Ident('res')))
 
         with ast(Function(Typename('coyaml_context_t *'),
@@ -225,16 +282,27 @@ class GenCCode(object):
             ctx(Statement(Assign(Member(_ctx, 'root_group'), Ref(Subscript(
                 Ident(self.prefix+'_group_vars'),
                 Int(len(self.states['group'].content)-1))))))
+            ctx(Statement(Assign(Member(_ctx, 'schema_hash'),
+                Int(self.schema_hash()))))
+            ctx(Statement(Assign(Member(_ctx, 'target_size'),
+                Call('sizeof', [ mainstr ]))))
+            if hasattr(self.cfg.meta, 'snapshot_file'):
+                ctx(Statement(Assign(Member(_ctx, 'snapshot_filename'),
+                    String(self.cfg.meta.snapshot_file))))
+            if getattr(self.cfg.meta, 'event_cache', False):
+                ctx(Statement(Assign(Member(_ctx, 'event_cache'),
+                    Ident('TRUE'))))
+            for k, v in getattr(self.cfg.meta, 'limits', {}).items():
+                k = varname(k)
+                if k not in limit_names:
+                    raise ValueError("Unknown limit {0!r}".format(k))
+                ctx(Statement(Assign(Dot(Member(_ctx, 'limits'), k),
+                    Int(parse_int(v)))))
             ctx(Return(_ctx))
 
         with ast(Function(Void(), self.prefix+'_free', [
             Param(mainptr, Ident('ptr')) ], ast.block())) as free:
-            free(Statement(Call('obstack_free', [
-                Ref(Dot(Member(Ident('ptr'), 'head'), 'pieces')),
-                Ident('NULL') ])))
-            with free(If(Dot(Member(Ident('ptr'), 'head'), 'free_object'),
-                ast.block())) as if_:
-                if_(Statement(Call('free', [ Ident('ptr') ])))
+            free(Statement(Call('coyaml_config_free', [ Ident('ptr') ])))
 
         with ast(Function(Typename('bool'), self.prefix+'_readfile', [
             Param('coyaml_context_t *', 'ctx'),
@@ -266,7 +334,114 @@ class GenCCode(object):
             fun(Statement(Call('coyaml_context_free', [ Ref(Ident('ctx')) ])))
             fun(Return(Coerce(mainptr, Dot(Ident('ctx'), Ident('target')))))
 
+        if self.bake:
+            self.make_baked(ast)
+
         self._clear_unused_vars(ast.zone('transitions'), ast.zone('vars'))
+        if self.shards > 1:
+            self._split(ast)
+
+    def _split(self, ast):
+        # Transition tables, default images and tables of scalar
+        # placeholders refer to nothing but each other, so they are spread
+        # over several translation units. The rest is kept in the main one
+        self.shard_items = [[] for i in range(self.shards)]
+        sizes = [0]*self.shards
+        self.shared_vars = []
+        for item in ast.zone('transitions').content:
+            if isinstance(item, Var) and not isinstance(item, VarAssign):
+                # Declarations of the tables, they are needed in all units
+                item.static = False
+                item.extern = True
+                self.shared_vars.append(item)
+        scalar_tables = {'{0}_{1}_vars'.format(self.prefix, name)
+            for name in ('string', 'file', 'dir', 'int', 'uint', 'float',
+                         'bool', 'regex', 'address', 'cidr', 'stringset')}
+        for zone in (ast.zone('vars'), ast.zone('transitions'),
+                     ast.zone('defaults')):
+            content = []
+            for item in zone.content:
+                if not isinstance(item, VarAssign):
+                    content.append(item)
+                    continue
+                if zone is ast.zone('vars'):
+                    item.static = False
+                    if item.name.value not in scalar_tables:
+                        content.append(item)
+                        sizes[0] += len(_text([item]))
+                        continue
+                shard = sizes.index(min(sizes))
+                sizes[shard] += len(_text([item]))
+                if shard == 0:
+                    content.append(item)
+                    continue
+                item.static = False
+                self.shard_items[shard].append(item)
+                if zone is not ast.zone('vars'):
+                    content.append(Var(item.type, item.name,
+                        array=getattr(item, 'array', ()), extern=True))
+            zone.content[:] = content
+
+    def make_shard(self, ast, index):
+        """Makes `index`th additional translation unit, after `make()`"""
+        ast(CommentBlock(
+            'THIS IS AUTOGENERATED FILE',
+            'DO NOT EDIT!!!',
+            ))
+        ast(StdInclude('coyaml_src.h'))
+        ast(Include(self.cfg.targetname+'.h'))
+        ast(VSpace())
+        for item in self.shared_vars:
+            ast(item)
+        ast(VSpace())
+        for item in self.shard_items[index]:
+            ast(item)
+
+    def make_baked(self, ast):
+        # Config is evaluated here and placed in read-only data, only
+        # command-line and environment are applied at runtime, on a copy
+        mainstr = Typename(self.prefix+'_main_t')
+        mainptr = Typename(self.prefix+'_main_t *')
+        ast(VSpace())
+        bake.Baker(self.cfg, self.bake).make(ast)
+        ast(VSpace())
+        with ast(Function(mainptr, self.prefix+'_baked_load', [
+            Param(mainptr, 'ptr'),
+            Param('int','argc'), Param('char**','argv') ], ast.block())) as fun:
+            fun(Var('coyaml_context_t', 'ctx'))
+            with fun(If(Lt(Call(self.prefix+'_context', [
+                Ref(Ident('ctx')), Ident('ptr') ]), Int(0)),
+                fun.block())) as if_:
+                if_(Statement(Call('perror', [
+                    Subscript(Ident('argv'), Int(0)) ])))
+                if_(Statement(Call('exit', [ Int(1) ])))
+            head = Call('sizeof', [ Typename('coyaml_head_t') ])
+            fun(Statement(Call('memcpy', [
+                Add(Coerce(Typename('char *'), Dot(Ident('ctx'), Ident('target'))),
+                    head),
+                Add(Coerce(Typename('char *'), Ref(self.prefix+'_baked')),
+                    head),
+                Sub(Call('sizeof', [ mainstr ]), head) ])))
+            fun(Statement(Call('coyaml_cli_prepare_or_exit', [
+                Ref(Ident('ctx')),
+                Ident('argc'), Ident('argv')])))
+            fun(Statement(Call('coyaml_env_parse_or_exit', [
+                Ref(Ident('ctx')) ])))
+            fun(Statement(Call('coyaml_cli_parse_or_exit', [ Ref(Ident('ctx')),
+                Ident('argc'), Ident('argv') ])))
+            fun(Statement(Call('coyaml_context_free', [ Ref(Ident('ctx')) ])))
+            fun(Return(Coerce(mainptr, Dot(Ident('ctx'), Ident('target')))))
+
+    def schema_hash(self):
+        # Layout of the structures is fully described by the header, so
+        # hash of the header identifies compatible snapshots
+        from .hgen import GenHCode
+        with Ast() as ast:
+            GenHCode(self.cfg).make(ast)
+        hash = 0xcbf29ce484222325
+        for c in str(ast).encode('utf-8'):
+            hash = ((hash ^ c) * 0x100000001b3) & 0xffffffffffffffff
+        return hash & 0x7fffffffffffffff
 
     def make_options(self, ast):
         optval = 1000
@@ -397,6 +572,110 @@ class GenCCode(object):
                     Ref(self.prefix+'_print')),
             )))
 
+    def make_paths(self, ast):
+        # Index of the dotted paths for `coyaml_get()` and friends, slots
+        # are filled here, so lookup is a hash of the path and a probe or two
+        self.paths = []
+        self._collect_paths(self.cfg.data, '', Int(0), None)
+        nslots = 2
+        while nslots < len(self.paths)*2:
+            nslots *= 2
+        slots = [0]*nslots
+        for i, (path, offset, prop, setter) in enumerate(self.paths):
+            slot = fnv1a(path.encode('utf-8')) & (nslots - 1)
+            while slots[slot]:
+                slot = (slot + 1) & (nslots - 1)
+            slots[slot] = i + 1
+        with ast(VarAssign('coyaml_path_t', self.prefix+'_paths',
+            Arr(ast.block()), static=True, array=(None,))) as tbl:
+            for path, offset, prop, setter in self.paths:
+                tbl(StrValue(
+                    path=String(path),
+                    path_len=Int(len(path.encode('utf-8'))),
+                    offset=offset,
+                    prop=Coerce('coyaml_placeholder_t *', prop),
+                    set=Coerce('coyaml_option_fun', setter)
+                        if setter else NULL,
+                    ))
+        ast(VarAssign('int', self.prefix+'_path_slots',
+            Arr(list(map(Int, slots))), static=True, array=(None,)))
+        ast(VarAssign('coyaml_pathindex_t', self.prefix+'_path_index',
+            StrValue(
+                paths=Ident(self.prefix+'_paths'),
+                nslots=Int(nslots),
+                slots=Ident(self.prefix+'_path_slots'),
+            ), static=True))
+        ast(VSpace())
+        mainptr = Typename(self.prefix+'_main_t *')
+        index = Ref(Ident(self.prefix+'_path_index'))
+        with ast(Function(Typename('void *'), self.prefix+'_get', [
+            Param(mainptr, 'cfg'),
+            Param('const char *', 'path'),
+            ], ast.block())) as fun:
+            fun(Return(Call('coyaml_get', [ index,
+                Ident('cfg'), Ident('path') ])))
+        with ast(Function('int', self.prefix+'_set', [
+            Param(mainptr, 'cfg'),
+            Param('const char *', 'path'),
+            Param('char *', 'value'),
+            ], ast.block())) as fun:
+            fun(Return(Call('coyaml_set', [ index,
+                Ident('cfg'), Ident('path'), Ident('value') ])))
+        with ast(Function('int', self.prefix+'_print_path', [
+            Param('FILE *', 'out'),
+            Param(mainptr, 'cfg'),
+            Param('const char *', 'path'),
+            Param('int', 'mode'),
+            ], ast.block())) as fun:
+            fun(Return(Call('coyaml_print_path', [ Ident('out'), index,
+                Ident('cfg'), Ident('path'), Ident('mode') ])))
+
+    def _collect_paths(self, members, prefix, offset, base):
+        # Structures are embedded, so the offset chain of the path is summed
+        # up to a single `offsetof()`. Members of the structures under the
+        # root get placeholders relative to the root, to be set by the same
+        # converters as command-line options
+        for k, v in members.items():
+            if k.startswith('_'):
+                continue
+            path = prefix + k
+            if isinstance(v, dict):
+                self.paths.append((path, offset, v.prop_ref, None))
+                self._collect_paths(v, path+'.', offset, base)
+                continue
+            elif isinstance(v, (load.CType, load.CStruct, load.VoidPtr)):
+                continue
+            member = _rebased(v.member_path, base)
+            if isinstance(v, (load.Array, load.Mapping)):
+                self.paths.append((path, offset, v.prop_ref, None))
+            elif isinstance(v, load.Struct):
+                utype = self.cfg.types[v.type]
+                setter = 'coyaml_custom_o' if hasattr(utype, 'convert') \
+                    else None
+                prop = v.prop_ref
+                if base is not None:
+                    prop = self._root_custom(v, member)
+                self.paths.append((path, Int(0), prop, setter))
+                self._collect_paths(utype.members, path+'.',
+                    Call('offsetof', [ Typename(self.prefix+'_main_t'),
+                        mem2dotname(member) ]), member)
+            else:
+                if base is not None:
+                    v = copy.copy(v)
+                    self.mkstate(v, StructInfo(self.prefix+'_main_t'), member)
+                self.paths.append((path, Int(0), v.prop_ref,
+                    v.prop_func+'_o'))
+
+    def _root_custom(self, item, member):
+        self.states['custom'](StrValue(
+            type=Ref(Ident('coyaml_custom_type')),
+            baseoffset=Call('offsetof', [ Typename(self.prefix+'_main_t'),
+                mem2dotname(member) ]),
+            usertype=Ref(Ident(self.prefix+'_'+item.type+'_def')),
+            ))
+        return Ref(Subscript(Ident(self.prefix+'_custom_vars'),
+            Int(len(self.states['custom'].content)-1)))
+
     def make_environ(self, ast):
         ast(VarAssign('coyaml_env_var_t', self.prefix+'_env_vars', Arr([
             StrValue(
@@ -411,17 +690,32 @@ class GenCCode(object):
         # Visits hierarchy to set appropriate structures and member
         # names for `offsetof()` in `baseoffset`
         ast(VSpace())
-        self._mk_defaultsfun(self.prefix + '_defaults', self.cfg.data, ast=ast)
+        self.initializer = bake.Initializer(self.cfg)
+        self.element_defaults = set()
+        self.group_parsers = []
+        self.mapping_finds = set()
+        self.array_finds = set()
+        self.index_tables = []
+        self.column_tables = []
+        self.choice_tables = {}
+        self.choice_zone = ast.zone('usertypes')
+        ast.zone('defaults')(VarAssign(
+            Typename('const '+self.prefix+'_main_t'),
+            self.prefix+'_main_default',
+            self.initializer.defaults(self.cfg.data), static=True))
         for i, sname in enumerate(self.cfg.types):
             self._visit_usertype(sname, root=ast, index=i+1)
         ast(VSpace())
-        tranname = Ident('transitions_{0}'.format(self.lasttran))
+        tranname = Ident('{0}_transitions_{1}'.format(self.prefix,
+            self.lasttran))
         self.lasttran += 1
         with ast.zone('transitions')(VarAssign('coyaml_transition_t', tranname,
                 Arr(ast.block()),
                 static=True, array=(None,))) as tran:
+            _pack_bools(self.cfg.data)
+            struct = StructInfo(self.prefix+'_main_t')
             for k, v in self.cfg.data.items():
-                self._visit_hier(v, k, StructInfo(self.prefix+'_main_t'),
+                self._visit_hier(v, k, struct,
                     Member('cfg', varname(k)), root=ast)
                 tran(StrValue(
                     symbol=String(k),
@@ -433,6 +727,7 @@ class GenCCode(object):
                 type=Ref(Ident('coyaml_group_type')),
                 baseoffset=Int(0),
                 transitions=tranname,
+                parser=self._group_parser(ast, self.cfg.data, struct),
                 ))
         with ast(Function('int', self.prefix+'_print', [
                 Param('FILE *', 'out'),
@@ -445,72 +740,34 @@ class GenCCode(object):
                     Int(len(self.states['group'].content)-1))),
                 Ident('cfg'), Ident('mode'),
                 ])))
-
-    def _mk_defaultsfun(self, defname, utype, ast, defaults={}):
-        typ = self.prefix+'_'+ getattr(utype, 'name', 'main') +'_t *'
-        chzone = ast.zone(typ) # for proper ordering
-        with ast(Function('int', defname, [
-            Param(typ, 'cfg') ], ast.block())) as cdef:
-            if hasattr(utype, 'tagname'):
-                cdef(Statement(Assign(Member('cfg', varname(utype.tagname)),
-                    Int(utype.defaulttag))))
-            for k, v in getattr(utype, 'members', utype).items():
-                if not isinstance(defaults, dict):
-                    if k == 'value':
-                        current_def = defaults
-                    else:
-                        current_def = None
-                else:
-                    current_def = defaults.get(k)
-                self._visit_defaults(v, Member('cfg', varname(k)),
-                    ast=cdef, root=chzone, default=current_def)
-            cdef(Return(Int(0)))
-
-    def _visit_defaults(self, item, mem, ast, root, default=None):
-        if default is None and hasattr(item, 'default_'):
-            default = item.default_
-        if isinstance(item, dict):
-            for k, v in item.items():
-                self._visit_defaults(v, Dot(mem, varname(k)),
-                    ast=ast, root=root,
-                    default=default.get(k) if default else None)
-        elif item.__class__ in scalar_types:
-            asttyp = scalar_types[item.__class__]
-            ast(Statement(Assign(mem, asttyp(default))))
-        elif item.__class__ in string_types:
-            if isinstance(default, str):
-                dlen = len(default.encode('utf-8'))
-            elif default:
-                dlen = len(default)
-            else:
-                dlen = 0
-            ast(Statement(Assign(mem, String(default))))
-            lenmem = mem.__class__(mem.source, mem.name.value + '_len')
-            ast(Statement(Assign(lenmem, Int(dlen))))
-        elif isinstance(item, load.Bool):
-            ast(Statement(Assign(mem, Ident('TRUE')
-                if default else Ident('FALSE'))))
-        elif isinstance(item, load.Struct):
-            if not hasattr(item, 'default_'):
-                ast(Statement(Call(self.prefix+'_defaults_'+item.type, [
-                    Ref(mem) ])))
-            else:
-                utype = self.cfg.types[item.type]
-                item.default_fun = '{0}_defaults_{1}_{2}'.format(
-                    self.prefix, item.type, self._next_default_fun())
-                self._mk_defaultsfun(item.default_fun, utype, ast=root,
-                    defaults=item.default_)
-                ast(Statement(Call(item.default_fun, [ Ref(mem) ])))
+        # Counters are indexed by offset of the member in main structure
+        ast(VSpace())
+        ast(Ifdef('COYAML_PROFILE'))
+        ast(Var(Typename('unsigned long'), self.prefix+'_profile',
+            array=('sizeof({0}_main_t)'.format(self.prefix),)))
+        with ast(Function('int', self.prefix+'_profile_dump', [
+                Param('FILE *', 'out'),
+                ], ast.block())) as pdump:
+            pdump(Return(Call('coyaml_profile_dump', [
+                Ident('out'),
+                Ref(Subscript(Ident(self.prefix+'_group_vars'),
+                    Int(len(self.states['group'].content)-1))),
+                Ident(self.prefix+'_profile'),
+                ])))
+        ast(Endif('COYAML_PROFILE'))
+        ast(VSpace())
 
     def _visit_usertype(self, name, root, index):
         utype = self.cfg.types[name]
         struct = StructInfo(self.prefix+'_'+name+'_t',
             inheritance=bool(utype.inheritance))
-        tranname = Ident('transitions_{0}'.format(self.lasttran))
+        tranname = Ident('{0}_transitions_{1}'.format(self.prefix,
+            self.lasttran))
         self.lasttran += 1
         with root.zone('transitions')(VarAssign('coyaml_transition_t',
                 tranname, Arr(root.block()),
                 static=True, array=(None,))) as tran:
+            _pack_bools(utype.members)
             for k, v in utype.members.items():
                 self._visit_hier(v, k, struct,
                     Member('cfg', varname(k)), root=root)
@@ -527,6 +784,7 @@ class GenCCode(object):
             type=Ref(Ident('coyaml_group_type')),
             baseoffset=Int(0),
             transitions=tranname,
+            parser=self._group_parser(root, utype.members, struct),
             ))
         uzone = root.zone('usertypes')
         if hasattr(utype, 'tags'):
@@ -541,10 +799,6 @@ class GenCCode(object):
             tagvar = 'NULL'
             default_tag = -1
 
-        defname = self.prefix+'_defaults_'+name
-        self._mk_defaultsfun(defname, utype, root)
-        uzone(Func('int', defname, [ Param(struct.a_ptr, 'cfg') ]))
-
         conv_fun = getattr(utype, 'convert', None)
         if conv_fun is not None and conv_fun not in builtin_conversions:
             uzone(Func('int', utype.convert, [
@@ -571,11 +825,13 @@ class GenCCode(object):
 
     def _visit_hier(self, item, name, struct, mem, root):
         if isinstance(item, dict):
-            tranname = Ident('transitions_{0}'.format(self.lasttran))
+            tranname = Ident('{0}_transitions_{1}'.format(self.prefix,
+            self.lasttran))
             self.lasttran += 1
             with root.zone('transitions')(VarAssign('coyaml_transition_t',
                 tranname, Arr(root.block()),
                 static=True, array=(None,))) as tran:
+                _pack_bools(item)
                 for k, v in item.items():
                     self._visit_hier(v, k, struct,
                         Dot(mem, varname(k)), root=root)
@@ -591,7 +847,9 @@ class GenCCode(object):
                 baseoffset=Call('offsetof', [ struct.a_name,
                     mem2dotname(mem) ]),
                 transitions=tranname,
+                parser=self._group_parser(root, item, struct),
                 ))
+            item.parser = self.group_parsers[-1]
             item.prop_func = 'coyaml_group'
             item.prop_ref = Ref(Subscript(Ident(self.prefix+'_group_vars'),
                 Int(len(self.states['group'].content)-1)))
@@ -600,11 +858,15 @@ class GenCCode(object):
             item.member_path = mem
             if not name.startswith('_'):
                 self.mkstate(item, struct, mem)
-        elif isinstance(item, load.Bool):
+        elif isinstance(item, (load.Bool, load.Choice, load.Flags,
+                               load.Regex, load.Address, load.CIDR,
+                               load.StringSet, load.Format)):
             item.struct_name = struct.name
             item.member_path = mem
             if not name.startswith('_'):
                 self.mkstate(item, struct, mem)
+            if isinstance(item, load.StringSet):
+                self._contains(root)
         elif isinstance(item, load.Struct):
             item.struct_name = struct.name
             item.member_path = mem
@@ -646,15 +908,15 @@ class GenCCode(object):
                 element_size=Call('sizeof', [ Typename(mstr.name) ]),
                 key_prop=Coerce('coyaml_placeholder_t *',
                     item.key_element.prop_ref),
-                key_defaults=Coerce('coyaml_defaults_fun',
-                    self.prefix+'_defaults_'+item.key_element.type)
-                    if isinstance(item.key_element, load.Struct) else NULL,
                 value_prop=Coerce('coyaml_placeholder_t *',
                     item.value_element.prop_ref),
-                value_defaults=Coerce('coyaml_defaults_fun',
-                    self.prefix+'_defaults_'+item.value_element.type)
-                    if isinstance(item.value_element, load.Struct) else NULL,
+                element_default=self._element_default(root, mstr.name,
+                    key=item.key_element, value=item.value_element),
+                indexoffset=Call('offsetof', [ struct.a_name,
+                    mem2dotname(_suffixed(mem, '_index')) ])
+                    if mapping_indexed(item) else Int(0),
                 ))
+            self._mapping_find(root, item, mstr.name)
             item.prop_func = 'coyaml_mapping'
             item.prop_ref = Ref(Subscript(Ident(self.prefix+'_mapping_vars'),
                 Int(len(self.states['mapping'].content)-1)))
@@ -680,10 +942,23 @@ class GenCCode(object):
                 element_size=Call('sizeof', [ Typename(astr.name) ]),
                 element_prop=Coerce('coyaml_placeholder_t *',
                     item.element.prop_ref),
-                element_defaults=Coerce('coyaml_defaults_fun',
-                    self.prefix+'_defaults_'+item.element.type)
-                    if isinstance(item.element, load.Struct) else NULL,
+                element_default=self._element_default(root, astr.name,
+                    value=item.element),
+                contiguous=cbool(getattr(item, 'contiguous', False)),
+                capacity=Int(int(getattr(item, 'capacity', 0))),
+                indexes=self._array_indexes(root, item, astr.name),
+                columns=self._array_columns(root, item, astr.name),
+                columnsoffset=Call('offsetof', [ struct.a_name,
+                    mem2dotname(_suffixed(mem, '_columns')) ])
+                    if array_columns(self.cfg, item) else Int(0),
+                setoffset=Call('offsetof', [ struct.a_name,
+                    mem2dotname(_suffixed(mem, '_set')) ])
+                    if array_set(item) else Int(0),
+                indexoffset=Call('offsetof', [ struct.a_name,
+                    mem2dotname(_suffixed(mem, '_indexes')) ])
+                    if array_indexes(self.cfg, item) else Int(0),
                 ))
+            self._cidr_match(root, item, astr.name)
             item.prop_func = 'coyaml_array'
             item.prop_ref = Ref(Subscript(Ident(self.prefix+'_array_vars'),
                 Int(len(self.states['array'].content)-1)))
@@ -692,7 +967,258 @@ class GenCCode(object):
         else:
             raise NotImplementedError(item)
 
+    def _group_parser(self, root, members, struct):
+        # Does the same as `coyaml_group()` with the transition table of
+        # the group, but keys are matched by `switch` on the length and
+        # scalars are checked against constants and stored directly.
+        # Must be called right before the group is added to the table
+        index = len(self.states['group'].content)
+        name = '{0}_parse_group_{1}'.format(self.prefix, index)
+        self.group_parsers.append(name)
+        params = [
+            Param('coyaml_parseinfo_t *', 'info'),
+            Param('coyaml_group_t *', 'def'),
+            Param('void *', 'target'),
+            ]
+        root.zone('parser_decls')(Func('static int', name, params))
+        bylen = defaultdict(list)
+        for k, v in members.items():
+            if not k.startswith('_'):
+                bylen[len(k.encode('utf-8'))].append((k, v))
+        info = Ident('info')
+        with root.zone('parsers')(Function('static int', name, params,
+            root.block())) as fun:
+            if any(v.__class__ in direct_types
+                   for k, v in members.items() if not k.startswith('_')):
+                fun(VarAssign(struct.a_ptr, 'cfg', Ident('target')))
+            fun(Var('const char *', 'key'))
+            fun(Var('size_t', 'len'))
+            fun(Var('int', 'res'))
+            self._check(fun, Call('coyaml_group_start', [ info ]))
+            with fun(While(Ident('TRUE'), fun.block())) as loop:
+                loop(Statement(Assign(Ident('res'), Call('coyaml_group_key',
+                    [ info, Ref(Ident('key')), Ref(Ident('len')) ]))))
+                with loop(If(Le(Ident('res'), Int(0)),
+                    loop.block())) as if_:
+                    if_(Return(Ident('res')))
+                with loop(Switch(Ident('len'), loop.block())) as switch:
+                    for length, keys in sorted(bylen.items()):
+                        with switch(Case(Int(length),
+                            switch.block())) as case:
+                            for k, v in keys:
+                                with case(If(Not(Call('memcmp', [
+                                    Ident('key'), String(k), Int(length) ])),
+                                    case.block())) as match:
+                                    self._check(match, Call(
+                                        'coyaml_event_next', [ info ]))
+                                    self._parse_member(match, v)
+                                    match(Continue())
+                            case(Break())
+                loop(Return(Call('coyaml_group_unknown', [
+                    info, Ident('def') ])))
+        root.zone('parsers')(VSpace())
+        return Ident(name)
+
+    def _check(self, ast, call):
+        with ast(If(Lt(call, Int(0)), ast.block())) as if_:
+            if_(Return(Int(-1)))
+
+    def _value_error(self, ast, cond, message, value):
+        with ast(If(cond, ast.block())) as if_:
+            if_(Return(Call('coyaml_value_error', [ Ident('info'),
+                String(message), value ])))
+
+    def _parse_member(self, ast, item):
+        info = Ident('info')
+        val = Ident('val')
+        if isinstance(item, dict):
+            self._check(ast, Call(item.parser, [ info,
+                item.prop_ref, Ident('target') ]))
+            return
+        elif item.__class__ not in direct_types:
+            # Tags, variables and allocation are left to the runtime
+            self._check(ast, Call(item.prop_func, [ info,
+                item.prop_ref, Ident('target') ]))
+            return
+        if item.flag:
+            self._check(ast, Call('coyaml_mark_filled', [
+                info, Int(item.flag) ]))
+        if isinstance(item, (load.Int, load.UInt)):
+            low, high = int_range(item)
+            ast(Var('long', val))
+            self._check(ast, Call('coyaml_scalar_int', [ info, Ref(val) ]))
+            if isinstance(item, load.Int):
+                typ, fmt = 'long', '%ld'
+                cval = val
+            else:
+                typ, fmt = 'unsigned long', '%lu'
+                cval = Coerce(Typename(typ), val)
+            if high is not None:
+                self._value_error(ast, Gt(cval, Int(high)),
+                    'Value must be less than or equal to ' + fmt,
+                    Coerce(Typename(typ), Int(high)))
+            if low is not None:
+                self._value_error(ast, Lt(cval, Int(low)),
+                    'Value must be greater than or equal to ' + fmt,
+                    Coerce(Typename(typ), Int(low)))
+            if isinstance(item, load.UInt):
+                with ast(If(Lt(val, Int(0)), ast.block())) as if_:
+                    if_(Return(Call('coyaml_value_error', [ info,
+                        String('Value must be greater or equal to zero') ])))
+        elif isinstance(item, load.Float):
+            ast(Var('double', val))
+            self._check(ast, Call('coyaml_scalar_float', [ info, Ref(val) ]))
+            if hasattr(item, 'max'):
+                high = Float(parse_float(item.max))
+                self._value_error(ast, Gt(val, high),
+                    'Value must be less than or equal to %lf', high)
+            if hasattr(item, 'min'):
+                low = Float(parse_float(item.min))
+                self._value_error(ast, Lt(val, low),
+                    'Value must be greater than or equal to %lf', low)
+        else:
+            ast(Var('int', val))
+            self._check(ast, Call('coyaml_scalar_bool', [ info, Ref(val) ]))
+        ast(Statement(Assign(item.member_path, val)))
+        self._check(ast, Call('coyaml_event_next', [ info ]))
+
+    def _element_default(self, root, typ, **members):
+        # Elements having no structures are zeroed instead
+        if not any(isinstance(v, load.Struct) for v in members.values()):
+            return NULL
+        name = typ[:-len('_t')]+'_default'
+        if name not in self.element_defaults:
+            self.element_defaults.add(name)
+            members = OrderedDict((k, members[k])
+                for k in ('key', 'value') if k in members)
+            root.zone('defaults')(VarAssign(Typename('const '+typ), name,
+                self.initializer.defaults(members), static=True))
+        return Ref(Ident(name))
+
+    def _mapping_find(self, root, item, typ):
+        # Lookup by key, uses index built by parser when it's there
+        name = typ[:-len('_t')].replace('_m_', '_', 1)+'_find'
+        if name in self.mapping_finds:
+            return
+        if not mapping_indexed(item):
+            return
+        offset = Call('offsetof', [ Typename(typ), Ident('key') ])
+        if item.key_element.__class__ in string_types:
+            params = [ Param('const char *', 'key'),
+                       Param('size_t', 'keylen') ]
+            call = Call('coyaml_mapping_find_str', [ Ident('map'),
+                Ident('index'), offset, Ident('key'), Ident('keylen') ])
+        else:
+            params = [ Param('long', 'key') ]
+            call = Call('coyaml_mapping_find_int', [ Ident('map'),
+                Ident('index'), offset, Ident('key') ])
+        self.mapping_finds.add(name)
+        with root.zone('lookup')(Function(Typename(typ+' *'), name,
+            [ Param(Typename(typ+' *'), 'map'),
+              Param('struct coyaml_index_s *', 'index') ] + params,
+            root.block())) as fun:
+            fun(Return(call))
+
+    def _cidr_match(self, root, item, typ):
+        # Longest prefix match in the tree built by the parser
+        name = typ[:-len('_t')].replace('_a_', '_', 1)+'_match'
+        if not isinstance(item.element, load.CIDR) \
+            or name in self.array_finds:
+            return
+        self.array_finds.add(name)
+        with root.zone('lookup')(Function(Typename(typ+' *'), name, [
+            Param('coyaml_cidrset_t *', 'set'),
+            Param('const struct sockaddr *', 'addr'),
+            ], root.block())) as fun:
+            fun(Return(Call('coyaml_cidr_match', [ Ident('set'),
+                Ident('addr') ])))
+
+    def _contains(self, root):
+        # Single probe into the minimal perfect hash built by the parser
+        name = self.prefix+'_contains'
+        if name in self.array_finds:
+            return
+        self.array_finds.add(name)
+        with root.zone('lookup')(Function('int', name, [
+            Param('const coyaml_hashset_t *', 'set'),
+            Param('const char *', 'str'),
+            Param('size_t', 'len'),
+            ], root.block())) as fun:
+            fun(Return(Call('coyaml_hashset_contains', [ Ident('set'),
+                Ident('str'), Ident('len') ])))
+
+    def _array_indexes(self, root, item, typ):
+        indexes = array_indexes(self.cfg, item)
+        if not indexes:
+            return NULL
+        utype = self.cfg.types[item.element.type]
+        name = '{0}_indexes_{1}'.format(self.prefix, len(self.index_tables))
+        self.index_tables.append(name)
+        with root.zone('defaults')(VarAssign('coyaml_arrayindex_t', name,
+            Arr(root.block()), static=True, array=(None,))) as tbl:
+            for member, unique in indexes:
+                offset = Call('offsetof', [ Typename(typ),
+                    mem2dotname(Dot(Member(Ident('item'), 'value'),
+                        varname(member))) ])
+                string = utype.members[member].__class__ in string_types
+                tbl(StrValue(
+                    name=String(member),
+                    keytype=Ident('COYAML_STRING' if string else 'COYAML_INT'),
+                    keyoffset=offset,
+                    unique=cbool(unique),
+                    ))
+                self._array_find(root, typ, member, offset, string)
+            tbl(StrValue(name=NULL))
+        return Ident(name)
+
+    def _array_columns(self, root, item, typ):
+        columns = array_columns(self.cfg, item)
+        if not columns:
+            return NULL
+        name = '{0}_columns_{1}'.format(self.prefix, len(self.column_tables))
+        self.column_tables.append(name)
+        coltyp = Typename(typ[:-len('_t')]+'_columns_t')
+        with root.zone('defaults')(VarAssign('coyaml_column_t', name,
+            Arr(root.block()), static=True, array=(None,))) as tbl:
+            for member, ctype in columns:
+                tbl(StrValue(
+                    offset=Call('offsetof', [ Typename(typ),
+                        mem2dotname(Dot(Member(Ident('item'), 'value'),
+                            varname(member))) ]),
+                    size=Call('sizeof', [ Typename(ctype) ]),
+                    column=Call('offsetof', [ coltyp,
+                        Ident(varname(member)) ]),
+                    ))
+            tbl(StrValue(size=Int(0)))
+        return Ident(name)
+
+    def _array_find(self, root, typ, member, offset, string):
+        name = '{0}_find_by_{1}'.format(
+            typ[:-len('_t')].replace('_a_', '_', 1), varname(member))
+        if name in self.array_finds:
+            return
+        self.array_finds.add(name)
+        if string:
+            params = [ Param('const char *', 'key'),
+                       Param('size_t', 'keylen') ]
+            call = Call('coyaml_array_find_str', [ Ident('array'),
+                Ident('indexes'), offset, Ident('key'), Ident('keylen') ])
+        else:
+            params = [ Param('long', 'key') ]
+            call = Call('coyaml_array_find_int', [ Ident('array'),
+                Ident('indexes'), offset, Ident('key') ])
+        with root.zone('lookup')(Function(Typename(typ+' *'), name,
+            [ Param(Typename(typ+' *'), 'array'),
+              Param('struct coyaml_index_s **', 'indexes') ] + params,
+            root.block())) as fun:
+            fun(Return(call))
+
     def mkstate(self, item, struct, member):
+        flag = struct.nextflag() if item.inheritance else 0
+        # Used by group parser to mark the member filled
+        item.flag = flag
+        if isinstance(item, (load.Int, load.UInt)):
+            low, high = int_range(item)
         if isinstance(item, load.Int):
             self.states['int'](StrValue(
                 type=Ref(Ident('coyaml_int_type')),
@@ -700,14 +1226,12 @@ class GenCCode(object):
                     mem2dotname(member) ]),
                 description=String(item.description.strip())
                     if hasattr(item, 'description') else NULL,
-                flagoffset=Int(struct.nextflag())
-                    if item.inheritance else Int(0),
-                min=Int(parse_int(getattr(item, 'min', 0))),
-                max=Int(parse_int(getattr(item, 'max', 0))),
-                bitmask=Int(bitmask(
-                    hasattr(item, 'min'),
-                    hasattr(item, 'max'),
-                ))))
+                flagoffset=Int(flag),
+                min=Int(low or 0),
+                max=Int(high or 0),
+                bitmask=Int(bitmask(low is not None, high is not None)),
+                width=Int(int_width(item)),
+                ))
             item.prop_func = 'coyaml_int'
             item.prop_ref = Ref(Subscript(Ident(self.prefix+'_int_vars'),
                 Int(len(self.states['int'].content)-1)))
@@ -718,14 +1242,12 @@ class GenCCode(object):
                     mem2dotname(member) ]),
                 description=String(item.description.strip())
                     if hasattr(item, 'description') else NULL,
-                flagoffset=Int(struct.nextflag())
-                    if item.inheritance else Int(0),
-                min=Int(parse_int(getattr(item, 'min', 0))),
-                max=Int(parse_int(getattr(item, 'max', 0))),
-                bitmask=Int(bitmask(
-                    hasattr(item, 'min'),
-                    hasattr(item, 'max'),
-                ))))
+                flagoffset=Int(flag),
+                min=Int(low or 0),
+                max=Int(high or 0),
+                bitmask=Int(bitmask(low is not None, high is not None)),
+                width=Int(int_width(item)),
+                ))
             item.prop_func = 'coyaml_uint'
             item.prop_ref = Ref(Subscript(Ident(self.prefix+'_uint_vars'),
                 Int(len(self.states['uint'].content)-1)))
@@ -736,8 +1258,7 @@ class GenCCode(object):
                     mem2dotname(member) ]),
                 description=String(item.description.strip())
                     if hasattr(item, 'description') else NULL,
-                flagoffset=Int(struct.nextflag())
-                    if item.inheritance else Int(0),
+                flagoffset=Int(flag),
                 min=Float(parse_float(getattr(item, 'min', 0))),
                 max=Float(parse_float(getattr(item, 'max', 0))),
                 bitmask=Int(bitmask(
@@ -748,14 +1269,16 @@ class GenCCode(object):
             item.prop_ref = Ref(Subscript(Ident(self.prefix+'_float_vars'),
                 Int(len(self.states['float'].content)-1)))
         elif isinstance(item, load.Bool):
+            word, bit = getattr(item, 'bitfield', (None, 0))
             self.states['bool'](StrValue(
                 type=Ref(Ident('coyaml_bool_type')),
                 baseoffset=Call('offsetof', [ struct.a_name,
-                    mem2dotname(member) ]),
+                    mem2dotname(_renamed(member, word) if word else member) ]),
                 description=String(item.description.strip())
                     if hasattr(item, 'description') else NULL,
-                flagoffset=Int(struct.nextflag())
-                    if item.inheritance else Int(0),
+                flagoffset=Int(flag),
+                packed=Ident(cbool(word)),
+                bit=Int(bit),
                 ))
             item.prop_func = 'coyaml_bool'
             item.prop_ref = Ref(Subscript(Ident(self.prefix+'_bool_vars'),
@@ -767,8 +1290,8 @@ class GenCCode(object):
                     mem2dotname(member) ]),
                 description=String(item.description.strip())
                     if hasattr(item, 'description') else NULL,
-                flagoffset=Int(struct.nextflag())
-                    if item.inheritance else Int(0),
+                flagoffset=Int(flag),
+                inline_size=Int(inline_size(item)),
                 ))
             item.prop_func = 'coyaml_string'
             item.prop_ref = Ref(Subscript(Ident(self.prefix+'_string_vars'),
@@ -780,8 +1303,7 @@ class GenCCode(object):
                     mem2dotname(member) ]),
                 description=String(item.description.strip())
                     if hasattr(item, 'description') else NULL,
-                flagoffset=Int(struct.nextflag())
-                    if item.inheritance else Int(0),
+                flagoffset=Int(flag),
                 bitmask=Int(bitmask(hasattr(item, 'warn_outside'))),
                 check_existence=cbool(getattr(item, 'check_existence', False)),
                 check_dir=cbool(getattr(item, 'check_dir', False)),
@@ -798,17 +1320,129 @@ class GenCCode(object):
                     mem2dotname(member) ]),
                 description=String(item.description.strip())
                     if hasattr(item, 'description') else NULL,
-                flagoffset=Int(struct.nextflag())
-                    if item.inheritance else Int(0),
+                flagoffset=Int(flag),
                 check_existence=cbool(getattr(item, 'check_existence', False)),
                 check_dir=cbool(getattr(item, 'check_dir', False)),
                 ))
             item.prop_func = 'coyaml_dir'
             item.prop_ref = Ref(Subscript(Ident(self.prefix+'_dir_vars'),
                 Int(len(self.states['dir'].content)-1)))
+        elif isinstance(item, load.Regex):
+            self.states['regex'](StrValue(
+                type=Ref(Ident('coyaml_regex_type')),
+                baseoffset=Call('offsetof', [ struct.a_name,
+                    mem2dotname(member) ]),
+                description=String(item.description.strip())
+                    if hasattr(item, 'description') else NULL,
+                flagoffset=Int(flag),
+                cflags=reduce(BitOr, map(Ident, regex_flags(item))),
+                compiledoffset=Call('offsetof', [ struct.a_name,
+                    mem2dotname(_suffixed(member, '_re')) ]),
+                ))
+            item.prop_func = 'coyaml_regex'
+            item.prop_ref = Ref(Subscript(Ident(self.prefix+'_regex_vars'),
+                Int(len(self.states['regex'].content)-1)))
+        elif isinstance(item, load.Address):
+            parsed_type(item)
+            self.states['address'](StrValue(
+                type=Ref(Ident('coyaml_address_type')),
+                baseoffset=Call('offsetof', [ struct.a_name,
+                    mem2dotname(member) ]),
+                description=String(item.description.strip())
+                    if hasattr(item, 'description') else NULL,
+                flagoffset=Int(flag),
+                default_port=Int(address_port(item)),
+                ))
+            item.prop_func = 'coyaml_address'
+            item.prop_ref = Ref(Subscript(Ident(self.prefix+'_address_vars'),
+                Int(len(self.states['address'].content)-1)))
+        elif isinstance(item, load.CIDR):
+            parsed_type(item)
+            self.states['cidr'](StrValue(
+                type=Ref(Ident('coyaml_cidr_type')),
+                baseoffset=Call('offsetof', [ struct.a_name,
+                    mem2dotname(member) ]),
+                description=String(item.description.strip())
+                    if hasattr(item, 'description') else NULL,
+                flagoffset=Int(flag),
+                ))
+            item.prop_func = 'coyaml_cidr'
+            item.prop_ref = Ref(Subscript(Ident(self.prefix+'_cidr_vars'),
+                Int(len(self.states['cidr'].content)-1)))
+        elif isinstance(item, load.Format):
+            if format_strftime(item):
+                names, seed, mask, slots = NULL, 0, 0, NULL
+            else:
+                names, seed, slots = self._choice_table(item)
+                mask = len(self.choice_tables[names.value][1])-1
+            self.states['format'](StrValue(
+                type=Ref(Ident('coyaml_format_type')),
+                baseoffset=Call('offsetof', [ struct.a_name,
+                    mem2dotname(member) ]),
+                description=String(item.description.strip())
+                    if hasattr(item, 'description') else NULL,
+                flagoffset=Int(flag),
+                names=names,
+                seed=Int(seed),
+                mask=Int(mask),
+                slots=slots,
+                compiledoffset=Call('offsetof', [ struct.a_name,
+                    mem2dotname(_suffixed(member, '_tpl')) ]),
+                ))
+            item.prop_func = 'coyaml_format'
+            item.prop_ref = Ref(Subscript(Ident(self.prefix+'_format_vars'),
+                Int(len(self.states['format'].content)-1)))
+        elif isinstance(item, load.StringSet):
+            parsed_type(item)
+            self.states['stringset'](StrValue(
+                type=Ref(Ident('coyaml_stringset_type')),
+                baseoffset=Call('offsetof', [ struct.a_name,
+                    mem2dotname(member) ]),
+                description=String(item.description.strip())
+                    if hasattr(item, 'description') else NULL,
+                flagoffset=Int(flag),
+                ))
+            item.prop_func = 'coyaml_stringset'
+            item.prop_ref = Ref(Subscript(Ident(self.prefix+'_stringset_vars'),
+                Int(len(self.states['stringset'].content)-1)))
+        elif isinstance(item, (load.Choice, load.Flags)):
+            kind = 'choice' if isinstance(item, load.Choice) else 'flags'
+            names, seed, slots = self._choice_table(item)
+            self.states[kind](StrValue(
+                type=Ref(Ident('coyaml_{0}_type'.format(kind))),
+                baseoffset=Call('offsetof', [ struct.a_name,
+                    mem2dotname(member) ]),
+                description=String(item.description.strip())
+                    if hasattr(item, 'description') else NULL,
+                flagoffset=Int(flag),
+                names=names,
+                seed=Int(seed),
+                mask=Int(len(self.choice_tables[names.value][1])-1),
+                slots=slots,
+                ))
+            item.prop_func = 'coyaml_' + kind
+            item.prop_ref = Ref(Subscript(
+                Ident('{0}_{1}_vars'.format(self.prefix, kind)),
+                Int(len(self.states[kind].content)-1)))
         else:
             raise NotImplementedError(item)
 
+    def _choice_table(self, item):
+        # Names and perfect hash slots are shared by all members having
+        # the same type, the name is looked up by a single probe
+        tname = choice_typename(self.prefix, item)[:-len('_t')]
+        names = Ident(tname + '_names')
+        if names.value not in self.choice_tables:
+            seed, slots = perfect_hash(choices(item))
+            self.choice_tables[names.value] = (seed, slots)
+            self.choice_zone(VarAssign('char *', names.value,
+                Arr(list(map(String, choices(item))) + [ NULL ]),
+                static=True, array=(None,)))
+            self.choice_zone(VarAssign('const int', tname + '_slots',
+                Arr(list(map(Int, slots))), static=True, array=(None,)))
+        seed, slots = self.choice_tables[names.value]
+        return names, seed, Ident(tname + '_slots')
+
 def main():
     from .cli import simple
     from .load import load
@@ -816,7 +1450,7 @@ def main():
     cfg, inp, opt = simple()
     with inp:
         load(inp, cfg)
-    generator = GenCCode(cfg)
+    generator = GenCCode(cfg, bake=opt.bake)
     with Ast() as ast:
         generator.make(ast)
     print(str(ast))
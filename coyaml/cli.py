@@ -13,6 +13,12 @@ def simple():
     op.add_option('-f', '--filename', metavar="NAME",
         help="Filename to read",
         dest="filename", default="config", type="string")
+    op.add_option('-b', '--bake', metavar="FILENAME",
+        help="Instance configuration to compile into generated code",
+        dest="bake", default=None, type="string")
+    op.add_option('-P', '--profile', metavar="FILENAME",
+        help="Member access profile to lay out main structure by",
+        dest="profile", default=None, type="string")
     op.add_option('-p', '--print',
         help="Print parsed configuration file",
         dest="print", default=False, action="store_true")
@@ -20,6 +26,9 @@ def simple():
     if args:
         op.error("No arguments expected")
     cfg = Config(options.name, options.filename)
+    if options.profile:
+        from .load import load_profile
+        cfg.profile = load_profile(options.profile)
     if options.configfile:
         inp = open(options.configfile, 'rt', encoding='utf-8')
     else:
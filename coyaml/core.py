@@ -1,7 +1,7 @@
 from collections import OrderedDict
 
 from .util import varname
-from .load import Convert
+from .load import Convert, Choice, Flags, Format
 
 class Option(object):
     has_argument = True
@@ -42,6 +42,16 @@ class EnvVar(object):
         self.name = name
         self.target = target
 
+def _name_choices(members):
+    # Enum of the `!Choice`, `!Flags` or placeholders of the `!Format` is
+    # named after the member by default
+    for k, v in members.items():
+        if isinstance(v, dict):
+            _name_choices(v)
+        elif isinstance(v, (Choice, Flags, Format)) \
+            and not hasattr(v, 'name'):
+            v.name = k
+
 class Usertype(object):
     def __init__(self, name, members, **kw):
         self.name = name
@@ -62,6 +72,7 @@ class Usertype(object):
             elif k.startswith('__'):
                 continue
             self.members[k] = v
+        _name_choices(self.members)
         if isinstance(members.get('__value__'), Convert):
             self.convert = members['__value__'].fun
         elif members.get('__value__'):
@@ -92,6 +103,7 @@ class Config(object):
 
     def fill_data(self, data):
         self.data = data
+        _name_choices(self.data)
         self._visit_options(self.data)
 
     def _visit_options(self, data):
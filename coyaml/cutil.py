@@ -1,7 +1,8 @@
+import re
 from string import digits
 
 from . import load
-from .util import varname
+from .util import varname, parse_int
 
 reserved = {
     'class',
@@ -27,10 +28,16 @@ _typenames.update({
     load.String: 'string',
     load.File: 'File',
     load.Dir: 'Dir',
+    load.Regex: 'regex',
+    load.Address: 'address',
+    load.CIDR: 'cidr',
+    load.StringSet: 'stringset',
     load.VoidPtr: 'void',
     })
 _typenames.update(types)
 string_types = (load.File, load.String, load.Dir)
+choice_types = (load.Choice, load.Flags)
+re_ident = re.compile(r'^[A-Za-z_][A-Za-z0-9_]*$')
 
 def string(val):
     return '"{0}"'.format(repr(val)[1:-1].replace('"', r'\"'))
@@ -44,8 +51,330 @@ def typename(typ):
         return 'struct ' + typ.structname
     return _typenames[typ.__class__]
 
+int_widths = (8, 16, 32, 64)
+
+def int_width(item):
+    """Returns declared storage width of the integer in bits, zero for long"""
+    width = int(getattr(item, 'width', 0))
+    if width and width not in int_widths:
+        raise ValueError("{0}: width must be one of {1}"
+            .format(item.start_mark, ', '.join(map(str, int_widths))))
+    return width
+
+def ctype(item):
+    """Returns C type the scalar value is stored as"""
+    if isinstance(item, (load.Int, load.UInt)):
+        width = int_width(item)
+        if width:
+            return '{0}int{1}_t'.format(
+                'u' if isinstance(item, load.UInt) else '', width)
+    return typename(item)
+
+def int_range(item):
+    """Returns (min, max) of the integer, either of them may be None
+
+    Explicit bounds take precedence, the rest is derived from the width
+    """
+    width = int_width(item)
+    low = high = None
+    if width == 64:
+        pass
+    elif width and isinstance(item, load.UInt):
+        low, high = 0, (1 << width) - 1
+    elif width:
+        low, high = -(1 << (width-1)), (1 << (width-1)) - 1
+    if hasattr(item, 'min'):
+        low = parse_int(item.min)
+    if hasattr(item, 'max'):
+        high = parse_int(item.max)
+    return low, high
+
+def inline_size(item):
+    """Returns size of the inline buffer of the string, zero if none"""
+    size = int(getattr(item, 'inline', 0))
+    if size and not isinstance(item, load.String):
+        raise ValueError("{0}: only strings can be inline"
+            .format(item.start_mark))
+    return size + 1 if size else 0
+
+def heat(item, profile, path):
+    """Returns number of reads of the member and everything nested in it"""
+    if isinstance(item, dict):
+        return sum(heat(v, profile, path + (k,)) for k, v in item.items())
+    return profile.get('.'.join(path), 0)
+
+def hot_first(members, profile, path=()):
+    """Returns member names, most read first, unread in the schema order"""
+    return sorted(members,
+        key=lambda k: -heat(members[k], profile, path + (k,)))
+
+def packed_bools(members):
+    """Returns {member: (word, bit)} for booleans packed into bitfields
+
+    Every 32 packed booleans of the structure share a ``uint32_t``
+    """
+    res = {}
+    for k, v in members.items():
+        if isinstance(v, load.Bool) and getattr(v, 'packed', False):
+            res[k] = ('_bits_{0}'.format(len(res) // 32), len(res) % 32)
+    return res
+
 def cbool(val):
     return 'TRUE' if val else 'FALSE'
 
 def makevar(val):
     return varname(val).replace('.', '_').replace(' ', '_')
+
+def array_indexes(cfg, item):
+    """Returns list of (member, unique) for indexes declared on the array"""
+    res = []
+    for attr, unique in (('unique_index', True), ('index', False)):
+        names = getattr(item, attr, None)
+        if names is None:
+            continue
+        if isinstance(names, str):
+            names = [names]
+        for name in names:
+            if not isinstance(item.element, load.Struct):
+                raise ValueError("{0}: only arrays of structures can be "
+                    "indexed".format(item.start_mark))
+            if int(getattr(item, 'capacity', 0)):
+                raise ValueError("{0}: inline arrays can't be indexed"
+                    .format(item.start_mark))
+            member = cfg.types[item.element.type].members.get(name)
+            if member is None:
+                raise ValueError("{0}: can't index by {1!r}, structure "
+                    "{2!r} has no member named {1!r}"
+                    .format(item.start_mark, name, item.element.type))
+            if member.__class__ not in string_types + (load.Int, load.UInt):
+                raise ValueError("{0}: can't index by {1!r}, only string "
+                    "and integer members can be indexed"
+                    .format(item.start_mark, name))
+            if inline_size(member):
+                raise ValueError("{0}: can't index by {1!r}, inline strings "
+                    "can't be indexed".format(item.start_mark, name))
+            if member.__class__ not in string_types and int_width(member):
+                raise ValueError("{0}: can't index by {1!r}, integers with "
+                    "explicit width can't be indexed"
+                    .format(item.start_mark, name))
+            if any(name == n for n, _ in res):
+                continue
+            res.append((name, unique))
+    return res
+
+def mapping_indexed(item):
+    """Returns True if the mapping has a lookup index built by parser"""
+    return isinstance(item.key_element, string_types + (load.Int, load.UInt))
+
+def array_columns(cfg, item):
+    """Returns list of (member, ctype) stored as columns for the array"""
+    if not getattr(item, 'columns', False):
+        return []
+    if not isinstance(item.element, load.Struct):
+        raise ValueError("{0}: columns can only be made for arrays of "
+            "structures".format(item.start_mark))
+    utype = cfg.types[item.element.type]
+    res = []
+    if hasattr(utype, 'tagname'):
+        res.append((utype.tagname, 'int'))
+    packed = packed_bools(utype.members)
+    for k, v in utype.members.items():
+        if k.startswith('_') or v.__class__ not in types:
+            continue
+        if isinstance(v, load.VoidPtr) or k in packed:
+            continue
+        res.append((k, ctype(v)))
+    return res
+
+# Parsed at runtime into a ready structure, so there are no defaults
+parsed_types = {
+    load.Address: 'coyaml_sockaddr_t',
+    load.CIDR: 'coyaml_network_t',
+    load.StringSet: 'coyaml_hashset_t',
+    }
+
+def parsed_type(item):
+    """Returns C type of the ``!Address``, ``!CIDR`` or ``!StringSet``"""
+    if getattr(item, 'default_', None) not in (None, ''):
+        raise ValueError("{0}: {1} can't have a default, it's parsed "
+            "when config is read".format(item.start_mark, item.yaml_tag))
+    return parsed_types[item.__class__]
+
+def address_port(item):
+    """Returns port used when the address has none, -1 if it's required"""
+    port = int(getattr(item, 'default_port', -1))
+    if not -1 <= port <= 65535:
+        raise ValueError("{0}: bad default port".format(item.start_mark))
+    return port
+
+def regex_flags(item):
+    """Returns names of ``regcomp()`` flags for the ``!Regex``"""
+    if getattr(item, 'default_', None) not in (None, ''):
+        raise ValueError("{0}: regex can't have a default, patterns are "
+            "compiled when config is read".format(item.start_mark))
+    flags = ['REG_EXTENDED']
+    if getattr(item, 'ignore_case', False):
+        flags.append('REG_ICASE')
+    if getattr(item, 'newline', False):
+        flags.append('REG_NEWLINE')
+    return flags
+
+def array_set(item):
+    """Returns True if the array has a set for matching all elements at once
+
+    Patterns of regex arrays are combined on request, arrays of networks
+    always have a radix tree
+    """
+    if isinstance(item.element, load.CIDR):
+        return True
+    if not getattr(item, 'combined', False):
+        return False
+    if not isinstance(item.element, load.Regex):
+        raise ValueError("{0}: only arrays of regexes can be combined"
+            .format(item.start_mark))
+    return True
+
+def fnv1a(data, hash=0xcbf29ce484222325):
+    """Returns the same as ``coyaml_hash()`` of libcoyaml"""
+    for c in data:
+        hash = ((hash ^ c) * 0x100000001b3) & 0xffffffffffffffff
+    return hash
+
+def perfect_hash(names):
+    """Returns (seed, slots) having every name in its own slot
+
+    Slot of the name is ``hash ^ hash >> 32`` masked by the size of the
+    table, where hash is ``fnv1a()`` of the name starting with seed. The
+    slot holds index of the name plus one, zero for the empty slot
+    """
+    size = 1
+    while size < len(names):
+        size *= 2
+    while True:
+        for i in range(1000):
+            # Kept below 2**63 to be a valid `long` literal in C
+            seed = (0xcbf29ce484222325 + i*0x9e3779b97f4a7c15) \
+                & 0x7fffffffffffffff
+            slots = [0]*size
+            for n, name in enumerate(names):
+                hash = fnv1a(name.encode('utf-8'), seed)
+                slot = (hash ^ (hash >> 32)) & (size - 1)
+                if slots[slot]:
+                    break
+                slots[slot] = n + 1
+            else:
+                return seed, slots
+        size *= 2
+
+def choices(item):
+    """Returns names of the ``!Choice`` or ``!Flags``, value is the index
+
+    Placeholders of the ``!Format`` are the same kind of names
+    """
+    attr = 'placeholders' if isinstance(item, load.Format) else 'choices'
+    names = getattr(item, attr, None)
+    if not isinstance(names, list) or not names:
+        raise ValueError("{0}: list of {1} expected"
+            .format(item.start_mark, attr))
+    names = [str(n) for n in names]
+    if len(set(names)) != len(names):
+        raise ValueError("{0}: duplicate choice".format(item.start_mark))
+    if isinstance(item, load.Flags) and len(names) > 32:
+        raise ValueError("{0}: flags can't have more than 32 names"
+            .format(item.start_mark))
+    for n in names:
+        if not re_ident.match(makevar(n)):
+            raise ValueError("{0}: choice {1!r} can't be a C name"
+                .format(item.start_mark, n))
+    return names
+
+def choice_value(item, value):
+    """Returns integer stored for the choice name or the list of flags"""
+    names = choices(item)
+    if isinstance(item, load.Choice):
+        if value is None:
+            return 0
+        if str(value) not in names:
+            raise ValueError("{0}: unknown choice {1!r}"
+                .format(item.start_mark, value))
+        return names.index(str(value))
+    res = 0
+    for v in value or ():
+        if str(v) not in names:
+            raise ValueError("{0}: unknown flag {1!r}"
+                .format(item.start_mark, v))
+        res |= 1 << names.index(str(v))
+    return res
+
+def choice_typename(prefix, item):
+    """Returns name of the enum of ``!Choice`` or bitmask of ``!Flags``"""
+    kind = {
+        load.Choice: 'choice',
+        load.Flags: 'flags',
+        load.Format: 'placeholder',
+        }[item.__class__]
+    return '{0}_{1}_{2}_t'.format(prefix, makevar(item.name), kind)
+
+def choice_constant(prefix, item, name):
+    return '{0}_{1}_{2}'.format(prefix, makevar(item.name),
+        makevar(name)).upper()
+
+def format_strftime(item):
+    """Returns True for ``strftime()`` format, False if it has placeholders"""
+    strftime = bool(getattr(item, 'strftime', False))
+    if strftime == hasattr(item, 'placeholders'):
+        raise ValueError("{0}: format must have either `placeholders` or "
+            "`strftime: yes`".format(item.start_mark))
+    return strftime
+
+_re_conversion = re.compile(r'%[-_0^#]*[0-9]*[EO]?([A-Za-z])')
+
+def format_segments(item, value):
+    """Returns (placeholder, text) of segments of the ``!Format`` template
+
+    The same as ``coyaml_format_compile()``: placeholder is the index of
+    the name or the ``strftime()`` conversion character, -1 for literal
+    text. Adjacent literals are merged and escapes are unescaped
+    """
+    res = []
+    def literal(text):
+        if res and res[-1][0] == -1:
+            res[-1] = (-1, res[-1][1] + text)
+        else:
+            res.append((-1, text))
+    pos = 0
+    if format_strftime(item):
+        while pos < len(value):
+            if value.startswith('%%', pos):
+                literal('%')
+                pos += 2
+            elif value[pos] == '%':
+                m = _re_conversion.match(value, pos)
+                if not m:
+                    raise ValueError("{0}: bad conversion in {1!r}"
+                        .format(item.start_mark, value))
+                res.append((ord(m.group(1)), m.group(0)))
+                pos = m.end()
+            else:
+                literal(value[pos])
+                pos += 1
+        return res
+    names = choices(item)
+    while pos < len(value):
+        if value.startswith('{{', pos) or value.startswith('}}', pos):
+            literal(value[pos])
+            pos += 2
+        elif value[pos] == '{':
+            end = value.find('}', pos)
+            if end < 0 or value[pos+1:end] not in names:
+                raise ValueError("{0}: bad placeholder in {1!r}"
+                    .format(item.start_mark, value))
+            res.append((names.index(value[pos+1:end]), value[pos:end+1]))
+            pos = end + 1
+        elif value[pos] == '}':
+            raise ValueError("{0}: unmatched brace in {1!r}"
+                .format(item.start_mark, value))
+        else:
+            literal(value[pos])
+            pos += 1
+    return res
@@ -0,0 +1,30 @@
+from collections import OrderedDict
+
+from .textast import Node, ListConstraint as List
+
+__all__ = [
+    'Code', 'Block',
+    ]
+
+# C++ is only emitted as views over the C structures, so nodes are
+# lines of code and blocks of them rather than a full syntax tree
+
+class Code(Node):
+    __slots__ = OrderedDict([
+        ('line', str),
+        ])
+    top = True
+    line_format = '{line}'
+
+class Block(Node):
+    __slots__ = OrderedDict([
+        ('head', str),
+        ('body', List(Node)),
+        ('tail', str),
+        ])
+    top = True
+    block_start = '{head} {{'
+    block_end = '}}{tail}'
+
+    def fmt_tail(self):
+        return getattr(self, 'tail', None) or ''
@@ -0,0 +1,296 @@
+from . import load
+from .util import parse_int, parse_float
+from .cutil import varname, typename, string, makevar, ctype, int_range
+from .cutil import inline_size, choice_value, choice_typename
+from .cutil import choice_constant, parsed_type
+from .cast import CommentBlock, Ifndef, Define, Endif, Include, StdInclude
+from .cxxast import *
+from .textast import VSpace
+
+# Names which are fine in C but not in C++, `unix` and `linux` are
+# predefined macros with GNU extensions
+reserved = {
+    'alignas', 'alignof', 'and', 'asm', 'auto', 'catch', 'class',
+    'concept', 'const_cast', 'constexpr', 'decltype', 'delete',
+    'dynamic_cast', 'explicit', 'export', 'friend', 'linux', 'mutable',
+    'namespace', 'new', 'noexcept', 'not', 'nullptr', 'operator', 'or',
+    'private', 'protected', 'public', 'reinterpret_cast', 'requires',
+    'static_assert', 'static_cast', 'template', 'this', 'throw', 'try',
+    'typeid', 'typename', 'unix', 'using', 'virtual', 'xor',
+    }
+
+def cxxname(name):
+    if name in reserved:
+        return name + '_'
+    return name
+
+
+# Views over the generated C structures. Every view holds a pointer to
+# the structure and has a method per member, which is a single load or
+# a range over the elements, so it inlines to the same code as in C
+
+
+class View(object):
+    """Class of the C++ view and methods it has"""
+
+    def __init__(self, name, ctype):
+        self.name = name
+        self.ctype = ctype
+        self.methods = []  # (return type, name, expression)
+        self.constants = []  # (type, name, value)
+
+
+class GenCxxCode(object):
+
+    def __init__(self, cfg, header):
+        self.cfg = cfg
+        self.prefix = cfg.name
+        self.header = header
+        self.ns = '::' + self.prefix
+        self.views = []
+        self.getters = []  # (name, element type, return type, expression)
+        self._visited = set()
+
+    def make(self, ast):
+        ast(CommentBlock(
+            'THIS IS AUTOGENERATED FILE',
+            'DO NOT EDIT!!!',
+            ))
+        guard = '_HPP_'+self.cfg.targetname.upper()
+        ast(Ifndef(guard))
+        ast(Define(guard))
+        ast(StdInclude('coyaml_hdr.hpp'))
+        with ast(Block('extern "C"', ast.block())) as ext:
+            ext(Include(self.header))
+        ast(VSpace())
+        for name, utype in self.cfg.types.items():
+            self._usertype(name, utype)
+        self._group(View('main', self.prefix+'_main_t'), self.cfg.data)
+        with ast(Block('namespace '+self.prefix, ast.block(),
+            tail='  // namespace '+self.prefix)) as ns:
+            ns(VSpace())
+            self._enums(ns)
+            for view in self.views:
+                ns(Code('class {0};'.format(view.name)))
+            ns(VSpace())
+            self._getters(ns)
+            for view in self.views:
+                self._class(ns, view)
+            self._definitions(ns)
+        ast(VSpace())
+        ast(Endif(guard))
+
+    # Collecting views
+
+    def _usertype(self, name, utype):
+        view = View(varname(name), '{0}_{1}_t'.format(self.prefix, name))
+        if hasattr(utype, 'tagname'):
+            view.methods.append((self._tag_type(name),
+                cxxname(varname(utype.tagname)),
+                'static_cast<{0}>(c_->{1})'.format(self._tag_type(name),
+                    varname(utype.tagname))))
+        self._group(view, utype.members)
+
+    def _group(self, view, members):
+        self.views.append(view)
+        for k, v in members.items():
+            if k.startswith('_'):
+                continue
+            mem = varname(k)
+            if isinstance(v, dict):
+                sub = View('{0}_{1}'.format(view.name, mem),
+                    'decltype(std::declval<{0}>().{1})'.format(
+                        view.ctype, mem))
+                view.methods.append((self.ns+'::'+sub.name, cxxname(mem),
+                    '{0}::{1}(c_->{2})'.format(self.ns, sub.name, mem)))
+                self._group(sub, v)
+                continue
+            typ, expr = self._read(v, 'c_->'+mem)
+            view.methods.append((typ, cxxname(mem), expr))
+            self._constants(view, mem, v)
+
+    def _constants(self, view, mem, item):
+        # Usable in compile-time specialization
+        default = getattr(item, 'default_', None)
+        if isinstance(item, (load.Int, load.UInt)):
+            typ = ctype(item)
+            low, high = int_range(item)
+            if default is not None:
+                view.constants.append((typ, mem+'_default',
+                    str(parse_int(default))))
+            if low is not None:
+                view.constants.append((typ, mem+'_min', str(low)))
+            if high is not None:
+                view.constants.append((typ, mem+'_max', str(high)))
+        elif isinstance(item, load.Float):
+            if default is not None:
+                view.constants.append(('double', mem+'_default',
+                    repr(parse_float(default))))
+            for attr in ('min', 'max'):
+                if hasattr(item, attr):
+                    view.constants.append(('double', mem+'_'+attr,
+                        repr(parse_float(getattr(item, attr)))))
+        elif isinstance(item, load.Bool):
+            if default is not None:
+                view.constants.append(('bool', mem+'_default',
+                    'true' if default else 'false'))
+        elif isinstance(item, (load.Choice, load.Flags)):
+            if isinstance(item, load.Choice) and default is not None:
+                choice_value(item, default)  # validates the name
+                view.constants.append((choice_typename(self.prefix, item),
+                    mem+'_default',
+                    choice_constant(self.prefix, item, default)))
+            elif default is not None:
+                view.constants.append((choice_typename(self.prefix, item),
+                    mem+'_default', str(choice_value(item, default))))
+        elif isinstance(item, (load.String, load.File, load.Dir)):
+            # Variables are substituted at load, so value is unknown
+            if default is not None and '$' not in str(default):
+                view.constants.append(('std::string_view', mem+'_default',
+                    string(str(default))))
+
+    def _read(self, item, src):
+        # Returns C++ type and expression reading the member at `src`
+        if isinstance(item, (load.Int, load.UInt)):
+            return ctype(item), src
+        elif isinstance(item, load.Float):
+            return 'double', src
+        elif isinstance(item, load.Bool):
+            return 'bool', src + ' != 0'
+        elif isinstance(item, (load.Choice, load.Flags)):
+            return choice_typename(self.prefix, item), src
+        elif isinstance(item, load.Regex):
+            return 'const regex_t *', src + '_re'
+        elif isinstance(item, load.Format):
+            return 'const coyaml_template_t &', src + '_tpl'
+        elif isinstance(item, (load.Address, load.CIDR, load.StringSet)):
+            return 'const {0} &'.format(parsed_type(item)), src
+        elif isinstance(item, (load.String, load.File, load.Dir)):
+            data = src
+            if inline_size(item):
+                data = '{0} ? {0} : {0}_inline'.format(src)
+            return 'std::string_view', '::coyaml::str({0}, {1}_len)'.format(
+                data, src)
+        elif isinstance(item, load.Struct):
+            name = '{0}::{1}'.format(self.ns, varname(item.type))
+            return name, '{0}({1})'.format(name, src)
+        elif isinstance(item, (load.CStruct, load.CType)):
+            return 'const {0} &'.format(typename(item)), src
+        elif isinstance(item, load.VoidPtr):
+            return 'void *', src
+        elif isinstance(item, load.Array):
+            tname = '{0}_a_{1}'.format(self.prefix, typename(item.element))
+            getter = self._getter('a_'+typename(item.element), tname+'_t',
+                [item.element])
+            if int(getattr(item, 'capacity', 0)) \
+                or getattr(item, 'contiguous', False):
+                typ = '::coyaml::span<{0}_t, {1}>'.format(tname, getter)
+            else:
+                typ = '::coyaml::list<{0}_t, {1}>'.format(tname, getter)
+            return typ, '{0}({1}, {1}_len)'.format(typ, src)
+        elif isinstance(item, load.Mapping):
+            tname = '{0}_m_{1}_{2}'.format(self.prefix,
+                typename(item.key_element), typename(item.value_element))
+            getter = self._getter('m_{0}_{1}'.format(
+                typename(item.key_element), typename(item.value_element)),
+                tname+'_t', [item.key_element, item.value_element])
+            typ = '::coyaml::list<{0}_t, {1}>'.format(tname, getter)
+            return typ, '{0}({1}, {1}_len)'.format(typ, src)
+        raise NotImplementedError(item)
+
+    def _getter(self, name, eltype, elements):
+        # Element of array is converted to view of `value`, element of
+        # mapping to pair of views of `key` and `value`
+        name = '{0}::detail::{1}'.format(self.ns, name)
+        if name in self._visited:
+            return name
+        self._visited.add(name)
+        if len(elements) == 1:
+            typ, expr = self._read(elements[0], 'el.value')
+        else:
+            ktyp, kexpr = self._read(elements[0], 'el.key')
+            vtyp, vexpr = self._read(elements[1], 'el.value')
+            typ = 'std::pair<{0}, {1}>'.format(ktyp, vtyp)
+            expr = '{0}({1}, {2})'.format(typ, kexpr, vexpr)
+        self.getters.append((name, eltype, typ, expr))
+        return name
+
+    def _tag_type(self, name):
+        return '{0}::{1}_tag'.format(self.ns, varname(name))
+
+    # Output
+
+    def _enums(self, ns):
+        for name, utype in self.cfg.types.items():
+            if not hasattr(utype, 'tags'):
+                continue
+            with ns(Block('enum class {0}_tag : int'.format(varname(name)),
+                ns.block(), tail=';')) as enum:
+                for k, v in utype.tags.items():
+                    enum(Code('{0} = {1},'.format(cxxname(makevar(k)), v)))
+            ns(VSpace())
+
+    def _getters(self, ns):
+        if not self.getters:
+            return
+        with ns(Block('namespace detail', ns.block(),
+            tail='  // namespace detail')) as det:
+            for name, eltype, typ, expr in self.getters:
+                with det(Block('struct '+name.rsplit('::', 1)[1],
+                    det.block(), tail=';')) as st:
+                    st(Code('static {0} get(const {1} &el) noexcept;'
+                        .format(typ, eltype)))
+        ns(VSpace())
+
+    def _class(self, ns, view):
+        with ns(Block('class '+view.name, ns.block(), tail=';')) as cls:
+            cls(Code('public:'))
+            cls(Code('using c_type = {0};'.format(view.ctype)))
+            cls(VSpace())
+            cls(Code('constexpr explicit {0}(const c_type &c) noexcept'
+                ' : c_(&c) {{}}'.format(view.name)))
+            cls(Code('constexpr const c_type &c_struct() const noexcept '
+                '{ return *c_; }'))
+            for typ, name, expr in view.methods:
+                cls(Code('{0} {1}() const noexcept;'.format(typ, name)))
+            if view.constants:
+                cls(VSpace())
+            for typ, name, value in view.constants:
+                cls(Code('static constexpr {0} {1} = {2};'
+                    .format(typ, name, value)))
+            cls(VSpace())
+            cls(Code('private:'))
+            cls(Code('const c_type *c_;'))
+        ns(VSpace())
+
+    def _definitions(self, ns):
+        # Names are relative, `::cfg::x ::cfg::y::z()` would be parsed as
+        # a single qualified name
+        for name, eltype, typ, expr in self.getters:
+            with ns(Block('inline {0} detail::{1}::get(const {2} &el) '
+                'noexcept'.format(typ, name.rsplit('::', 1)[1], eltype),
+                ns.block())) as fun:
+                fun(Code('return {0};'.format(expr)))
+        for view in self.views:
+            for typ, name, expr in view.methods:
+                with ns(Block('inline {0} {1}::{2}() const noexcept'
+                    .format(typ, view.name, name),
+                    ns.block())) as fun:
+                    fun(Code('return {0};'.format(expr)))
+        ns(VSpace())
+
+
+def main():
+    from .cli import simple
+    from .load import load
+    from .textast import Ast
+    cfg, inp, opt = simple()
+    with inp:
+        load(inp, cfg)
+    with Ast() as ast:
+        GenCxxCode(cfg, cfg.targetname+'.h').make(ast)
+    print(str(ast))
+
+if __name__ == '__main__':
+    from .cxxgen import main
+    main()
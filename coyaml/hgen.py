@@ -1,14 +1,20 @@
 
 from . import load
 from .cutil import varname, typename, string_types, makevar
+from .cutil import array_indexes, array_columns, ctype, int_width
+from .cutil import packed_bools, inline_size, hot_first, heat
+from .cutil import choice_types, choices, choice_typename, choice_constant
+from .cutil import array_set, parsed_type, format_strftime, mapping_indexed
 from .cast import *
 from .textast import VSpace
 
 class GenHCode(object):
 
-    def __init__(self, cfg):
+    def __init__(self, cfg, baked=False):
         self.cfg = cfg
         self.prefix = self.cfg.name
+        self.baked = baked
+        self.profile = getattr(cfg, 'profile', None)
         self._visited = set()
 
     def make(self, ast):
@@ -24,6 +30,7 @@ class GenHCode(object):
         for i in getattr(self.cfg.meta, 'c_include', []):
             ast(Include(i))
         ast(VSpace())
+        self._choices(ast)
         defined = {}
         for sname, struct in self.cfg.types.items():
             if hasattr(struct, 'tags'):
@@ -43,18 +50,23 @@ class GenHCode(object):
                     ast(TypeDef('int', tagtyp))
                 ast(VSpace())
             cname = self.prefix+'_'+sname
+            pre = ast.zone()
             with ast(TypeDef(Struct(cname+'_s', ast.block()),
                 cname+'_t')) as s:
                 if hasattr(struct, 'tags'):
                     s(Var(tagtyp, struct.tagname))
-                self._struct_body(s, struct.members, root=ast)
+                self._struct_body(s, struct.members, root=ast, pre=pre)
             ast(VSpace())
+        pre = ast.zone()
         with ast(TypeDef(Struct(self.prefix+'_main_s', ast.block()),
             self.prefix+'_main_t')) as ms:
             ms(Var('coyaml_head_t', 'head'))
-            self._struct_body(ms, self.cfg.data, root=ast)
+            self._struct_body(ms, self.cfg.data, root=ast, pre=pre, path=())
         ast(VSpace())
-        ast(Var(Typename('coyaml_cmdline_t'), self.prefix+'_cmdline'))
+        self._accessors(ast)
+        ast(VSpace())
+        ast(Var(Typename('coyaml_cmdline_t'), self.prefix+'_cmdline',
+            extern=True))
         ast(Func(Typename(self.prefix+'_main_t *'), self.prefix+'_init', [
             Param(Typename(self.prefix+'_main_t *'), 'target'),
             ]))
@@ -70,27 +82,184 @@ class GenHCode(object):
             Param(Typename('int'), 'argc'),
             Param(Typename('char **'), 'argv'),
             ]))
+        ast(Func(Typename('void *'), self.prefix+'_get', [
+            Param(Typename(self.prefix+'_main_t *'), 'cfg'),
+            Param(Typename('const char *'), 'path'),
+            ]))
+        ast(Func('int', self.prefix+'_set', [
+            Param(Typename(self.prefix+'_main_t *'), 'cfg'),
+            Param(Typename('const char *'), 'path'),
+            Param(Typename('char *'), 'value'),
+            ]))
+        ast(Func('int', self.prefix+'_print_path', [
+            Param(Typename('FILE *'), 'out'),
+            Param(Typename(self.prefix+'_main_t *'), 'cfg'),
+            Param(Typename('const char *'), 'path'),
+            Param(Typename('int'), 'mode'),
+            ]))
+        if 'stringset' in self._visited:
+            ast(Func('int', self.prefix+'_contains', [
+                Param(Typename('const coyaml_hashset_t *'), 'set'),
+                Param(Typename('const char *'), 'str'),
+                Param(Typename('size_t'), 'len'),
+                ]))
+        if self.baked:
+            ast(Var(Typename('const '+self.prefix+'_main_t'),
+                self.prefix+'_baked', extern=True))
+            ast(Func(Typename(self.prefix+'_main_t *'),
+                self.prefix+'_baked_load', [
+                Param(Typename(self.prefix+'_main_t *'), 'target'),
+                Param(Typename('int'), 'argc'),
+                Param(Typename('char **'), 'argv'),
+                ]))
         ast(Endif('_H_'+self.cfg.targetname.upper()))
 
+    def _choices(self, ast):
+        # Members having the same name share the enum, unless it's
+        # renamed with `name`
+        defined = {}
+        items = []
+        def visit(members):
+            for v in members.values():
+                if isinstance(v, dict):
+                    visit(v)
+                elif isinstance(v, choice_types):
+                    items.append(v)
+                elif isinstance(v, load.Format) and not format_strftime(v):
+                    items.append(v)
+        for utype in self.cfg.types.values():
+            visit(utype.members)
+        visit(self.cfg.data)
+        for item in items:
+            tname = choice_typename(self.prefix, item)
+            names = choices(item)
+            if tname in defined:
+                if defined[tname] != names:
+                    raise ValueError("{0}: choices differ from other {1!r}, "
+                        "set distinct `name`".format(item.start_mark,
+                        item.name))
+                continue
+            defined[tname] = names
+            if isinstance(item, (load.Choice, load.Format)):
+                with ast(TypeDef(Enum(ast.block()), tname)) as enum:
+                    for i, n in enumerate(names):
+                        enum(EnumVal(choice_constant(self.prefix, item, n),
+                            Int(i)))
+            else:
+                with ast(Anonymous(Enum(ast.block()))) as enum:
+                    for i, n in enumerate(names):
+                        enum(EnumVal(choice_constant(self.prefix, item, n),
+                            Int(1 << i)))
+                ast(TypeDef('uint32_t', tname))
+            ast(VSpace())
+
     def _simple_type(self, ast, typ, name):
-        if isinstance(typ, load.Struct):
+        if isinstance(typ, choice_types):
+            ast(Var(Typename(choice_typename(self.prefix, typ)),
+                varname(name)))
+        elif isinstance(typ, load.Struct):
             ast(Var(Typename(self.prefix+'_'+typ.type+'_t'), varname(name)))
+        elif isinstance(typ, (load.Address, load.CIDR, load.StringSet)):
+            ast(Var(Typename(parsed_type(typ)), varname(name)))
+            if isinstance(typ, load.StringSet):
+                self._visited.add('stringset')
+        elif isinstance(typ, load.Regex):
+            ast(Var(Typename('char *'), varname(name)))
+            ast(Var(Typename('size_t'), varname(name)+'_len'))
+            ast(Var(Typename('regex_t *'), varname(name)+'_re'))
+        elif isinstance(typ, load.Format):
+            ast(Var(Typename('char *'), varname(name)))
+            ast(Var(Typename('size_t'), varname(name)+'_len'))
+            ast(Var(Typename('coyaml_template_t'), varname(name)+'_tpl'))
         elif isinstance(typ, string_types):
             ast(Var(Typename('char *'), varname(name)))
             ast(Var(Typename('size_t'), varname(name)+'_len'))
+            size = inline_size(typ)
+            if size:
+                ast(Var(Typename('char'), varname(name)+'_inline',
+                    array=(size,)))
         else:
-            ast(Var(Typename(typename(typ)), varname(name)))
+            ast(Var(Typename(ctype(typ)), varname(name)))
 
-    def _struct_body(self, ast, dic, root):
-        for k, v in dic.items():
-            if isinstance(v, dict):
+    def _element_type(self, typ):
+        # Element types are shared by name, so storage must be the default
+        if isinstance(typ, (load.Int, load.UInt)) and int_width(typ):
+            raise ValueError("{0}: width can only be set on structure "
+                "members".format(typ.start_mark))
+        if isinstance(typ, choice_types):
+            raise ValueError("{0}: choices and flags can only be structure "
+                "members".format(typ.start_mark))
+        if isinstance(typ, load.StringSet):
+            raise ValueError("{0}: string sets can only be structure "
+                "members".format(typ.start_mark))
+        if isinstance(typ, load.Format):
+            raise ValueError("{0}: formats can only be structure "
+                "members".format(typ.start_mark))
+        if isinstance(typ, load.String) and inline_size(typ):
+            raise ValueError("{0}: only structure members can be inline"
+                .format(typ.start_mark))
+
+    def _packed_bools(self, ast, packed, word):
+        # Bits are also accessible as a whole word for copying and baking
+        with ast(Anonymous(AnonUnion(ast.block()))) as union:
+            union(Var(Typename('uint32_t'), word))
+            with union(Anonymous(AnonStruct(ast.block()))) as bits:
+                for k, (w, bit) in packed.items():
+                    if w == word:
+                        bits(BitField(Typename('unsigned int'),
+                            varname(k), 1))
+
+    def _accessors(self, ast):
+        # Reads through the macro are counted when built with profiling,
+        # the dumped profile is used to lay out the structure
+        macro = self.prefix.upper()+'_GET'
+        ast(Ifdef('COYAML_PROFILE'))
+        ast(Var(Typename('unsigned long'), self.prefix+'_profile',
+            array=(None,), extern=True))
+        ast(Func('int', self.prefix+'_profile_dump', [
+            Param(Typename('FILE *'), 'out'),
+            ]))
+        ast(Macro(macro, [Ident('cfg'), Ident('member')],
+            '({0}_profile[offsetof({0}_main_t, member)]++, (cfg)->member)'
+            .format(self.prefix)))
+        ast(Else())
+        ast(Macro(macro, [Ident('cfg'), Ident('member')],
+            '((cfg)->member)'))
+        ast(Endif('COYAML_PROFILE'))
+
+    def _struct_body(self, ast, dic, root, pre, path=None):
+        # Element types of inline arrays must be complete before the
+        # structure, so they are put in the `pre` zone.
+        # Members of the main structure are ordered by `profile` if
+        # there is one, `path` is set for them
+        packed = packed_bools(dic)
+        keys = list(dic)
+        hot = None
+        if path is not None and self.profile:
+            keys = hot_first(dic, self.profile, path)
+            if not path and keys and heat(dic[keys[0]],
+                    self.profile, (keys[0],)):
+                hot = len(ast.content)
+        for k in keys:
+            v = dic[k]
+            if k in packed:
+                word, bit = packed[k]
+                if bit == 0:
+                    self._packed_bools(ast, packed, word)
+            elif isinstance(v, dict):
                 with ast(Var(AnonStruct(ast.block()), varname(k))) as ss:
-                    self._struct_body(ss, v, root=root)
+                    self._struct_body(ss, v, root=root, pre=pre,
+                        path=path + (k,) if path is not None else None)
             elif isinstance(v, load.Mapping):
                 tname = '{0}_m_{1}_{2}'.format(self.prefix,
                     typename(v.key_element), typename(v.value_element))
+                self._element_type(v.key_element)
+                self._element_type(v.value_element)
                 ast(Var(Typename('struct '+tname+'_s *'), varname(k)))
                 ast(Var('size_t', varname(k)+'_len'))
+                if mapping_indexed(v):
+                    ast(Var(Typename('struct coyaml_index_s *'),
+                        varname(k)+'_index'))
                 if tname in self._visited:
                     continue
                 self._visited.add(tname)
@@ -104,25 +273,111 @@ class GenHCode(object):
                     [Ident('name'), Ident('source')],
                     'for({0}_t *name = source; name; name = name->head.next)'
                     .format(tname)))
+                if not mapping_indexed(v):
+                    continue
+                if isinstance(v.key_element, string_types):
+                    params = [ Param(Typename('const char *'), 'key'),
+                               Param(Typename('size_t'), 'keylen') ]
+                else:
+                    params = [ Param(Typename('long'), 'key') ]
+                root(Func(Typename(tname+'_t *'),
+                    tname.replace('_m_', '_', 1)+'_find',
+                    [ Param(Typename(tname+'_t *'), 'map'),
+                      Param(Typename('struct coyaml_index_s *'), 'index'),
+                    ] + params))
             elif isinstance(v, load.Array):
                 tname = '{0}_a_{1}'.format(self.prefix,
                     typename(v.element))
-                ast(Var(Typename('struct '+tname+'_s *'), varname(k)))
+                self._element_type(v.element)
+                capacity = int(getattr(v, 'capacity', 0))
+                if capacity:
+                    ast(Var(Typename('struct '+tname+'_s'), varname(k),
+                        array=(capacity,)))
+                else:
+                    ast(Var(Typename('struct '+tname+'_s *'), varname(k)))
                 ast(Var('size_t', varname(k)+'_len'))
+                if array_set(v):
+                    ast(Var(Typename('coyaml_cidrset_t *'
+                        if isinstance(v.element, load.CIDR)
+                        else 'coyaml_regexset_t *'), varname(k)+'_set'))
+                if array_indexes(self.cfg, v):
+                    ast(Var(Typename('struct coyaml_index_s **'),
+                        varname(k)+'_indexes'))
+                columns = array_columns(self.cfg, v)
+                if columns:
+                    ast(Var(Typename(tname+'_columns_t'),
+                        varname(k)+'_columns'))
+                    self._array_columns(pre, tname, columns)
                 if tname in self._visited:
+                    self._array_finds(root, tname, v)
                     continue
                 self._visited.add(tname)
-                root(VSpace())
-                with root(TypeDef(Struct(tname+'_s', ast.block()),
+                zone = pre if capacity else root
+                zone(VSpace())
+                with zone(TypeDef(Struct(tname+'_s', ast.block()),
                     tname+'_t')) as sub:
                     sub(Var(Typename('coyaml_arrayel_head_t'), 'head'))
                     self._simple_type(sub, v.element, 'value')
-                root(Macro(tname.replace('_a_', '_').upper()+'_LOOP',
+                macro = tname.replace('_a_', '_').upper()
+                zone(Macro(macro+'_LOOP',
                     [Ident('name'), Ident('source')],
                     'for({0}_t *name = source; name; name = name->head.next)'
                     .format(tname)))
+                # Only for `contiguous` and inline arrays
+                zone(Macro(macro+'_EACH',
+                    [Ident('name'), Ident('source'), Ident('len')],
+                    'for({0}_t *name = (source), *name##_end = name + (len); '
+                    'name < name##_end; ++name)'.format(tname)))
+                self._array_finds(root, tname, v)
             else:
                 self._simple_type(ast, v, k)
+        if hot is not None:
+            # Hot members start at the cache line right after the head
+            ast.content[hot].aligned = True
+
+    def _array_columns(self, pre, tname, columns):
+        # Every scalar member in its own vector, filled at load
+        name = tname+'_columns'
+        if name in self._visited:
+            return
+        self._visited.add(name)
+        pre(VSpace())
+        with pre(TypeDef(Struct(name+'_s', pre.block()),
+            name+'_t')) as sub:
+            for member, ctype in columns:
+                sub(Var(Typename(ctype+' *'), varname(member)))
+        macro = tname.replace('_a_', '_').upper()
+        pre(Macro(macro+'_COLUMN', [Ident('source'), Ident('member')],
+            '((__typeof__((source).member))__builtin_assume_aligned('
+            '(source).member, COYAML_COLUMN_ALIGN))'))
+        pre(Macro(macro+'_COLUMNS_LOOP', [Ident('i'), Ident('len')],
+            'for(size_t i = 0; i < (len); ++i)'))
+
+    def _array_finds(self, root, tname, item):
+        if isinstance(item.element, load.CIDR):
+            name = tname.replace('_a_', '_', 1)+'_match'
+            if name not in self._visited:
+                self._visited.add(name)
+                root(Func(Typename(tname+'_t *'), name, [
+                    Param(Typename('coyaml_cidrset_t *'), 'set'),
+                    Param(Typename('const struct sockaddr *'), 'addr'),
+                    ]))
+        for member, unique in array_indexes(self.cfg, item):
+            name = '{0}_find_by_{1}'.format(tname.replace('_a_', '_', 1),
+                varname(member))
+            if name in self._visited:
+                continue
+            self._visited.add(name)
+            typ = self.cfg.types[item.element.type].members[member]
+            if typ.__class__ in string_types:
+                params = [ Param(Typename('const char *'), 'key'),
+                           Param(Typename('size_t'), 'keylen') ]
+            else:
+                params = [ Param(Typename('long'), 'key') ]
+            root(Func(Typename(tname+'_t *'), name,
+                [ Param(Typename(tname+'_t *'), 'array'),
+                  Param(Typename('struct coyaml_index_s **'), 'indexes'),
+                ] + params))
 
 def main():
     from .cli import simple
@@ -132,7 +387,7 @@ def main():
     with inp:
         load(inp, cfg)
     with Ast() as ast:
-        GenHCode(cfg).make(ast)
+        GenHCode(cfg, baked=bool(opt.bake)).make(ast)
     print(str(ast))
 
 if __name__ == '__main__':
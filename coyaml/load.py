@@ -76,6 +76,34 @@ class Dir(YamlyType):
     yaml_tag = '!Dir'
     yaml_loader = ConfigLoader
 
+class Regex(YamlyType):
+    yaml_tag = '!Regex'
+    yaml_loader = ConfigLoader
+
+class Address(YamlyType):
+    yaml_tag = '!Address'
+    yaml_loader = ConfigLoader
+
+class CIDR(YamlyType):
+    yaml_tag = '!CIDR'
+    yaml_loader = ConfigLoader
+
+class Format(YamlyType):
+    yaml_tag = '!Format'
+    yaml_loader = ConfigLoader
+
+class StringSet(YamlyType):
+    yaml_tag = '!StringSet'
+    yaml_loader = ConfigLoader
+
+class Choice(YamlyType):
+    yaml_tag = '!Choice'
+    yaml_loader = ConfigLoader
+
+class Flags(YamlyType):
+    yaml_tag = '!Flags'
+    yaml_loader = ConfigLoader
+
 class Struct(yaml.YAMLObject):
     yaml_tag = '!Struct'
     yaml_loader = ConfigLoader
@@ -164,6 +192,12 @@ def load(input, config):
         config.add_type(typ)
     config.fill_data(data)
 
+def load_profile(filename):
+    """Loads counters of member reads, dumped by generated program"""
+    with open(filename, 'rb') as f:
+        data = yaml.safe_load(f) or {}
+    return {str(k): int(v) for k, v in data.items()}
+
 def main():
     from .cli import simple
     cfg, inp, opt = simple()
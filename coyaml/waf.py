@@ -1,3 +1,5 @@
+import os
+import hashlib
 
 try:
     from waflib import Task, TaskGen
@@ -9,27 +11,94 @@ def coyaml_decider(context, target):
         return ['.h', '.c']
     return None
 
+_generator_version = None
+
+def generator_version():
+    # Changes to generator must invalidate generated code as well as
+    # changes to the schema
+    global _generator_version
+    if _generator_version is not None:
+        return _generator_version
+    h = hashlib.sha1()
+    pkgdir = os.path.dirname(os.path.abspath(__file__))
+    for name in sorted(os.listdir(pkgdir)):
+        if name.endswith('.py'):
+            with open(os.path.join(pkgdir, name), 'rb') as f:
+                h.update(f.read())
+    _generator_version = h.hexdigest()
+    return _generator_version
+
+def source_hash(task):
+    h = hashlib.sha1()
+    h.update(generator_version().encode('ascii'))
+    h.update(getattr(task.generator, 'config_name', 'config').encode('utf-8'))
+    for node in task.inputs:
+        h.update(node.read('rb'))
+    for node in task.outputs:
+        h.update(node.name.encode('utf-8'))
+    return h.hexdigest()
+
+def stamp_line(digest):
+    return '/* coyaml source hash: {0} */\n'.format(digest)
+
+def up_to_date(task, stamp):
+    for node in task.outputs:
+        try:
+            with open(node.abspath(), 'rt', encoding='utf-8') as f:
+                if f.readline() != stamp:
+                    return False
+        except IOError:
+            return False
+    return True
+
 def coyaml_gen(task):
     if not task.outputs:
         return
-    from . import cgen, hgen, core, load, textast
+    from . import cgen, hgen, cxxgen, core, load, textast
     name = getattr(task.generator, 'config_name', 'config')
     src = task.inputs[0]
-    tgt = task.outputs[0]
-    cfg = core.Config(name, tgt.name[:-len(tgt.suffix())])
+    extra = list(task.inputs[1:])
+    bake = None
+    if getattr(task.generator, 'config_bake', None):
+        bake = extra.pop(0).abspath()
+    profile = None
+    if getattr(task.generator, 'config_profile', None):
+        profile = extra.pop(0)
+    stamp = stamp_line(source_hash(task))
+    # Files included by the baked instance are not known beforehand
+    if not bake and up_to_date(task, stamp):
+        return
+    outputs = list(task.outputs)
+    cxxtgt = None
+    if getattr(task.generator, 'config_cxx', False):
+        cxxtgt = outputs.pop()
+    htgt, ctgt = outputs[:2]
+    shards = outputs[2:]
+    cfg = core.Config(name, htgt.name[:-len(htgt.suffix())])
     with open(src.abspath(), 'rb') as f:
         load.load(f, cfg)
-    with open(tgt.abspath(), 'wt', encoding='utf-8') as f:
+    if profile is not None:
+        cfg.profile = load.load_profile(profile.abspath())
+    # Generators only annotate the loaded schema, so it's parsed once
+    gen = cgen.GenCCode(cfg, bake=bake, shards=len(shards)+1)
+    with textast.Ast() as ast:
+        hgen.GenHCode(cfg, baked=bool(bake)).make(ast)
+    write_output(htgt, stamp, ast)
+    with textast.Ast() as ast:
+        gen.make(ast)
+    write_output(ctgt, stamp, ast)
+    for i, tgt in enumerate(shards):
         with textast.Ast() as ast:
-            hgen.GenHCode(cfg).make(ast)
-        f.write(str(ast))
-    tgt = task.outputs[1]
-    cfg = core.Config(name, tgt.name[:-len(tgt.suffix())])
-    with open(src.abspath(), 'rb') as f:
-        load.load(f, cfg)
-    with open(tgt.abspath(), 'wt', encoding='utf-8') as f:
+            gen.make_shard(ast, i+1)
+        write_output(tgt, stamp, ast)
+    if cxxtgt is not None:
         with textast.Ast() as ast:
-            cgen.GenCCode(cfg).make(ast)
+            cxxgen.GenCxxCode(cfg, htgt.name).make(ast)
+        write_output(cxxtgt, stamp, ast)
+
+def write_output(node, stamp, ast):
+    with open(node.abspath(), 'wt', encoding='utf-8') as f:
+        f.write(stamp)
         f.write(str(ast))
 
 Task.task_type_from_func(
@@ -37,6 +106,7 @@ Task.task_type_from_func(
         func      = coyaml_gen, 
         ext_in    = '.yaml',
         ext_out   = ['.h', '.c'],
+        vars      = ['COYAML_GENERATOR'],
         before    = 'c',
 )
 
@@ -44,11 +114,33 @@ Task.task_type_from_func(
 def process_coyaml(self, node):
     if not 'coyaml' in self.features:
         return
-    cfile = node.change_ext('.c')
-    self.create_task('coyaml', node,
-        [node.change_ext('.h'), cfile])
-    self.source.append(cfile)
-    
+    bake = getattr(self, 'config_bake', None)
+    inputs = [node]
+    if bake:
+        # Instance config is compiled in, so generated files are
+        # named differently than ones for the same schema without it
+        suffix = '_baked'
+        inputs.append(self.path.find_resource(bake))
+    else:
+        suffix = ''
+    # Profile dumped by `<prefix>_profile_dump()`, used for the layout
+    profile = getattr(self, 'config_profile', None)
+    if profile:
+        inputs.append(self.path.find_resource(profile))
+    # Tables may be split into several files to compile them in parallel
+    shards = int(getattr(self, 'config_shards', 1))
+    cfiles = [node.change_ext(suffix+'.c')] + [
+        node.change_ext('{0}_{1}.c'.format(suffix, i))
+        for i in range(1, shards)]
+    # C++ views over the structures from the header
+    cxx = []
+    if getattr(self, 'config_cxx', False):
+        cxx = [node.change_ext(suffix+'.hpp')]
+    self.env.COYAML_GENERATOR = generator_version()
+    self.create_task('coyaml', inputs,
+        [node.change_ext(suffix+'.h')] + cfiles + cxx)
+    self.source.extend(cfiles)
+
 @TaskGen.feature('coyaml')
 def process_coyaml(self):
     pass
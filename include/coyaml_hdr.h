@@ -2,11 +2,20 @@
 #define COYAML_HDR_HEADER
 
 #include <stddef.h>
+#include <stdint.h>
 #include <obstack.h>
 #include <getopt.h>
 #include <stdio.h>
+#include <regex.h>
+#include <sys/socket.h>
 
+#ifdef __cplusplus
+extern "C" {
+// Structures must have the same layout as in C
+#define bool int
+#else
 typedef int bool;
+#endif
 #define FALSE 0
 #define TRUE 1
 #define ECOYAML_MIN 67575558 // Some random value
@@ -16,17 +25,121 @@ typedef int bool;
 #define ECOYAML_CLI_WRONG_OPTION (ECOYAML_MIN+3)
 #define ECOYAML_CLI_EXIT (ECOYAML_MIN+4)
 #define ECOYAML_CLI_HELP (ECOYAML_MIN+5)
-#define ECOYAML_MAX (ECOYAML_MIN+5)
+#define ECOYAML_LIMIT_EXCEEDED (ECOYAML_MIN+6)
+#define ECOYAML_MAX (ECOYAML_MIN+6)
+
+// Columns of arrays having `columns: yes` and hot members of the configs
+// generated with a profile start at the cache line
+#define COYAML_CACHE_LINE 64
+#define COYAML_COLUMN_ALIGN COYAML_CACHE_LINE
+#define COYAML_ALIGNED __attribute__((aligned(COYAML_CACHE_LINE)))
+
+// Value of a string declared with `inline: N`, short values are kept in
+// the `<member>_inline` buffer and the pointer is NULL then
+#define COYAML_STR(obj, member) \
+    ((obj).member ? (obj).member : (obj).member##_inline)
 
 struct coyaml_group_s;
 
 typedef int (*coyaml_print_fun)(FILE *out, void *cfg, int mode);
 
+// Resources which are not in `pieces`, e.g. compiled regular expressions,
+// are released by coyaml_config_free() in reverse order of adding
+typedef struct coyaml_cleanup_s {
+    struct coyaml_cleanup_s *next;
+    void (*fun)(void *);
+    void *data;
+} coyaml_cleanup_t;
+
 typedef struct coyaml_head_s {
     struct obstack pieces;
     bool free_object;
+    void *snapshot;
+    size_t snapshot_size;
+    coyaml_cleanup_t *cleanup;
 } coyaml_head_t;
 
+// Patterns of an array of `!Regex` having `combined: yes`, compiled as
+// a single alternation, so any number of them is matched in one pass
+typedef struct coyaml_regexset_s {
+    regex_t regex;
+    size_t count;
+    size_t *groups;  // subexpression number of each pattern
+} coyaml_regexset_t;
+
+typedef enum {
+    COYAML_SOCKADDR_NONE,  // not set
+    COYAML_SOCKADDR_INET,
+    COYAML_SOCKADDR_INET6,
+    COYAML_SOCKADDR_UNIX,
+    COYAML_SOCKADDR_FD,  // `&N`, already open descriptor in `fd`
+} coyaml_sockaddr_kind;
+
+// Value of `!Address`, ready for bind() or connect()
+typedef struct coyaml_sockaddr_s {
+    coyaml_sockaddr_kind kind;
+    int fd;
+    socklen_t addrlen;
+    struct sockaddr_storage addr;
+} coyaml_sockaddr_t;
+
+// Value of `!CIDR`, host bits of `addr` are cleared
+typedef struct coyaml_network_s {
+    int family;  // AF_INET or AF_INET6
+    int prefixlen;
+    unsigned char addr[16];  // network byte order
+} coyaml_network_t;
+
+// Binary radix tree of the networks of an array of `!CIDR`, one per family
+typedef struct coyaml_cidrnode_s {
+    struct coyaml_cidrnode_s *child[2];
+    void *element;  // having the prefix ending at the node, or NULL
+} coyaml_cidrnode_t;
+
+typedef struct coyaml_cidrset_s {
+    coyaml_cidrnode_t *inet;
+    coyaml_cidrnode_t *inet6;
+} coyaml_cidrset_t;
+
+// Value of `!StringSet`, a minimal perfect hash built at load. A string
+// with hash `h` can only be equal to the item in the slot computed from
+// `h` and the displacement of bucket `(h ^ h >> 32) & mask`. The tag of
+// the slot is `h >> 32`, so most strings which aren't in the set are
+// rejected without touching the item
+typedef struct coyaml_hashitem_s {
+    const char *value;
+    size_t len;
+} coyaml_hashitem_t;
+
+typedef struct coyaml_hashset_s {
+    size_t count;
+    size_t mask;
+    const uint32_t *displace;  // per bucket
+    const uint32_t *tags;  // per slot
+    const coyaml_hashitem_t *items;  // per slot
+    const uint32_t *order;  // slots in the order of the config
+} coyaml_hashset_t;
+
+// Piece of the `!Format` template. Placeholder is the index in the list
+// of placeholders of the member, or the conversion character, like 'Y',
+// for strftime() formats. Text is zero-terminated, for placeholders it is
+// the source, e.g. "{time}" or "%-d"
+typedef struct coyaml_segment_s {
+    int placeholder;  // -1 for literal text
+    const char *value;
+    size_t len;
+} coyaml_segment_t;
+
+// Compiled `!Format`, output is the concatenation of the segments
+typedef struct coyaml_template_s {
+    size_t count;
+    const coyaml_segment_t *segments;
+} coyaml_template_t;
+
+// Lookup index built by parser, stored next to the list in `<member>_index`
+// of mappings and `<member>_indexes` of indexed arrays
+struct coyaml_index_s;
+
 typedef struct coyaml_arrayel_head_s {
     void *next;
 } coyaml_arrayel_head_t;
@@ -46,6 +159,23 @@ typedef struct coyaml_cmdline_s {
     coyaml_print_fun print_callback;
 } coyaml_cmdline_t;
 
+// Zero value means no limit
+typedef struct coyaml_limits_s {
+    size_t max_input_bytes;
+    size_t max_events;
+    int max_depth;
+    size_t max_arena_bytes;
+    int max_includes;
+} coyaml_limits_t;
+
+typedef struct coyaml_counters_s {
+    size_t input_bytes;
+    size_t events;
+    int depth;
+    size_t arena_bytes;
+    int includes;
+} coyaml_counters_t;
+
 typedef struct coyaml_context_s {
     bool debug;
     bool parse_vars;
@@ -57,10 +187,18 @@ typedef struct coyaml_context_s {
     struct coyaml_env_var_s *env_vars;
     char *root_filename;
     bool free_object;
+    coyaml_limits_t limits;
+    coyaml_counters_t counters;
+    uint64_t schema_hash;
+    size_t target_size;
+    char *snapshot_filename;
+    bool event_cache;
+    bool table_driven;  // don't use parsers generated for groups
 
     struct obstack pieces;
     struct coyaml_variable_s *variables;
     struct coyaml_parseinfo_s *parseinfo;
+    struct coyaml_input_s *inputs;
 } coyaml_context_t;
 
 int coyaml_readfile(coyaml_context_t *ctx);
@@ -69,6 +207,30 @@ int coyaml_cli_parse(coyaml_context_t *, int argc, char **argv);
 int coyaml_env_parse(coyaml_context_t *ctx);
 void coyaml_context_free(coyaml_context_t *ctx);
 
+int coyaml_snapshot_write(coyaml_context_t *ctx, char *filename);
+int coyaml_snapshot_map(coyaml_context_t *ctx, char *filename);
+
+typedef struct coyaml_shared_s coyaml_shared_t;
+
+coyaml_shared_t *coyaml_shared_create(size_t slot_size, int nslots);
+int coyaml_shared_publish(coyaml_shared_t *sh, coyaml_context_t *ctx);
+const void *coyaml_shared_config(coyaml_shared_t *sh);
+uint64_t coyaml_shared_generation(coyaml_shared_t *sh);
+void coyaml_shared_free(coyaml_shared_t *sh);
+
+// Returns index of the pattern matching `str`, or -1 if none matches
+int coyaml_regexset_match(const coyaml_regexset_t *set, const char *str);
+
+// Returns element of the array of `!CIDR` having the longest prefix
+// containing `addr`, or NULL. IPv4-mapped IPv6 addresses match IPv4
+// networks
+void *coyaml_cidr_match(const coyaml_cidrset_t *set,
+    const struct sockaddr *addr);
+
+// Returns TRUE if `str` is in the `!StringSet`, takes constant time
+bool coyaml_hashset_contains(const coyaml_hashset_t *set,
+    const char *str, size_t len);
+
 int coyaml_set_string(coyaml_context_t *, char *name, char *data, int dlen);
 int coyaml_set_integer(coyaml_context_t *ctx, char *name, long value);
 
@@ -77,4 +239,9 @@ void coyaml_readfile_or_exit(coyaml_context_t *ctx);
 void coyaml_env_parse_or_exit(coyaml_context_t *ctx);
 void coyaml_cli_parse_or_exit(coyaml_context_t *ctx, int argc, char **argv);
 
+#ifdef __cplusplus
+#undef bool
+}
+#endif
+
 #endif // COYAML_HDR_HEADER
@@ -0,0 +1,165 @@
+#ifndef COYAML_HDR_HPP
+#define COYAML_HDR_HPP
+
+// Building blocks of the C++ views generated for the configuration
+// structures. Views only hold a pointer to the C structure, so they are
+// passed by value and compile down to the same loads as the C code
+
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <utility>
+
+namespace coyaml {
+
+// Custom converters may set only the pointer of the string
+inline std::string_view str(const char *data, std::size_t len) noexcept {
+    if(!data) return std::string_view();
+    return len ? std::string_view(data, len) : std::string_view(data);
+}
+
+// Iterates over elements of arrays and mappings linked through
+// `head.next`, `Get::get()` converts the element to its C++ view
+template<typename El, typename Get>
+class list_iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = decltype(Get::get(std::declval<const El &>()));
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = value_type;
+
+    constexpr list_iterator() noexcept : el_(nullptr) {}
+    constexpr explicit list_iterator(const El *el) noexcept : el_(el) {}
+
+    value_type operator*() const noexcept { return Get::get(*el_); }
+    list_iterator &operator++() noexcept {
+        el_ = static_cast<const El *>(el_->head.next);
+        return *this;
+    }
+    list_iterator operator++(int) noexcept {
+        list_iterator res = *this;
+        ++*this;
+        return res;
+    }
+    constexpr bool operator==(const list_iterator &other) const noexcept {
+        return el_ == other.el_;
+    }
+    constexpr bool operator!=(const list_iterator &other) const noexcept {
+        return el_ != other.el_;
+    }
+    // Underlying C element
+    constexpr const El *element() const noexcept { return el_; }
+
+  private:
+    const El *el_;
+};
+
+template<typename El, typename Get>
+class list {
+  public:
+    using iterator = list_iterator<El, Get>;
+    using value_type = typename iterator::value_type;
+
+    constexpr list(const El *first, std::size_t size) noexcept
+        : first_(first), size_(size) {}
+
+    constexpr iterator begin() const noexcept { return iterator(first_); }
+    constexpr iterator end() const noexcept { return iterator(); }
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return !size_; }
+
+  private:
+    const El *first_;
+    std::size_t size_;
+};
+
+// Inline and contiguous arrays, elements are adjacent
+template<typename El, typename Get>
+class span_iterator {
+  public:
+    using iterator_category = std::random_access_iterator_tag;
+    using value_type = decltype(Get::get(std::declval<const El &>()));
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = value_type;
+
+    constexpr span_iterator() noexcept : el_(nullptr) {}
+    constexpr explicit span_iterator(const El *el) noexcept : el_(el) {}
+
+    value_type operator*() const noexcept { return Get::get(*el_); }
+    value_type operator[](difference_type n) const noexcept {
+        return Get::get(el_[n]);
+    }
+    span_iterator &operator++() noexcept { ++el_; return *this; }
+    span_iterator operator++(int) noexcept { return span_iterator(el_++); }
+    span_iterator &operator--() noexcept { --el_; return *this; }
+    span_iterator operator--(int) noexcept { return span_iterator(el_--); }
+    span_iterator &operator+=(difference_type n) noexcept {
+        el_ += n;
+        return *this;
+    }
+    span_iterator &operator-=(difference_type n) noexcept {
+        el_ -= n;
+        return *this;
+    }
+    constexpr span_iterator operator+(difference_type n) const noexcept {
+        return span_iterator(el_ + n);
+    }
+    constexpr span_iterator operator-(difference_type n) const noexcept {
+        return span_iterator(el_ - n);
+    }
+    constexpr difference_type operator-(const span_iterator &other)
+        const noexcept { return el_ - other.el_; }
+    constexpr bool operator==(const span_iterator &other) const noexcept {
+        return el_ == other.el_;
+    }
+    constexpr bool operator!=(const span_iterator &other) const noexcept {
+        return el_ != other.el_;
+    }
+    constexpr bool operator<(const span_iterator &other) const noexcept {
+        return el_ < other.el_;
+    }
+    constexpr bool operator>(const span_iterator &other) const noexcept {
+        return el_ > other.el_;
+    }
+    constexpr bool operator<=(const span_iterator &other) const noexcept {
+        return el_ <= other.el_;
+    }
+    constexpr bool operator>=(const span_iterator &other) const noexcept {
+        return el_ >= other.el_;
+    }
+    constexpr const El *element() const noexcept { return el_; }
+
+  private:
+    const El *el_;
+};
+
+template<typename El, typename Get>
+class span {
+  public:
+    using iterator = span_iterator<El, Get>;
+    using value_type = typename iterator::value_type;
+
+    constexpr span(const El *data, std::size_t size) noexcept
+        : data_(data), size_(size) {}
+
+    constexpr iterator begin() const noexcept { return iterator(data_); }
+    constexpr iterator end() const noexcept {
+        return iterator(data_ + size_);
+    }
+    constexpr std::size_t size() const noexcept { return size_; }
+    constexpr bool empty() const noexcept { return !size_; }
+    value_type operator[](std::size_t i) const noexcept {
+        return Get::get(data_[i]);
+    }
+    constexpr const El *data() const noexcept { return data_; }
+
+  private:
+    const El *data_;
+    std::size_t size_;
+};
+
+}  // namespace coyaml
+
+#endif // COYAML_HDR_HPP
@@ -53,6 +53,23 @@ typedef struct coyaml_parseinfo_s {
     struct coyaml_marks_s *last_mark;
     struct coyaml_marks_s *top_mark;
     // End marks
+    // Event tape
+    struct coyaml_tape_s *tape;
+    bool tape_record;
+    int tape_skipping;
+    size_t tape_count;
+    struct obstack tape_events;
+    struct obstack tape_anchors;
+    // End tape
+    // Compiled expressions
+    struct obstack exprs;
+    struct coyaml_expr_s **expr_table;
+    size_t expr_tablesize;  // power of two
+    size_t expr_count;
+    struct coyaml_symbol_s *symbols;
+    int nsymbols;
+    int symbols_size;
+    // End expressions
     struct coyaml_stack_s *root_file;
     struct coyaml_stack_s *current_file;
 } coyaml_parseinfo_t;
@@ -79,7 +96,8 @@ typedef int (*coyaml_emit_fun)(struct coyaml_printctx_s *ctx,
 typedef int (*coyaml_copy_fun)(coyaml_context_t *ctx,
     struct coyaml_placeholder_s *sprop, void *source,
     struct coyaml_placeholder_s *tprop, void *target);
-typedef void (*coyaml_defaults_fun)(void *target);
+typedef int (*coyaml_group_fun)(coyaml_parseinfo_t *info,
+    struct coyaml_group_s *def, void *target);
 
 typedef enum {
     COYAML_UNKNOWN,
@@ -95,6 +113,13 @@ typedef enum {
     COYAML_FILE,
     COYAML_DIR,
     COYAML_STRING,
+    COYAML_CHOICE,
+    COYAML_FLAGS,
+    COYAML_REGEX,
+    COYAML_ADDRESS,
+    COYAML_CIDR,
+    COYAML_STRINGSET,
+    COYAML_FORMAT,
     COYAML_TYPE_SENTINEL
 } coyaml_type_enum;
 
@@ -137,6 +162,7 @@ typedef struct coyaml_tag_s {
 typedef struct coyaml_group_s {
     COYAML_PLACEHOLDER
     coyaml_transition_t *transitions;
+    coyaml_group_fun parser;  // generated for the group, may be NULL
 } coyaml_group_t;
 extern coyaml_valuetype_t coyaml_group_type;
 
@@ -161,21 +187,25 @@ extern coyaml_valuetype_t coyaml_custom_type;
 typedef struct coyaml_int_s {
     COYAML_PLACEHOLDER
     int bitmask;
-    int min;
-    int max;
+    long min;
+    long max;
+    int width;  // in bits, zero for `long`
 } coyaml_int_t;
 extern coyaml_valuetype_t coyaml_int_type;
 
 typedef struct coyaml_uint_s {
     COYAML_PLACEHOLDER
     int bitmask;
-    unsigned int min;
-    unsigned int max;
+    unsigned long min;
+    unsigned long max;
+    int width;  // in bits, zero for `unsigned long`
 } coyaml_uint_t;
 extern coyaml_valuetype_t coyaml_uint_type;
 
 typedef struct coyaml_bool_s {
     COYAML_PLACEHOLDER
+    bool packed;  // bit `bit` of uint32_t at `baseoffset`, not a `bool`
+    int bit;
 } coyaml_bool_t;
 extern coyaml_valuetype_t coyaml_bool_type;
 
@@ -187,12 +217,37 @@ typedef struct coyaml_float_s {
 } coyaml_float_t;
 extern coyaml_valuetype_t coyaml_float_type;
 
+// Secondary index on a member of the array element
+typedef struct coyaml_arrayindex_s {
+    char *name;  // member name for error messages
+    coyaml_type_enum keytype;  // COYAML_STRING or COYAML_INT
+    size_t keyoffset;  // from the start of the element
+    bool unique;
+} coyaml_arrayindex_t;
+
+// Scalar member of the array element, copied into a separate vector
+typedef struct coyaml_column_s {
+    size_t offset;  // of the member in the element
+    size_t size;
+    size_t column;  // offset of the vector pointer in the columns structure
+} coyaml_column_t;
+
 typedef struct coyaml_array_s {
     COYAML_PLACEHOLDER
     int inheritance;
     size_t element_size;
     coyaml_placeholder_t *element_prop;
-    coyaml_defaults_fun element_defaults;
+    const void *element_default;
+    bool contiguous;  // elements are in single vector, still linked
+    size_t capacity;  // nonzero for arrays stored inline in the structure
+    coyaml_arrayindex_t *indexes;  // terminated by entry with NULL name
+    coyaml_column_t *columns;  // terminated by entry with zero size
+    int columnsoffset;
+    // of `coyaml_regexset_t *` if `combined: yes` or `coyaml_cidrset_t *`
+    // for arrays of `!CIDR`, zero if there is no set
+    int setoffset;
+    // of NULL-terminated `coyaml_index_s **`, zero if there are no indexes
+    int indexoffset;
 } coyaml_array_t;
 extern coyaml_valuetype_t coyaml_array_type;
 
@@ -202,8 +257,8 @@ typedef struct coyaml_mapping_s {
     size_t element_size;
     coyaml_placeholder_t *key_prop;
     coyaml_placeholder_t *value_prop;
-    coyaml_defaults_fun key_defaults;
-    coyaml_defaults_fun value_defaults;
+    const void *element_default;
+    int indexoffset;  // of `coyaml_index_s *`, zero if key isn't indexed
 } coyaml_mapping_t;
 extern coyaml_valuetype_t coyaml_mapping_type;
 
@@ -226,9 +281,66 @@ extern coyaml_valuetype_t coyaml_dir_type;
 
 typedef struct coyaml_string_s {
     COYAML_PLACEHOLDER
+    size_t inline_size;  // buffer after the length, zero if not inline
 } coyaml_string_t;
 extern coyaml_valuetype_t coyaml_string_type;
 
+// Names are found by perfect hash generated with the schema, slot of the
+// name is `hash ^ hash >> 32` masked, where hash is `coyaml_hash(seed, name)`
+typedef struct coyaml_choice_s {
+    COYAML_PLACEHOLDER
+    char **names;  // NULL-terminated, value of the choice is the index
+    uint64_t seed;
+    size_t mask;
+    const int *slots;  // index in `names` plus one, zero for empty slot
+} coyaml_choice_t;
+extern coyaml_valuetype_t coyaml_choice_type;
+
+// Stored as `uint32_t`, bit N is set when `names[N]` is in the list
+typedef struct coyaml_choice_s coyaml_flags_t;
+extern coyaml_valuetype_t coyaml_flags_type;
+
+// Source is stored like a string, compiled pattern is in a separate
+// member, both are set at load
+typedef struct coyaml_regex_s {
+    COYAML_PLACEHOLDER
+    int cflags;  // for regcomp()
+    size_t compiledoffset;  // of `regex_t *`
+} coyaml_regex_t;
+extern coyaml_valuetype_t coyaml_regex_type;
+
+// Stored as `coyaml_sockaddr_t`, names are not resolved
+typedef struct coyaml_address_s {
+    COYAML_PLACEHOLDER
+    int default_port;  // -1 if port is required
+} coyaml_address_t;
+extern coyaml_valuetype_t coyaml_address_type;
+
+// Stored as `coyaml_network_t`
+typedef struct coyaml_cidr_s {
+    COYAML_PLACEHOLDER
+} coyaml_cidr_t;
+extern coyaml_valuetype_t coyaml_cidr_type;
+
+// Stored as `coyaml_hashset_t`, a sequence of strings without duplicates
+typedef struct coyaml_stringset_s {
+    COYAML_PLACEHOLDER
+} coyaml_stringset_t;
+extern coyaml_valuetype_t coyaml_stringset_type;
+
+// Source is stored like a string, template is compiled at load into a
+// separate member. Placeholders are looked up like names of `!Choice`,
+// so the members up to `slots` are the same as in `coyaml_choice_t`
+typedef struct coyaml_format_s {
+    COYAML_PLACEHOLDER
+    char **names;  // NULL for strftime() formats
+    uint64_t seed;
+    size_t mask;
+    const int *slots;
+    size_t compiledoffset;  // of `coyaml_template_t`
+} coyaml_format_t;
+extern coyaml_valuetype_t coyaml_format_type;
+
 typedef struct coyaml_option_s {
     coyaml_option_fun callback;
     void *prop;
@@ -240,9 +352,32 @@ typedef struct coyaml_env_var_s {
     void *prop;
 } coyaml_env_var_t;
 
+// Value reachable from the root by member names, e.g. `Server.listen.port`.
+// Members of arrays and mappings are not there, as they aren't known
+// before parsing
+typedef struct coyaml_path_s {
+    char *path;
+    size_t path_len;
+    size_t offset;  // of the structure `prop` is in, from the root
+    coyaml_placeholder_t *prop;
+    coyaml_option_fun set;  // NULL if value can't be set from a string
+} coyaml_path_t;
+
+// Hash table generated with the schema, open addressing with linear
+// probing on `coyaml_hash()` of the path
+typedef struct coyaml_pathindex_s {
+    coyaml_path_t *paths;
+    size_t nslots;  // power of two
+    int *slots;  // index in `paths` plus one, zero for empty slot
+} coyaml_pathindex_t;
+
 int coyaml_readfile(coyaml_context_t *);
 int coyaml_print(FILE *output, coyaml_group_t *root,
     void *cfg, coyaml_print_enum mode);
+int coyaml_print_prop(FILE *output, coyaml_placeholder_t *prop,
+    void *target, coyaml_print_enum mode);
+int coyaml_profile_dump(FILE *output, coyaml_group_t *root,
+    unsigned long *counters);
 coyaml_context_t *coyaml_context_init(coyaml_context_t *ctx);
 
 void coyaml_config_free(void *ptr);
@@ -266,5 +401,71 @@ int coyaml_file_o(char *value, coyaml_file_t *prop, void *target);
 int coyaml_dir_o(char *value, coyaml_dir_t *prop, void *target);
 int coyaml_string_o(char *value, coyaml_string_t *prop, void *target);
 int coyaml_custom_o(char *value, coyaml_custom_t *prop, void *target);
+int coyaml_choice_o(char *value, coyaml_choice_t *prop, void *target);
+int coyaml_flags_o(char *value, coyaml_flags_t *prop, void *target);
+int coyaml_regex_o(char *value, coyaml_regex_t *prop, void *target);
+int coyaml_address_o(char *value, coyaml_address_t *prop, void *target);
+int coyaml_cidr_o(char *value, coyaml_cidr_t *prop, void *target);
+int coyaml_stringset_o(char *value, coyaml_stringset_t *prop, void *target);
+int coyaml_format_o(char *value, coyaml_format_t *prop, void *target);
+
+// Used by parsers generated for groups, which do the same as
+// `coyaml_group()` with keys and scalar checks compiled in
+int coyaml_event_next(coyaml_parseinfo_t *info);
+int coyaml_group_start(coyaml_parseinfo_t *info);
+int coyaml_group_key(coyaml_parseinfo_t *info, const char **key, size_t *len);
+int coyaml_group_unknown(coyaml_parseinfo_t *info, coyaml_group_t *def);
+int coyaml_scalar_int(coyaml_parseinfo_t *info, long *val);
+int coyaml_scalar_float(coyaml_parseinfo_t *info, double *val);
+int coyaml_scalar_bool(coyaml_parseinfo_t *info, int *val);
+int coyaml_value_error(coyaml_parseinfo_t *info, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+int coyaml_mark_filled(coyaml_parseinfo_t *info, int flag);
+
+int coyaml_group(coyaml_parseinfo_t *info,
+    coyaml_group_t *prop, void *target);
+int coyaml_array(coyaml_parseinfo_t *info,
+    coyaml_array_t *prop, void *target);
+int coyaml_mapping(coyaml_parseinfo_t *info,
+    coyaml_mapping_t *prop, void *target);
+int coyaml_file(coyaml_parseinfo_t *info,
+    coyaml_file_t *prop, void *target);
+int coyaml_dir(coyaml_parseinfo_t *info,
+    coyaml_dir_t *prop, void *target);
+int coyaml_string(coyaml_parseinfo_t *info,
+    coyaml_string_t *prop, void *target);
+int coyaml_custom(coyaml_parseinfo_t *info,
+    coyaml_custom_t *prop, void *target);
+int coyaml_choice(coyaml_parseinfo_t *info,
+    coyaml_choice_t *prop, void *target);
+int coyaml_flags(coyaml_parseinfo_t *info,
+    coyaml_flags_t *prop, void *target);
+int coyaml_regex(coyaml_parseinfo_t *info,
+    coyaml_regex_t *prop, void *target);
+int coyaml_address(coyaml_parseinfo_t *info,
+    coyaml_address_t *prop, void *target);
+int coyaml_cidr(coyaml_parseinfo_t *info,
+    coyaml_cidr_t *prop, void *target);
+int coyaml_stringset(coyaml_parseinfo_t *info,
+    coyaml_stringset_t *prop, void *target);
+int coyaml_format(coyaml_parseinfo_t *info,
+    coyaml_format_t *prop, void *target);
+
+void *coyaml_mapping_find_str(void *map, struct coyaml_index_s *index,
+    size_t keyoffset, const char *key, size_t keylen);
+void *coyaml_mapping_find_int(void *map, struct coyaml_index_s *index,
+    size_t keyoffset, long key);
+void *coyaml_array_find_str(void *array, struct coyaml_index_s **indexes,
+    size_t keyoffset, const char *key, size_t keylen);
+void *coyaml_array_find_int(void *array, struct coyaml_index_s **indexes,
+    size_t keyoffset, long key);
+
+coyaml_path_t *coyaml_path_find(coyaml_pathindex_t *idx,
+    const char *path, size_t len);
+void *coyaml_get(coyaml_pathindex_t *idx, void *cfg, const char *path);
+int coyaml_set(coyaml_pathindex_t *idx, void *cfg, const char *path,
+    char *value);
+int coyaml_print_path(FILE *output, coyaml_pathindex_t *idx, void *cfg,
+    const char *path, coyaml_print_enum mode);
 
 #endif //COYAML_SRC_HEADER
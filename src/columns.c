@@ -0,0 +1,44 @@
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+
+#include "columns.h"
+
+#define REF(obj, off, typ) (*(typ*)((char *)(obj) + (off)))
+
+size_t coyaml_array_length(coyaml_array_t *def, void *target) {
+    char *base = (char *)target + def->baseoffset;
+    if(def->capacity) {
+        return REF(base, def->capacity*def->element_size, size_t);
+    }
+    return REF(base, sizeof(void *), size_t);
+}
+
+// Fills columns from the elements. Must be called each time the array is
+// changed, as columns are copies
+int coyaml_array_columns(struct obstack *pieces, coyaml_array_t *def,
+    void *target) {
+    if(!def->columns) return 0;
+    char *base = (char *)target + def->baseoffset;
+    size_t len = coyaml_array_length(def, target);
+    for(coyaml_column_t *col = def->columns; col->size; ++col) {
+        char *vec = NULL;
+        if(len) {
+            vec = obstack_alloc(pieces,
+                len*col->size + COYAML_COLUMN_ALIGN - 1);
+            vec = (char *)(((uintptr_t)vec + COYAML_COLUMN_ALIGN - 1)
+                & ~(uintptr_t)(COYAML_COLUMN_ALIGN - 1));
+            char *el = def->capacity ? base : REF(base, 0, char *);
+            for(size_t i = 0; i < len; ++i) {
+                memcpy(vec + i*col->size, el + col->offset, col->size);
+                if(def->capacity) {
+                    el += def->element_size;
+                } else {
+                    el = ((coyaml_arrayel_head_t *)el)->next;
+                }
+            }
+        }
+        REF(target, def->columnsoffset + col->column, char *) = vec;
+    }
+    return 0;
+}
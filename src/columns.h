@@ -0,0 +1,11 @@
+#ifndef _H_COLUMNS
+#define _H_COLUMNS
+
+#include <obstack.h>
+#include <coyaml_src.h>
+
+size_t coyaml_array_length(coyaml_array_t *def, void *target);
+int coyaml_array_columns(struct obstack *pieces, coyaml_array_t *def,
+    void *target);
+
+#endif // _H_COLUMNS
@@ -1,9 +1,14 @@
 #include <coyaml_src.h>
 #include <errno.h>
 #include <string.h>
-#include <strings.h>
 #include <stdlib.h>
 
+#include "scalars.h"
+#include "patterns.h"
+#include "netaddr.h"
+#include "hashset.h"
+#include "convert.h"
+
 #define VALUE_ERROR(cond, message, ...) if(!(cond)) { \
     fprintf(stderr, "Error parsing option: " message "\n", ##__VA_ARGS__); \
     errno = ECOYAML_VALUE_ERROR; \
@@ -135,35 +140,35 @@ int coyaml_env_parse(coyaml_context_t *ctx) {
 }
 
 int coyaml_int_o(char *value, coyaml_int_t *def, void *target) {
-    char *end;
-    int val = strtol(value, (char **)&end, 0);
-    VALUE_ERROR(end == value + strlen(value),
+    long val;
+    const char *end = value + strlen(value);
+    VALUE_ERROR(coyaml_parse_long(value, end, &val) == end,
         "Option value ``%s'' is not integer", value);
     VALUE_ERROR(!(def->bitmask&2) || val <= def->max,
-        "Value must be less than or equal to %d", def->max);
+        "Value must be less than or equal to %ld", def->max);
     VALUE_ERROR(!(def->bitmask&1) || val >= def->min,
-        "Value must be greater than or equal to %d", def->min);
-    *(int *)(((char *)target)+def->baseoffset) = val;
+        "Value must be greater than or equal to %ld", def->min);
+    coyaml_int_set(def, target, val);
     return 0;
 }
 
 int coyaml_uint_o(char *value, coyaml_uint_t *def, void *target) {
-    char *end;
-    int val = strtol(value, (char **)&end, 0);
-    VALUE_ERROR(end == value + strlen(value),
+    unsigned long val;
+    const char *end = value + strlen(value);
+    VALUE_ERROR(coyaml_parse_ulong(value, end, &val) == end,
         "Option value ``%s'' is not integer", value);
     VALUE_ERROR(!(def->bitmask&2) || val <= def->max,
-        "Value must be less than or equal to %d", def->max);
+        "Value must be less than or equal to %lu", def->max);
     VALUE_ERROR(!(def->bitmask&1) || val >= def->min,
-        "Value must be greater than or equal to %d", def->min);
-    *(unsigned *)(((char *)target)+def->baseoffset) = val;
+        "Value must be greater than or equal to %lu", def->min);
+    coyaml_uint_set(def, target, val);
     return 0;
 }
 
 int coyaml_float_o(char *value, coyaml_float_t *def, void *target) {
-    char *end;
-    double val = strtod(value, (char **)&end);
-    VALUE_ERROR(end == value + strlen(value),
+    double val;
+    const char *end = value + strlen(value);
+    VALUE_ERROR(coyaml_parse_double(value, end, &val) == end,
         "Option value ``%s'' is not float", value);
     VALUE_ERROR(!(def->bitmask&2) || val <= def->max,
         "Value must be less than or equal to %lf", def->max);
@@ -174,48 +179,34 @@ int coyaml_float_o(char *value, coyaml_float_t *def, void *target) {
 }
 
 int coyaml_int_incr_o(char *value, coyaml_int_t *def, void *target) {
-    ++*(int *)(((char *)target)+def->baseoffset);
+    coyaml_int_set(def, target, coyaml_int_get(def, target) + 1);
     return 0;
 }
 int coyaml_int_decr_o(char *value, coyaml_int_t *def, void *target) {
-    --*(int *)(((char *)target)+def->baseoffset);
+    coyaml_int_set(def, target, coyaml_int_get(def, target) - 1);
     return 0;
 }
 int coyaml_uint_incr_o(char *value, coyaml_uint_t *def, void *target) {
-    ++*(unsigned *)(((char *)target)+def->baseoffset);
+    coyaml_uint_set(def, target, coyaml_uint_get(def, target) + 1);
     return 0;
 }
 int coyaml_uint_decr_o(char *value, coyaml_uint_t *def, void *target) {
-    --*(unsigned *)(((char *)target)+def->baseoffset);
+    coyaml_uint_set(def, target, coyaml_uint_get(def, target) - 1);
     return 0;
 }
 int coyaml_bool_o(char *value, coyaml_bool_t *def, void *target) {
-    if(
-        !strcasecmp(value, "true")
-        || !strcasecmp(value, "y")
-        || !strcasecmp(value, "yes")
-        || !strcasecmp(value, "on")
-        ) {
-        *(bool *)(((char *)target)+def->baseoffset) = TRUE;
-        return 0;
-    } else if(
-        !strcasecmp(value, "false")
-        || !strcasecmp(value, "n")
-        || !strcasecmp(value, "no")
-        || !strcasecmp(value, "off")
-        ) {
-        *(bool *)(((char *)target)+def->baseoffset) = FALSE;
-        return 0;
-    }
-    VALUE_ERROR(FALSE, "Option value ``%s'' is not boolean", value);
+    int val = coyaml_parse_bool(value, strlen(value));
+    VALUE_ERROR(val >= 0, "Option value ``%s'' is not boolean", value);
+    coyaml_bool_set(def, target, val);
+    return 0;
 }
 
 int coyaml_bool_enable_o(char *value, coyaml_bool_t *def, void *target) {
-    *(bool *)(((char *)target)+def->baseoffset) = TRUE;
+    coyaml_bool_set(def, target, TRUE);
     return 0;
 }
 int coyaml_bool_disable_o(char *value, coyaml_bool_t *def, void *target) {
-    *(bool *)(((char *)target)+def->baseoffset) = FALSE;
+    coyaml_bool_set(def, target, FALSE);
     return 0;
 }
 
@@ -231,8 +222,9 @@ int coyaml_dir_o(char *value, coyaml_dir_t *def, void *target) {
     return 0;
 }
 int coyaml_string_o(char *value, coyaml_string_t *def, void *target) {
-    *(char **)(((char *)target)+def->baseoffset) = obstack_copy0(
-        &((coyaml_head_t *)target)->pieces, value, strlen(value));
+    size_t len = strlen(value);
+    coyaml_string_set(def, target, obstack_copy0(
+        &((coyaml_head_t *)target)->pieces, value, len), len);
     //TODO: more checks
     return 0;
 }
@@ -241,3 +233,91 @@ int coyaml_custom_o(char *value, coyaml_custom_t *def, void *target) {
         (void *)(((char *)target)+def->baseoffset));
     return 0;
 }
+int coyaml_regex_o(char *value, coyaml_regex_t *def, void *target) {
+    size_t len = strlen(value);
+    *(char **)(((char *)target)+def->baseoffset) = obstack_copy0(
+        &((coyaml_head_t *)target)->pieces, value, len);
+    *(size_t *)(((char *)target)+def->baseoffset+sizeof(char*)) = len;
+    char err[256];
+    VALUE_ERROR(!coyaml_regex_compile((coyaml_head_t *)target, def, target,
+        err, sizeof(err)), "Bad regular expression ``%s'': %s", value, err);
+    return 0;
+}
+int coyaml_address_o(char *value, coyaml_address_t *def, void *target) {
+    const char *err = coyaml_sockaddr_parse(
+        (coyaml_sockaddr_t *)((char *)target + def->baseoffset),
+        value, strlen(value), def->default_port);
+    VALUE_ERROR(!err, "%s in ``%s''", err, value);
+    return 0;
+}
+int coyaml_cidr_o(char *value, coyaml_cidr_t *def, void *target) {
+    const char *err = coyaml_network_parse(
+        (coyaml_network_t *)((char *)target + def->baseoffset),
+        value, strlen(value));
+    VALUE_ERROR(!err, "%s in ``%s''", err, value);
+    return 0;
+}
+int coyaml_format_o(char *value, coyaml_format_t *def, void *target) {
+    size_t len = strlen(value);
+    *(char **)(((char *)target)+def->baseoffset) = obstack_copy0(
+        &((coyaml_head_t *)target)->pieces, value, len);
+    *(size_t *)(((char *)target)+def->baseoffset+sizeof(char*)) = len;
+    char err[256];
+    VALUE_ERROR(!coyaml_format_compile((coyaml_head_t *)target, def, target,
+        err, sizeof(err)), "%s in format ``%s''", err, value);
+    return 0;
+}
+// Strings are separated by comma, empty string makes an empty set
+int coyaml_stringset_o(char *value, coyaml_stringset_t *def, void *target) {
+    coyaml_head_t *head = (coyaml_head_t *)target;
+    struct obstack tmp;
+    coyaml_hashbuild_t build;
+    obstack_init(&tmp);
+    coyaml_hashbuild_init(&build, &tmp);
+    int rc = 0;
+    while(*value && !rc) {
+        char *end = strchr(value, ',');
+        size_t len = end ? (size_t)(end - value) : strlen(value);
+        if(coyaml_hashbuild_add(&build,
+            obstack_copy0(&head->pieces, value, len), len)) {
+            fprintf(stderr, "Error parsing option: "
+                "Duplicate ``%.*s'' in the set\n", (int)len, value);
+            rc = -1;
+        }
+        value += end ? len + 1 : len;
+    }
+    if(!rc) {
+        rc = coyaml_hashset_build(head, &build,
+            (coyaml_hashset_t *)((char *)target + def->baseoffset));
+        if(rc < 0) {
+            fprintf(stderr, "Error parsing option: "
+                "Can't build hash of the set\n");
+        }
+    }
+    obstack_free(&tmp, NULL);
+    if(rc < 0) {
+        errno = ECOYAML_VALUE_ERROR;
+        return -1;
+    }
+    return 0;
+}
+int coyaml_choice_o(char *value, coyaml_choice_t *def, void *target) {
+    int val = coyaml_choice_find(def, value, strlen(value));
+    VALUE_ERROR(val >= 0, "Unknown choice ``%s''", value);
+    *(int *)(((char *)target)+def->baseoffset) = val;
+    return 0;
+}
+// Names are separated by comma, empty string clears all flags
+int coyaml_flags_o(char *value, coyaml_flags_t *def, void *target) {
+    uint32_t mask = 0;
+    while(*value) {
+        char *end = strchr(value, ',');
+        size_t len = end ? (size_t)(end - value) : strlen(value);
+        int val = coyaml_choice_find(def, value, len);
+        VALUE_ERROR(val >= 0, "Unknown flag ``%.*s''", (int)len, value);
+        mask |= 1u << val;
+        value += end ? len + 1 : len;
+    }
+    *(uint32_t *)(((char *)target)+def->baseoffset) = mask;
+    return 0;
+}
@@ -0,0 +1,310 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <limits.h>
+#include <float.h>
+#include <ctype.h>
+#include <locale.h>
+
+#include "convert.h"
+
+// Both suffix tables are indexed by a multiplicative hash of the packed
+// word, constants are picked so that every word has a slot of its own
+
+#define UNIT_MAGIC 0xcb96b350121920b7ULL
+#define UNIT_KEY(a, b, len) ((uint32_t)(a) | (uint32_t)(b) << 8 | (len) << 16)
+#define BOOL_MAGIC 0xf6459819e749e3b7ULL
+#define BOOL_WORD(a, b, c, d, e) ((uint64_t)(a) | (uint64_t)(b) << 8 \
+    | (uint64_t)(c) << 16 | (uint64_t)(d) << 24 | (uint64_t)(e) << 32)
+
+static struct unit_s {
+    uint32_t key;
+    uint64_t value;
+} units[16] = {
+    {UNIT_KEY('T', 'i', 2), 1ULL << 40},
+    {UNIT_KEY('E', 'i', 2), 1ULL << 60},
+    {UNIT_KEY('G', 0, 1), 1000000000ULL},
+    {0, 0},
+    {UNIT_KEY('k', 'i', 2), 1ULL << 10},
+    {UNIT_KEY('P', 0, 1), 1000000000000000ULL},
+    {0, 0},
+    {UNIT_KEY('M', 'i', 2), 1ULL << 20},
+    {UNIT_KEY('T', 0, 1), 1000000000000ULL},
+    {UNIT_KEY('E', 0, 1), 1000000000000000000ULL},
+    {UNIT_KEY('G', 'i', 2), 1ULL << 30},
+    {0, 0},
+    {UNIT_KEY('k', 0, 1), 1000ULL},
+    {UNIT_KEY('P', 'i', 2), 1ULL << 50},
+    {UNIT_KEY('M', 0, 1), 1000000ULL},
+    {0, 0},
+    };
+
+// Words are lowercased by setting 0x20 bit in every byte, it can only turn
+// a byte into a lowercase letter if it was the same letter in any case
+static struct bool_s {
+    uint64_t word;
+    int value;
+} bools[8] = {
+    {BOOL_WORD('o', 'f', 'f', 0, 0), FALSE},
+    {BOOL_WORD('y', 'e', 's', 0, 0), TRUE},
+    {BOOL_WORD('t', 'r', 'u', 'e', 0), TRUE},
+    {BOOL_WORD('y', 0, 0, 0, 0), TRUE},
+    {BOOL_WORD('f', 'a', 'l', 's', 'e'), FALSE},
+    {BOOL_WORD('o', 'n', 0, 0, 0), TRUE},
+    {BOOL_WORD('n', 0, 0, 0, 0), FALSE},
+    {BOOL_WORD('n', 'o', 0, 0, 0), FALSE},
+    };
+
+// Exactly representable in double, so a product or a quotient of them and
+// an integer below 2^53 is correctly rounded
+static const double powers[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+    };
+
+// Returns multiplier of the unit spanning whole [p, end), 0 if it's not one
+static uint64_t unit_of(const char *p, const char *end) {
+    size_t len = end - p;
+    if(len - 1 > 1) return 0;
+    uint32_t key = UNIT_KEY((unsigned char)p[0],
+        len > 1 ? (unsigned char)p[1] : 0, (uint32_t)len);
+    struct unit_s *unit = &units[((uint64_t)key * UNIT_MAGIC) >> 60];
+    return unit->key == key ? unit->value : 0;
+}
+
+static uint64_t load8(const char *p) {
+    uint64_t val;
+    memcpy(&val, p, 8);
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    val = __builtin_bswap64(val);
+#endif
+    return val;
+}
+
+static int eight_digits(uint64_t val) {
+    return !(((val & 0xF0F0F0F0F0F0F0F0ULL)
+        | (((val + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))
+        ^ 0x3333333333333333ULL);
+}
+
+// Converts eight ASCII digits at once: pairs, then quads, then the whole
+static uint32_t parse8(uint64_t val) {
+    val -= 0x3030303030303030ULL;
+    val = val * 10 + (val >> 8);
+    val = ((val & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32))
+        + ((val >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))
+        >> 32;
+    return (uint32_t)val;
+}
+
+static unsigned digit_value(char c) {
+    unsigned d = (unsigned char)c - '0';
+    if(d < 10) return d;
+    d = ((unsigned char)c | 0x20) - 'a';
+    return d < 26 ? d + 10 : 99;
+}
+
+// Returns the pointer past the digits, NULL on overflow
+static const char *digits(const char *p, const char *end, unsigned base,
+    uint64_t *result)
+{
+    uint64_t val = 0;
+    if(base == 10) {
+        for(; end - p >= 8 && eight_digits(load8(p)); p += 8) {
+            if(__builtin_mul_overflow(val, 100000000ULL, &val)
+                || __builtin_add_overflow(val, parse8(load8(p)), &val))
+                return NULL;
+        }
+    }
+    for(; p < end; ++p) {
+        unsigned d = digit_value(*p);
+        if(d >= base) break;
+        if(__builtin_mul_overflow(val, base, &val)
+            || __builtin_add_overflow(val, d, &val))
+            return NULL;
+    }
+    *result = val;
+    return p;
+}
+
+// Magnitude and sign with the strtol's base 0 rules and a unit suffix
+static const char *integer(const char *str, const char *end,
+    int *negative, uint64_t *result)
+{
+    const char *p = str;
+    while(p < end && isspace((unsigned char)*p)) ++p;
+    *negative = 0;
+    if(p < end && (*p == '-' || *p == '+')) {
+        *negative = *p == '-';
+        ++p;
+    }
+    unsigned base = 10;
+    if(p < end && *p == '0') {
+        if(end - p > 2 && (p[1] | 0x20) == 'x' && digit_value(p[2]) < 16) {
+            base = 16;
+            p += 2;
+        } else {
+            base = 8;
+        }
+    }
+    const char *next = digits(p, end, base, result);
+    if(!next || next == p) return str;
+    if(next < end) {
+        uint64_t unit = unit_of(next, end);
+        if(unit) {
+            if(__builtin_mul_overflow(*result, unit, result)) return str;
+            next = end;
+        }
+    }
+    return next;
+}
+
+const char *coyaml_parse_long(const char *str, const char *end, long *result)
+{
+    int negative;
+    uint64_t val;
+    const char *next = integer(str, end, &negative, &val);
+    if(next == str) {
+        // Like strtol, so an empty string is zero, not an unset value
+        *result = 0;
+        return str;
+    }
+    if(negative) {
+        if(!val) {
+            *result = 0;
+        } else if(val - 1 <= (uint64_t)LONG_MAX) {
+            *result = -(long)(val - 1) - 1;
+        } else {
+            return str;
+        }
+    } else {
+        if(val > (uint64_t)LONG_MAX) return str;
+        *result = (long)val;
+    }
+    return next;
+}
+
+// Unlike strtoul, negative values are not wrapped around
+const char *coyaml_parse_ulong(const char *str, const char *end,
+    unsigned long *result)
+{
+    int negative;
+    uint64_t val;
+    const char *next = integer(str, end, &negative, &val);
+    if(next == str) {
+        *result = 0;
+        return str;
+    }
+    if((negative && val) || val > ULONG_MAX) return str;
+    *result = (unsigned long)val;
+    return next;
+}
+
+// Handles everything the fast path doesn't: long mantissas, big exponents,
+// hexadecimal, infinities and NaNs. The "C" locale makes decimal point the
+// same regardless of the application's locale
+static const char *slow_double(const char *str, const char *end,
+    double *result)
+{
+    static locale_t c_locale;
+    if(!c_locale) {
+        c_locale = newlocale(LC_ALL_MASK, "C", (locale_t)0);
+    }
+    size_t len = end - str;
+    char local[128];
+    char *buf = len < sizeof(local) ? local : malloc(len+1);
+    if(!buf) return str;
+    memcpy(buf, str, len);
+    buf[len] = 0;
+    char *stop;
+    double val = c_locale ? strtod_l(buf, &stop, c_locale)
+                          : strtod(buf, &stop);
+    const char *next = str + (stop - buf);
+    if(buf != local) free(buf);
+    *result = val;
+    return next;
+}
+
+const char *coyaml_parse_double(const char *str, const char *end,
+    double *result)
+{
+    const char *p = str;
+    while(p < end && isspace((unsigned char)*p)) ++p;
+    int negative = 0;
+    if(p < end && (*p == '-' || *p == '+')) {
+        negative = *p == '-';
+        ++p;
+    }
+    uint64_t mant = 0;
+    int count = 0;
+    int exp10 = 0;
+    const char *start = p;
+    for(; end - p >= 8 && eight_digits(load8(p)); p += 8, count += 8) {
+        mant = mant * 100000000ULL + parse8(load8(p));
+    }
+    for(; p < end && (unsigned char)(*p - '0') < 10; ++p, ++count) {
+        mant = mant * 10 + (*p - '0');
+    }
+    if(p < end && (*p | 0x20) == 'x' && p - start == 1 && *start == '0') {
+        p = slow_double(str, end, result);
+        goto unit;
+    }
+    if(p < end && *p == '.') {
+        const char *frac = ++p;
+        for(; p < end && (unsigned char)(*p - '0') < 10; ++p) {
+            mant = mant * 10 + (*p - '0');
+        }
+        count += p - frac;
+        exp10 = -(int)(p - frac);
+    }
+    if(!count) {
+        p = slow_double(str, end, result);
+        goto unit;
+    }
+    if(p < end && (*p | 0x20) == 'e') {
+        const char *q = p + 1;
+        int eneg = 0;
+        if(q < end && (*q == '-' || *q == '+')) {
+            eneg = *q == '-';
+            ++q;
+        }
+        if(q < end && (unsigned char)(*q - '0') < 10) {
+            int e = 0;
+            for(; q < end && (unsigned char)(*q - '0') < 10; ++q) {
+                if(e < 100000) e = e * 10 + (*q - '0');
+            }
+            exp10 += eneg ? -e : e;
+            p = q;
+        }
+    }
+#if FLT_EVAL_METHOD == 0
+    if(count <= 19 && mant <= (1ULL << 53) && exp10 >= -22 && exp10 <= 22) {
+        double val = (double)mant;
+        val = exp10 < 0 ? val / powers[-exp10] : val * powers[exp10];
+        *result = negative ? -val : val;
+    } else
+#endif
+    {
+        p = slow_double(str, end, result);
+    }
+unit:
+    if(p != str && p < end) {
+        uint64_t unit = unit_of(p, end);
+        if(unit) {
+            *result *= unit;
+            p = end;
+        }
+    }
+    return p;
+}
+
+int coyaml_parse_bool(const char *str, size_t len) {
+    if(len - 1 >= 5) return -1;
+    uint64_t word = 0;
+    for(size_t i = 0; i < len; ++i) {
+        word |= (uint64_t)((unsigned char)str[i] | 0x20) << 8*i;
+    }
+    struct bool_s *b = &bools[(word * BOOL_MAGIC) >> 61];
+    return b->word == word ? b->value : -1;
+}
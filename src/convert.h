@@ -0,0 +1,22 @@
+#ifndef _H_CONVERT
+#define _H_CONVERT
+
+#include <coyaml_src.h>
+
+// Number parsers accept the syntax of strtol(base 0)/strtod followed by an
+// optional unit suffix (k, ki, M, Mi ... E, Ei). They parse the longest
+// number at the start of [str, end) and return the pointer past it, or
+// `str` if there is no number or it doesn't fit the type. So callers check
+// that the whole value is consumed and get an error on overflow instead of
+// a saturated value. Like with strtol, result is zero if there is no number,
+// so an empty string is parsed as zero
+
+const char *coyaml_parse_long(const char *str, const char *end, long *result);
+const char *coyaml_parse_ulong(const char *str, const char *end,
+    unsigned long *result);
+const char *coyaml_parse_double(const char *str, const char *end,
+    double *result);
+// Returns TRUE or FALSE, -1 if the value is not a boolean
+int coyaml_parse_bool(const char *str, size_t len);
+
+#endif // _H_CONVERT
@@ -2,11 +2,17 @@
 #include <errno.h>
 
 #include "copy.h"
+#include "mapindex.h"
+#include "columns.h"
+#include "scalars.h"
+#include "patterns.h"
+#include "netaddr.h"
 #include "util.h"
 
 #define REF(obj, prop, typ) *(typ*)((char *)(obj) + (prop)->baseoffset)
 #define LEN(obj, prop, typ) *(int*)((char *)(obj) \
     + (prop)->baseoffset + sizeof(typ))
+#define INDEX(obj, prop) *(void **)((char *)(obj) + (prop)->indexoffset)
 
 static int copy_group(coyaml_context_t *ctx, coyaml_group_t *group,
     coyaml_marks_t *source, coyaml_marks_t *target)
@@ -48,10 +54,48 @@ int coyaml_custom_copy(coyaml_context_t *ctx,
     return 0;
 }
 
-int coyaml_array_copy(coyaml_context_t *ctx,
+static int array_append(coyaml_context_t *ctx,
     struct coyaml_array_s *sprop, void *source,
     struct coyaml_array_s *tprop, void *target)
 {
+    if(tprop->capacity) {
+        char *svec = (char *)source + sprop->baseoffset;
+        char *tvec = (char *)target + tprop->baseoffset;
+        size_t *slen = (size_t *)(svec + sprop->capacity*sprop->element_size);
+        size_t *tlen = (size_t *)(tvec + tprop->capacity*tprop->element_size);
+        if(*tlen + *slen > tprop->capacity) {
+            fprintf(stderr, "COYAML: Array can't contain more than %lu "
+                "elements\n", (unsigned long)tprop->capacity);
+            errno = ECOYAML_VALUE_ERROR;
+            return -1;
+        }
+        memcpy(tvec + *tlen*tprop->element_size, svec,
+            *slen*sprop->element_size);
+        *tlen += *slen;
+        return 0;
+    }
+    if(tprop->contiguous) {
+        // Elements are copied to keep vector contiguous
+        size_t tlen = *(size_t *)((char *)target
+            + tprop->baseoffset + sizeof(void *));
+        size_t slen = *(size_t *)((char *)source
+            + sprop->baseoffset + sizeof(void *));
+        if(!slen) return 0;
+        size_t size = tprop->element_size;
+        char *vec = obstack_alloc(&ctx->target->pieces, (tlen+slen)*size);
+        if(tlen) {
+            memcpy(vec, REF(target, tprop, char *), tlen*size);
+        }
+        memcpy(vec + tlen*size, REF(source, sprop, char *), slen*size);
+        for(size_t i = 0; i < tlen+slen; ++i) {
+            ((coyaml_arrayel_head_t *)(vec + i*size))->next =
+                i+1 < tlen+slen ? vec + (i+1)*size : NULL;
+        }
+        REF(target, tprop, char *) = vec;
+        *(size_t *)((char *)target + tprop->baseoffset + sizeof(void *))
+            = tlen + slen;
+        return coyaml_array_index(&ctx->target->pieces, tprop, target, NULL);
+    }
     coyaml_arrayel_head_t *m = REF(target, tprop, coyaml_arrayel_head_t *);
     for(;m && m->next; m = m->next);
     if(m) {
@@ -62,10 +106,32 @@ int coyaml_array_copy(coyaml_context_t *ctx,
     }
     LEN(target, tprop, coyaml_arrayel_head_t *) \
         += LEN(source, sprop, coyaml_arrayel_head_t *);
-    
+    if(m) {
+        return coyaml_array_index(&ctx->target->pieces, tprop, target, NULL);
+    }
+    // When the list is taken as is, indexes of the source still fit
+    if(tprop->indexoffset) {
+        INDEX(target, tprop) = INDEX(source, sprop);
+    }
     return 0;
 }
 
+int coyaml_array_copy(coyaml_context_t *ctx,
+    struct coyaml_array_s *sprop, void *source,
+    struct coyaml_array_s *tprop, void *target)
+{
+    CHECK(array_append(ctx, sprop, source, tprop, target));
+    CHECK(coyaml_array_columns(&ctx->target->pieces, tprop, target));
+    char err[256];
+    if(coyaml_regexset_build(ctx->target, tprop, target, err, sizeof(err))) {
+        fprintf(stderr, "COYAML: Can't combine regular expressions: %s\n",
+            err);
+        errno = ECOYAML_VALUE_ERROR;
+        return -1;
+    }
+    return coyaml_cidrset_build(ctx->target, tprop, target);
+}
+
 int coyaml_mapping_copy(coyaml_context_t *ctx,
     struct coyaml_mapping_s *sprop, void *source,
     struct coyaml_mapping_s *tprop, void *target)
@@ -80,6 +146,13 @@ int coyaml_mapping_copy(coyaml_context_t *ctx,
     }
     LEN(target, tprop, coyaml_mappingel_head_t *) \
         += LEN(source, sprop, coyaml_mappingel_head_t *);
+    if(m) {
+        return coyaml_mapping_index(&ctx->target->pieces, tprop, target);
+    }
+    // When the list is taken as is, index of the source still fits
+    if(tprop->indexoffset) {
+        INDEX(target, tprop) = INDEX(source, sprop);
+    }
     return 0;
 }
 
@@ -87,7 +160,7 @@ int coyaml_int_copy(coyaml_context_t *ctx,
     struct coyaml_int_s *sprop, void *source,
     struct coyaml_int_s *tprop, void *target)
 {
-    REF(target, tprop, long) = REF(source, sprop, long);
+    coyaml_int_set(tprop, target, coyaml_int_get(sprop, source));
     return 0;
 }
 
@@ -95,7 +168,7 @@ int coyaml_uint_copy(coyaml_context_t *ctx,
     struct coyaml_uint_s *sprop, void *source,
     struct coyaml_uint_s *tprop, void *target)
 {
-    REF(target, tprop, unsigned long) = REF(source, sprop, unsigned long);
+    coyaml_uint_set(tprop, target, coyaml_uint_get(sprop, source));
     return 0;
 }
 
@@ -103,7 +176,7 @@ int coyaml_bool_copy(coyaml_context_t *ctx,
     struct coyaml_bool_s *sprop, void *source,
     struct coyaml_bool_s *tprop, void *target)
 {
-    REF(target, tprop, bool) = REF(source, sprop, bool);
+    coyaml_bool_set(tprop, target, coyaml_bool_get(sprop, source));
     return 0;
 }
 
@@ -137,7 +210,79 @@ int coyaml_string_copy(coyaml_context_t *ctx,
     struct coyaml_string_s *sprop, void *source,
     struct coyaml_string_s *tprop, void *target)
 {
+    size_t len;
+    // Both have the same layout, so inline value is copied inline
+    char *data = coyaml_string_get(sprop, source, &len);
+    coyaml_string_set(tprop, target, data, len);
+    return 0;
+}
+
+int coyaml_choice_copy(coyaml_context_t *ctx,
+    struct coyaml_choice_s *sprop, void *source,
+    struct coyaml_choice_s *tprop, void *target)
+{
+    REF(target, tprop, int) = REF(source, sprop, int);
+    return 0;
+}
+
+int coyaml_flags_copy(coyaml_context_t *ctx,
+    struct coyaml_choice_s *sprop, void *source,
+    struct coyaml_choice_s *tprop, void *target)
+{
+    REF(target, tprop, uint32_t) = REF(source, sprop, uint32_t);
+    return 0;
+}
+
+int coyaml_regex_copy(coyaml_context_t *ctx,
+    struct coyaml_regex_s *sprop, void *source,
+    struct coyaml_regex_s *tprop, void *target)
+{
+    // Compiled pattern is owned by the config, so is shared by the copies
     REF(target, tprop, char *) = REF(source, sprop, char *);
-    LEN(target, tprop, char *) = LEN(source, sprop, char *);
+    *(size_t *)((char *)target + tprop->baseoffset + sizeof(char *)) =
+        *(size_t *)((char *)source + sprop->baseoffset + sizeof(char *));
+    *(regex_t **)((char *)target + tprop->compiledoffset) =
+        *(regex_t **)((char *)source + sprop->compiledoffset);
+    return 0;
+}
+
+int coyaml_address_copy(coyaml_context_t *ctx,
+    struct coyaml_address_s *sprop, void *source,
+    struct coyaml_address_s *tprop, void *target)
+{
+    REF(target, tprop, coyaml_sockaddr_t) = REF(source, sprop,
+        coyaml_sockaddr_t);
+    return 0;
+}
+
+int coyaml_format_copy(coyaml_context_t *ctx,
+    struct coyaml_format_s *sprop, void *source,
+    struct coyaml_format_s *tprop, void *target)
+{
+    // Source and segments are never changed, so they are shared
+    REF(target, tprop, char *) = REF(source, sprop, char *);
+    *(size_t *)((char *)target + tprop->baseoffset + sizeof(char *)) =
+        *(size_t *)((char *)source + sprop->baseoffset + sizeof(char *));
+    *(coyaml_template_t *)((char *)target + tprop->compiledoffset) =
+        *(coyaml_template_t *)((char *)source + sprop->compiledoffset);
+    return 0;
+}
+
+int coyaml_stringset_copy(coyaml_context_t *ctx,
+    struct coyaml_stringset_s *sprop, void *source,
+    struct coyaml_stringset_s *tprop, void *target)
+{
+    // Tables are never changed after build, so they are shared
+    REF(target, tprop, coyaml_hashset_t) = REF(source, sprop,
+        coyaml_hashset_t);
+    return 0;
+}
+
+int coyaml_cidr_copy(coyaml_context_t *ctx,
+    struct coyaml_cidr_s *sprop, void *source,
+    struct coyaml_cidr_s *tprop, void *target)
+{
+    REF(target, tprop, coyaml_network_t) = REF(source, sprop,
+        coyaml_network_t);
     return 0;
 }
@@ -37,5 +37,26 @@ int coyaml_file_copy(coyaml_context_t *ctx,
 int coyaml_string_copy(coyaml_context_t *ctx,
     struct coyaml_string_s *sprop, void *source,
     struct coyaml_string_s *tprop, void *target);
+int coyaml_choice_copy(coyaml_context_t *ctx,
+    struct coyaml_choice_s *sprop, void *source,
+    struct coyaml_choice_s *tprop, void *target);
+int coyaml_flags_copy(coyaml_context_t *ctx,
+    struct coyaml_choice_s *sprop, void *source,
+    struct coyaml_choice_s *tprop, void *target);
+int coyaml_regex_copy(coyaml_context_t *ctx,
+    struct coyaml_regex_s *sprop, void *source,
+    struct coyaml_regex_s *tprop, void *target);
+int coyaml_address_copy(coyaml_context_t *ctx,
+    struct coyaml_address_s *sprop, void *source,
+    struct coyaml_address_s *tprop, void *target);
+int coyaml_cidr_copy(coyaml_context_t *ctx,
+    struct coyaml_cidr_s *sprop, void *source,
+    struct coyaml_cidr_s *tprop, void *target);
+int coyaml_format_copy(coyaml_context_t *ctx,
+    struct coyaml_format_s *sprop, void *source,
+    struct coyaml_format_s *tprop, void *target);
+int coyaml_stringset_copy(coyaml_context_t *ctx,
+    struct coyaml_stringset_s *sprop, void *source,
+    struct coyaml_stringset_s *tprop, void *target);
 
 #endif //_H_COPY
@@ -2,6 +2,8 @@
 
 #include "emitter.h"
 #include "util.h"
+#include "scalars.h"
+#include "netaddr.h"
 
 #define EMIT_STRING(value) CHECK(yaml_scalar_event_initialize(&event, \
             NULL, (unsigned char *)"tag:yaml.org,2002:str", \
@@ -24,7 +26,7 @@ int coyaml_print_root(coyaml_printctx_t *ctx) {
     CHECK(yaml_document_start_event_initialize(&event, NULL, NULL, NULL, 1));
     CHECK(yaml_emitter_emit(&ctx->emitter, &event));
 
-    CHECK(coyaml_group_emit(ctx, (coyaml_group_t *)ctx->root, ctx->config));
+    VISIT(ctx->root, ctx->config);
 
     CHECK(yaml_document_end_event_initialize(&event, 1));
     CHECK(yaml_emitter_emit(&ctx->emitter, &event));
@@ -35,6 +37,13 @@ int coyaml_print_root(coyaml_printctx_t *ctx) {
 
 int coyaml_print(FILE *file, coyaml_group_t *root,
     void *cfg, coyaml_print_enum mode)
+{
+    return coyaml_print_prop(file, (coyaml_placeholder_t *)root, cfg, mode);
+}
+
+// Prints a single value, `target` is the structure `prop` is in
+int coyaml_print_prop(FILE *file, coyaml_placeholder_t *prop,
+    void *target, coyaml_print_enum mode)
 {
     coyaml_printctx_t ctx;
     CHECK(yaml_emitter_initialize(&ctx.emitter));
@@ -42,8 +51,8 @@ int coyaml_print(FILE *file, coyaml_group_t *root,
     ctx.file = file;
     ctx.comments = mode & COYAML_PRINT_COMMENTS;
     ctx.defaults = (mode & 0xf) == COYAML_PRINT_SHORT;
-    ctx.config = cfg;
-    ctx.root = root;
+    ctx.config = target;
+    ctx.root = prop;
     int res = coyaml_print_root(&ctx);
     if(res < 0) {
         switch (ctx.emitter.error)
@@ -139,10 +148,18 @@ int coyaml_array_emit(coyaml_printctx_t *ctx,
         YAML_BLOCK_SEQUENCE_STYLE));
     CHECK(yaml_emitter_emit(&ctx->emitter, &event));
 
-    for(coyaml_arrayel_head_t *el
-        = *(coyaml_arrayel_head_t **)((char *)target+prop->baseoffset);
-        el; el = el->next) {
-        VISIT(prop->element_prop, el);
+    if(prop->capacity) {
+        char *vec = (char *)target+prop->baseoffset;
+        size_t len = *(size_t *)(vec + prop->capacity*prop->element_size);
+        for(size_t i = 0; i < len; ++i) {
+            VISIT(prop->element_prop, vec + i*prop->element_size);
+        }
+    } else {
+        for(coyaml_arrayel_head_t *el
+            = *(coyaml_arrayel_head_t **)((char *)target+prop->baseoffset);
+            el; el = el->next) {
+            VISIT(prop->element_prop, el);
+        }
     }
 
     CHECK(yaml_sequence_end_event_initialize(&event));
@@ -175,8 +192,8 @@ int coyaml_int_emit(coyaml_printctx_t *ctx,
     coyaml_placeholder_t *prop, void *target)
 {
     char buf[24];
-    int len = snprintf(buf, 24, "%ld", *(long *)((char *)target
-            + prop->baseoffset));
+    int len = snprintf(buf, 24, "%ld",
+        coyaml_int_get((coyaml_int_t *)prop, target));
     yaml_event_t event;
     EMIT_STRING_LEN(buf, len);
     return 0;
@@ -186,8 +203,8 @@ int coyaml_uint_emit(coyaml_printctx_t *ctx,
     coyaml_placeholder_t *prop, void *target)
 {
     char buf[24];
-    int len = snprintf(buf, 24, "%lu", *(long *)((char *)target
-            + prop->baseoffset));
+    int len = snprintf(buf, 24, "%lu",
+        coyaml_uint_get((coyaml_uint_t *)prop, target));
     yaml_event_t event;
     EMIT_STRING_LEN(buf, len);
     return 0;
@@ -196,7 +213,7 @@ int coyaml_uint_emit(coyaml_printctx_t *ctx,
 int coyaml_bool_emit(coyaml_printctx_t *ctx,
     coyaml_placeholder_t *prop, void *target)
 {
-    bool value = *(bool *)((char *)target + prop->baseoffset);
+    bool value = coyaml_bool_get((coyaml_bool_t *)prop, target);
     yaml_event_t event;
     if(value) {
         EMIT_STRING("yes");
@@ -249,13 +266,103 @@ int coyaml_string_emit(coyaml_printctx_t *ctx,
     coyaml_string_t *prop, void *target)
 {
     yaml_event_t event;
-    char *str = *(char **)((char *)target + prop->baseoffset);
+    size_t len;
+    char *str = coyaml_string_get(prop, target, &len);
     if(str) {
-        EMIT_STRING_LEN(str, *(int *)((char *)target
-            + prop->baseoffset + sizeof(char *)));
+        EMIT_STRING_LEN(str, len);
     } else {
         EMIT_STRING("");
     }
     return 0;
 }
 
+
+int coyaml_choice_emit(coyaml_printctx_t *ctx,
+    coyaml_choice_t *prop, void *target)
+{
+    yaml_event_t event;
+    EMIT_STRING(prop->names[*(int *)((char *)target + prop->baseoffset)]);
+    return 0;
+}
+
+int coyaml_flags_emit(coyaml_printctx_t *ctx,
+    coyaml_flags_t *prop, void *target)
+{
+    yaml_event_t event;
+    uint32_t mask = *(uint32_t *)((char *)target + prop->baseoffset);
+    CHECK(yaml_sequence_start_event_initialize(&event,
+        NULL, (unsigned char *)"tag:yaml.org,2002:seq", 1,
+        YAML_FLOW_SEQUENCE_STYLE));
+    CHECK(yaml_emitter_emit(&ctx->emitter, &event));
+    for(int i = 0; prop->names[i]; ++i) {
+        if(mask & (1u << i)) {
+            EMIT_STRING(prop->names[i]);
+        }
+    }
+    CHECK(yaml_sequence_end_event_initialize(&event));
+    CHECK(yaml_emitter_emit(&ctx->emitter, &event));
+    return 0;
+}
+
+int coyaml_regex_emit(coyaml_printctx_t *ctx,
+    coyaml_regex_t *prop, void *target)
+{
+    yaml_event_t event;
+    char *src = *(char **)((char *)target + prop->baseoffset);
+    EMIT_STRING_LEN(src ? src : "",
+        *(size_t *)((char *)target + prop->baseoffset + sizeof(char *)));
+    return 0;
+}
+
+int coyaml_address_emit(coyaml_printctx_t *ctx,
+    coyaml_address_t *prop, void *target)
+{
+    yaml_event_t event;
+    char buf[128];
+    int len = coyaml_sockaddr_format(
+        (coyaml_sockaddr_t *)((char *)target + prop->baseoffset),
+        buf, sizeof(buf));
+    EMIT_STRING_LEN(buf, len);
+    return 0;
+}
+
+int coyaml_cidr_emit(coyaml_printctx_t *ctx,
+    coyaml_cidr_t *prop, void *target)
+{
+    yaml_event_t event;
+    char buf[64];
+    int len = coyaml_network_format(
+        (coyaml_network_t *)((char *)target + prop->baseoffset),
+        buf, sizeof(buf));
+    EMIT_STRING_LEN(buf, len);
+    return 0;
+}
+
+int coyaml_stringset_emit(coyaml_printctx_t *ctx,
+    coyaml_stringset_t *prop, void *target)
+{
+    yaml_event_t event;
+    coyaml_hashset_t *set = (coyaml_hashset_t *)((char *)target
+        + prop->baseoffset);
+    CHECK(yaml_sequence_start_event_initialize(&event,
+        NULL, (unsigned char *)"tag:yaml.org,2002:seq", 1,
+        YAML_FLOW_SEQUENCE_STYLE));
+    CHECK(yaml_emitter_emit(&ctx->emitter, &event));
+    for(size_t i = 0; i < set->count; ++i) {
+        const coyaml_hashitem_t *item = &set->items[set->order[i]];
+        EMIT_STRING_LEN(item->value, item->len);
+    }
+    CHECK(yaml_sequence_end_event_initialize(&event));
+    CHECK(yaml_emitter_emit(&ctx->emitter, &event));
+    return 0;
+}
+
+int coyaml_format_emit(coyaml_printctx_t *ctx,
+    coyaml_format_t *prop, void *target)
+{
+    yaml_event_t event;
+    char *src = *(char **)((char *)target + prop->baseoffset);
+    EMIT_STRING_LEN(src ? src : "",
+        *(size_t *)((char *)target + prop->baseoffset + sizeof(char *)));
+    return 0;
+}
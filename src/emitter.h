@@ -7,7 +7,7 @@ typedef struct coyaml_printctx_s {
     FILE *file;
     yaml_emitter_t emitter;
     void *config;
-    coyaml_group_t *root;
+    coyaml_placeholder_t *root;
     bool comments;
     bool defaults;
 } coyaml_printctx_t;
@@ -36,5 +36,19 @@ int coyaml_file_emit(coyaml_printctx_t *emitter,
     struct coyaml_file_s *prop, void *target);
 int coyaml_string_emit(coyaml_printctx_t *emitter,
     struct coyaml_string_s *prop, void *target);
+int coyaml_choice_emit(coyaml_printctx_t *emitter,
+    struct coyaml_choice_s *prop, void *target);
+int coyaml_flags_emit(coyaml_printctx_t *emitter,
+    struct coyaml_choice_s *prop, void *target);
+int coyaml_regex_emit(coyaml_printctx_t *emitter,
+    struct coyaml_regex_s *prop, void *target);
+int coyaml_address_emit(coyaml_printctx_t *emitter,
+    struct coyaml_address_s *prop, void *target);
+int coyaml_cidr_emit(coyaml_printctx_t *emitter,
+    struct coyaml_cidr_s *prop, void *target);
+int coyaml_format_emit(coyaml_printctx_t *emitter,
+    struct coyaml_format_s *prop, void *target);
+int coyaml_stringset_emit(coyaml_printctx_t *emitter,
+    struct coyaml_stringset_s *prop, void *target);
 
 #endif //_H_EMITTER
@@ -3,9 +3,17 @@
 #include <string.h>
 #include <errno.h>
 #include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include "parser.h"
+#include "convert.h"
 #include "vars.h"
+#include "util.h"
+#include "fingerprint.h"
 
 #define SYNTAX_ERROR(cond) if(!(cond)) { \
     fprintf(stderr, "COYAML: Syntax error in config file ``%s'' " \
@@ -24,23 +32,6 @@
 #define COYAML_DEBUG(message, ...) if(info->debug) { \
     fprintf(stderr, "COYAML: " message "\n", ##__VA_ARGS__); }
 
-typedef enum {
-    VAR_INT,
-    VAR_STRING,
-    MAX_VARTYPE
-} vartype_t;
-
-typedef struct variable_s {
-    vartype_t type;
-    union {
-        long intvalue;
-        struct {
-            char *value;
-            int length;
-        } str;
-    } data;
-} variable_t;
-
 typedef enum {
     TOK_NONE,
     TOK_END,
@@ -65,6 +56,8 @@ typedef struct eval_context_s {
     char *next;
     char *end;
     token_t curtok;
+    int depth;  // of the stack after the code emitted so far
+    int maxdepth;
 } eval_context_t;
 
 static struct char_token_s {
@@ -82,25 +75,6 @@ static struct char_token_s {
     {'\0', TOK_END}  // to feel safer
     };
 
-static struct unit_s {
-    char *unit;
-    size_t value;
-} units[] = {
-    {"k", 1000L},
-    {"ki", 1L << 10},
-    {"M", 1000000L},
-    {"Mi", 1L << 20},
-    {"G", 1000000000L},
-    {"Gi", 1L << 30},
-    {"T", 1000000000000L},
-    {"Ti", 1L << 40},
-    {"P", 1000000000000000L},
-    {"Pi", 1L << 50},
-    {"E", 1000000000000000000L},
-    {"Ei", 1L << 60},
-    {NULL, 0},
-    };
-
 static char *find_var(coyaml_parseinfo_t *info, char *name, int nlen) {
     char *data;
     int dlen;
@@ -144,6 +118,7 @@ static token_t _next_tok(char **data, char *end) {
         return TOK_INT;
     }
     if(*cur == '"') {
+        ++cur;
         while(cur < end && (*cur != '"' || cur[-1] == '\\')) ++cur;
         ++cur;  // set position after the quote
         *data = cur;
@@ -161,294 +136,452 @@ static void next_tok(eval_context_t *ctx) {
     }
 }
 
-static char *parse_long(char *value, long *result) {
-    char *end;
-    long val = strtol(value, (char **)&end, 0);
-    if(*end) {
-        for(struct unit_s *unit = units; unit->unit; ++unit) {
-            if(!strcmp(end, unit->unit)) {
-                val *= unit->value;
-                end += strlen(unit->unit);
-                break;
-            }
-        }
-    }
-    *result = val;
-    return end;
-}
+// Expressions are compiled to code of a stack machine once per load, the
+// same text anywhere in the config (or replayed through aliases) reuses it
 
-static char *parse_double(char *value, double *result) {
-    char *end;
-    double val = strtod(value, (char **)&end);
-    if(*end) {
-        for(struct unit_s *unit = units; unit->unit; ++unit) {
-            if(!strcmp(end, unit->unit)) {
-                val *= unit->value;
-                end += strlen(unit->unit);
-                break;
-            }
-        }
-    }
-    *result = val;
-    return end;
-}
+#define EXPR_STACK 32
 
-static int var_to_integer(variable_t **var) {
-    variable_t *v = *var;
-    if(v->type == VAR_INT) return 0;
-    if(v->type != VAR_STRING) {
-        errno = ENOTSUP;
-        return -1;
+typedef enum {
+    OP_INT,
+    OP_STRING,
+    OP_VAR,
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_DIV,
+    OP_MOD,
+} opcode_t;
+
+typedef struct instr_s {
+    opcode_t op;
+    union {
+        long intvalue;
+        struct {
+            char *value;
+            int length;
+        } str;
+        int symbol;  // index in `info->symbols`
+    } arg;
+} instr_t;
+
+// Values of variables don't change during the load: the ones of context
+// are set before it, and the first anchor of the name wins. So the value
+// is looked up once, and results of expressions are memoized
+typedef struct coyaml_symbol_s {
+    char *name;  // points into the text of expression
+    int name_len;
+    char *value;  // NULL until found
+    int value_len;
+} coyaml_symbol_t;
+
+typedef struct coyaml_expr_s {
+    struct coyaml_expr_s *chain;
+    uint64_t hash;
+    char *text;
+    int len;
+    int ncode;
+    instr_t *code;
+    char *result;  // NULL until evaluated
+    int result_len;
+} coyaml_expr_t;
+
+typedef struct value_s {
+    char *str;  // NULL for integers
+    union {
+        long intvalue;
+        int length;
+    } data;
+} value_t;
+
+static int emit(eval_context_t *ctx, opcode_t op, instr_t *ins) {
+    ins->op = op;
+    ctx->depth += op <= OP_VAR ? 1 : -1;
+    if(ctx->depth > ctx->maxdepth) {
+        ctx->maxdepth = ctx->depth;
     }
-    char *end;
-    long val = strtol(v->data.str.value, &end, 0);
-    if(end != v->data.str.value + v->data.str.length) {
+    if(ctx->maxdepth > EXPR_STACK) {
         errno = EINVAL;
         return -1;
     }
-    v->type = VAR_INT;
-    v->data.intvalue = val;
+    obstack_grow(&ctx->info->exprs, ins, sizeof(instr_t));
     return 0;
 }
 
-static int var_to_string(variable_t **var) {
-    if(!*var) return -1;
-    if((*var)->type == VAR_STRING) return 0;
-    if((*var)->type != VAR_INT) {
-        errno = ENOTSUP;
-        return -1;
+static int intern(coyaml_parseinfo_t *info, char *name, int nlen) {
+    for(int i = 0; i < info->nsymbols; ++i) {
+        coyaml_symbol_t *sym = &info->symbols[i];
+        if(sym->name_len == nlen && !memcmp(sym->name, name, nlen)) {
+            return i;
+        }
     }
-    char buf[128];  // should be enought for long
-    int len = sprintf(buf, "%ld", (*var)->data.intvalue);
-    if(len <= 0) return -1;
-    variable_t *nvar = realloc(*var, sizeof(variable_t)+len+1);
-    if(!nvar) return -1;
-    nvar->type = VAR_STRING;
-    nvar->data.str.value = (char*)nvar + sizeof(variable_t);
-    memcpy(nvar->data.str.value, buf, len);
-    nvar->data.str.value[len] = 0;
-    nvar->data.str.length = len;
-    *var = nvar;
-    return 0;
+    if(info->nsymbols == info->symbols_size) {
+        int size = info->symbols_size ? info->symbols_size*2 : 16;
+        coyaml_symbol_t *symbols = realloc(info->symbols,
+            size*sizeof(coyaml_symbol_t));
+        if(!symbols) return -1;
+        info->symbols = symbols;
+        info->symbols_size = size;
+    }
+    coyaml_symbol_t *sym = &info->symbols[info->nsymbols];
+    sym->name = name;
+    sym->name_len = nlen;
+    sym->value = NULL;
+    sym->value_len = 0;
+    return info->nsymbols++;
 }
 
-static variable_t *eval_sum(eval_context_t *ctx);
+static int compile_sum(eval_context_t *ctx);
+
+static char *skip_space(char *cur) {
+    while(isspace(*cur)) ++cur;
+    return cur;
+}
 
-static variable_t *eval_atom(eval_context_t *ctx) {
+static int compile_atom(eval_context_t *ctx) {
+    instr_t ins;
     next_tok(ctx);
     if(ctx->curtok == TOK_LPAREN) {
-        variable_t *res = eval_sum(ctx);
-        if(!res) return NULL;
+        CHECK(compile_sum(ctx));
         if(ctx->curtok != TOK_RPAREN) {
-            free(res);
             errno = EINVAL;
-            return NULL;
+            return -1;
         }
         next_tok(ctx);
-        return res;
+        return 0;
     } else if(ctx->curtok == TOK_INT) {
-        variable_t *res = (variable_t *)malloc(sizeof(variable_t));
-        if(!res) return NULL;
-        res->type = VAR_INT;
-        res->data.intvalue = atoi(ctx->token);
-        next_tok(ctx);
-        return res;
+        if(coyaml_parse_long(ctx->token, ctx->next, &ins.arg.intvalue)
+            != ctx->next) {
+            errno = EINVAL;
+            return -1;
+        }
+        CHECK(emit(ctx, OP_INT, &ins));
     } else if(ctx->curtok == TOK_STRING) {
-        variable_t *res = (variable_t *)malloc(sizeof(variable_t)
-            + ctx->next - ctx->token - 1);
-        if(!res) return NULL;
-        res->type = VAR_STRING;
-        res->data.str.value = (char *)res + sizeof(variable_t);
-        res->data.str.length = ctx->next - ctx->token;
-        memcpy(res->data.str.value, ctx->token+1, ctx->next - ctx->token - 1);
-        res->data.str.value[ctx->next - ctx->token - 2] = 0;
-        next_tok(ctx);
-        return res;
-    } else if(ctx->curtok == TOK_IDENT) {
-        char *value = find_var(ctx->info, ctx->token, ctx->next - ctx->token);
-        if(!value) {
-            return NULL;
+        char *start = skip_space(ctx->token) + 1;
+        if(ctx->next > ctx->end) {
+            errno = EINVAL;
+            return -1;
         }
-        variable_t *res = (variable_t *)malloc(sizeof(variable_t));
-        if(!res) return NULL;
-        res->type = VAR_STRING;
-        res->data.str.value = value;
-        res->data.str.length = strlen(value);
-        next_tok(ctx);
-        return res;
+        ins.arg.str.value = start;
+        ins.arg.str.length = ctx->next - 1 - start;
+        CHECK(emit(ctx, OP_STRING, &ins));
+    } else if(ctx->curtok == TOK_IDENT) {
+        char *name = skip_space(ctx->token);
+        ins.arg.symbol = intern(ctx->info, name, ctx->next - name);
+        CHECK(ins.arg.symbol);
+        CHECK(emit(ctx, OP_VAR, &ins));
     } else {
         errno = EINVAL;
-        return NULL;
+        return -1;
     }
+    next_tok(ctx);
+    return 0;
 }
 
-static variable_t *eval_product(eval_context_t *ctx) {
-    variable_t *left = eval_atom(ctx);
-    if(!left) return NULL;
+// Multiplication is right-associative, as it always was
+static int compile_product(eval_context_t *ctx) {
+    CHECK(compile_atom(ctx));
     while(ctx->curtok == TOK_PRODUCT
         || ctx->curtok == TOK_DIVISION
         || ctx->curtok == TOK_MODULO) {
-        token_t op = ctx->curtok;
-        variable_t *right = eval_product(ctx);
-        if(!right) {
-            free(left);
-            return NULL;
-        }
-        if(var_to_integer(&left) || var_to_integer(&right)) {
-            free(left);
-            free(right);
-            return NULL;
-        }
-        if(op == TOK_PRODUCT) {
-            left->data.intvalue *= right->data.intvalue;
-        }
-        if(op == TOK_DIVISION) {
-            left->data.intvalue /= right->data.intvalue;
-        }
-        if(op == TOK_MODULO) {
-            left->data.intvalue %= right->data.intvalue;
-        }
-        free(right);
+        token_t tok = ctx->curtok;
+        CHECK(compile_product(ctx));
+        instr_t ins = {0};
+        CHECK(emit(ctx, tok == TOK_PRODUCT ? OP_MUL
+            : tok == TOK_DIVISION ? OP_DIV : OP_MOD, &ins));
     }
-    return left;
+    return 0;
 }
 
-static variable_t *eval_sum(eval_context_t *ctx) {
-    variable_t *left = eval_product(ctx);
-    if(!left) return NULL;
+static int compile_sum(eval_context_t *ctx) {
+    CHECK(compile_product(ctx));
     while(ctx->curtok == TOK_PLUS || ctx->curtok == TOK_MINUS) {
-        token_t op = ctx->curtok;
-        variable_t *right = eval_product(ctx);
-        if(!right) {
-            free(left);
-            return NULL;
+        token_t tok = ctx->curtok;
+        CHECK(compile_product(ctx));
+        instr_t ins = {0};
+        CHECK(emit(ctx, tok == TOK_PLUS ? OP_ADD : OP_SUB, &ins));
+    }
+    return 0;
+}
+
+static void rehash(coyaml_parseinfo_t *info) {
+    size_t size = info->expr_tablesize ? info->expr_tablesize*2 : 16;
+    coyaml_expr_t **table = obstack_alloc(&info->exprs,
+        size*sizeof(coyaml_expr_t *));
+    memset(table, 0, size*sizeof(coyaml_expr_t *));
+    for(size_t i = 0; i < info->expr_tablesize; ++i) {
+        for(coyaml_expr_t *e = info->expr_table[i], *n; e; e = n) {
+            n = e->chain;
+            e->chain = table[e->hash & (size-1)];
+            table[e->hash & (size-1)] = e;
+        }
+    }
+    info->expr_table = table;
+    info->expr_tablesize = size;
+}
+
+static coyaml_expr_t *compile(coyaml_parseinfo_t *info, char *data, int dlen)
+{
+    uint64_t hash = coyaml_hash(COYAML_HASH_INIT, data, dlen);
+    if(info->expr_tablesize) {
+        coyaml_expr_t *e = info->expr_table[hash & (info->expr_tablesize-1)];
+        for(; e; e = e->chain) {
+            if(e->hash == hash && e->len == dlen
+                && !memcmp(e->text, data, dlen)) {
+                return e;
+            }
         }
-        if(var_to_integer(&left) || var_to_integer(&right)) {
-            free(left);
-            free(right);
-            return NULL;
+    }
+    coyaml_expr_t *expr = obstack_alloc(&info->exprs, sizeof(coyaml_expr_t));
+    expr->hash = hash;
+    expr->len = dlen;
+    // Copy is zero-terminated, tokenizer stops at the zero
+    expr->text = obstack_copy0(&info->exprs, data, dlen);
+    expr->result = NULL;
+    expr->result_len = 0;
+    eval_context_t ctx = {
+        info: info,
+        data: expr->text,
+        end: expr->text+dlen,
+        token: expr->text,
+        next: expr->text,
+        curtok: TOK_NONE,
+        depth: 0,
+        maxdepth: 0,
+        };
+    obstack_blank(&info->exprs, 0);
+    if(compile_sum(&ctx) < 0 || ctx.curtok != TOK_END
+        || ctx.next < ctx.end) {
+        obstack_finish(&info->exprs);
+        obstack_free(&info->exprs, expr);
+        errno = EINVAL;
+        return NULL;
+    }
+    expr->ncode = obstack_object_size(&info->exprs) / sizeof(instr_t);
+    expr->code = obstack_finish(&info->exprs);
+    COYAML_DEBUG("Compiled ``%.*s'' to %d instructions", dlen, data,
+        expr->ncode);
+    if(info->expr_count >= info->expr_tablesize) {
+        rehash(info);
+    }
+    expr->chain = info->expr_table[hash & (info->expr_tablesize-1)];
+    info->expr_table[hash & (info->expr_tablesize-1)] = expr;
+    info->expr_count += 1;
+    return expr;
+}
+
+static int to_integer(value_t *val) {
+    if(!val->str) return 0;
+    char *end = val->str + val->data.length;
+    if(coyaml_parse_long(val->str, end, &val->data.intvalue) != end) {
+        errno = EINVAL;
+        return -1;
+    }
+    val->str = NULL;
+    return 0;
+}
+
+static int run(coyaml_parseinfo_t *info, coyaml_expr_t *expr, value_t *res) {
+    value_t stack[EXPR_STACK];
+    value_t *top = stack;
+    for(instr_t *ins = expr->code; ins < expr->code + expr->ncode; ++ins) {
+        switch(ins->op) {
+            case OP_INT:
+                top->str = NULL;
+                top->data.intvalue = ins->arg.intvalue;
+                ++top;
+                continue;
+            case OP_STRING:
+                top->str = ins->arg.str.value;
+                top->data.length = ins->arg.str.length;
+                ++top;
+                continue;
+            case OP_VAR: {
+                coyaml_symbol_t *sym = &info->symbols[ins->arg.symbol];
+                if(!sym->value) {
+                    sym->value = find_var(info, sym->name, sym->name_len);
+                    if(!sym->value) {
+                        errno = EINVAL;
+                        return -1;
+                    }
+                    sym->value_len = strlen(sym->value);
+                }
+                top->str = sym->value;
+                top->data.length = sym->value_len;
+                ++top;
+                continue;
+            }
+            default:
+                break;
         }
-        if(op == TOK_PLUS) {
-            left->data.intvalue += right->data.intvalue;
+        value_t *left = top - 2, *right = top - 1;
+        CHECK(to_integer(left));
+        CHECK(to_integer(right));
+        // Both overflow the quotient and trap on most CPUs
+        if((ins->op == OP_DIV || ins->op == OP_MOD)
+            && (!right->data.intvalue || (right->data.intvalue == -1
+                && left->data.intvalue == LONG_MIN))) {
+            errno = EDOM;
+            return -1;
         }
-        if(op == TOK_MINUS) {
-            left->data.intvalue -= right->data.intvalue;
+        switch(ins->op) {
+            case OP_ADD: left->data.intvalue += right->data.intvalue; break;
+            case OP_SUB: left->data.intvalue -= right->data.intvalue; break;
+            case OP_MUL: left->data.intvalue *= right->data.intvalue; break;
+            case OP_DIV: left->data.intvalue /= right->data.intvalue; break;
+            case OP_MOD: left->data.intvalue %= right->data.intvalue; break;
+            default: break;
         }
-        free(right);
+        --top;
     }
-    return left;
+    *res = stack[0];
+    return 0;
 }
 
-static variable_t *evaluate(coyaml_parseinfo_t *info, char *data, int dlen) {
-    eval_context_t eval = {
-        info: info,
-        data: data,
-        end: data+dlen,
-        token: data,
-        next:data,
-        curtok: TOK_NONE
-        };
-    variable_t *res = eval_sum(&eval);
-    if(eval.token != eval.end || eval.curtok != TOK_END) {
-        if(res) {
-            free(res);
+// The result is owned by the cache, strings of variables and literals
+// already live long enough, only integers are formatted into it
+static int evaluate(coyaml_parseinfo_t *info, char *data, int dlen,
+    char **result, int *rlen)
+{
+    coyaml_expr_t *expr = compile(info, data, dlen);
+    if(!expr) return -1;
+    if(!expr->result) {
+        value_t val;
+        CHECK(run(info, expr, &val));
+        if(val.str) {
+            expr->result = val.str;
+            expr->result_len = val.data.length;
+        } else {
+            char buf[24];
+            expr->result_len = sprintf(buf, "%ld", val.data.intvalue);
+            expr->result = obstack_copy0(&info->exprs,
+                buf, expr->result_len);
         }
-        return NULL;
     }
-    return res;
+    *result = expr->result;
+    *rlen = expr->result_len;
+    return 0;
+}
+
+void coyaml_eval_free(coyaml_parseinfo_t *info) {
+    obstack_free(&info->exprs, NULL);
+    free(info->symbols);
+}
+
+// Returns the first ``$'' or ``\'' in [p, end), or `end` if there is none
+static char *find_special(char *p, char *end) {
+#ifdef __SSE2__
+    const __m128i dollar = _mm_set1_epi8('$');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    for(; end - p >= 16; p += 16) {
+        __m128i chunk = _mm_loadu_si128((const __m128i *)p);
+        int mask = _mm_movemask_epi8(_mm_or_si128(
+            _mm_cmpeq_epi8(chunk, dollar), _mm_cmpeq_epi8(chunk, backslash)));
+        if(mask) return p + __builtin_ctz(mask);
+    }
+#else
+    // A zero byte in either xor means the chunk has one of the characters
+    for(; end - p >= 8; p += 8) {
+        uint64_t val;
+        memcpy(&val, p, 8);
+        uint64_t a = val ^ 0x2424242424242424ULL;
+        uint64_t b = val ^ 0x5C5C5C5C5C5C5C5CULL;
+        if((((a - 0x0101010101010101ULL) & ~a)
+            | ((b - 0x0101010101010101ULL) & ~b)) & 0x8080808080808080ULL)
+            break;
+    }
+#endif
+    for(; p < end; ++p) {
+        if(*p == '$' || *p == '\\') return p;
+    }
+    return end;
 }
 
+// Numbers are parsed first, a valid number can't have variables in it
 int coyaml_eval_int(coyaml_parseinfo_t *info,
     char *value, size_t vlen, long *result) {
-    if(info->parse_vars && strchr(value, '$')) {
-        char *data;
-        int dlen;
-        if(coyaml_eval_str(info, value, vlen, &data, &dlen)) {
-            return -1;
-        }
-        char *end = parse_long(data, result);
-        obstack_free(&info->head->pieces, data);
-        SYNTAX_ERROR(end == data + dlen);
-        return 0;
+    const char *end = coyaml_parse_long(value, value + vlen, result);
+    if(end == value + vlen) return 0;
+    SYNTAX_ERROR(info->parse_vars && memchr(value, '$', vlen));
+    char *data;
+    int dlen;
+    if(coyaml_eval_str(info, value, vlen, &data, &dlen)) {
+        return -1;
     }
-    char *end = parse_long(value, result);
-    SYNTAX_ERROR(end == value + vlen);
+    end = coyaml_parse_long(data, data + dlen, result);
+    obstack_free(&info->head->pieces, data);
+    SYNTAX_ERROR(end == data + dlen);
     return 0;
 }
 
 int coyaml_eval_float(coyaml_parseinfo_t *info,
     char *value, size_t vlen, double *result) {
-    if(info->parse_vars && strchr(value, '$')) {
-        char *data;
-        int dlen;
-        if(coyaml_eval_str(info, value, vlen, &data, &dlen)) {
-            return -1;
-        }
-        char *end = parse_double(data, result);
-        obstack_free(&info->head->pieces, data);
-        SYNTAX_ERROR(end == data + dlen);
-        return 0;
+    const char *end = coyaml_parse_double(value, value + vlen, result);
+    if(end == value + vlen) return 0;
+    SYNTAX_ERROR(info->parse_vars && memchr(value, '$', vlen));
+    char *data;
+    int dlen;
+    if(coyaml_eval_str(info, value, vlen, &data, &dlen)) {
+        return -1;
     }
-    char *end = parse_double(value, result);
-    SYNTAX_ERROR(end == value + vlen);
+    end = coyaml_parse_double(data, data + dlen, result);
+    obstack_free(&info->head->pieces, data);
+    SYNTAX_ERROR(end == data + dlen);
     return 0;
 }
 
+// Text between variables is copied in spans. Backslash escapes are only
+// processed in strings having a variable, so the string is copied as is if
+// there is no ``$'' after the first special character
 int coyaml_eval_str(coyaml_parseinfo_t *info,
     char *data, size_t dlen, char **result, int *rlen) {
-    if(info->parse_vars && strchr(data, '$')) {
-        obstack_blank(&info->head->pieces, 0);
-        for(char *c = data; *c;) {
-            if(*c != '$' && *c != '\\') {
-                obstack_1grow(&info->head->pieces, *c);
-                ++c;
-                continue;
-            }
-            if(*c == '\\') {
-                SYNTAX_ERROR(*++c);
-                obstack_1grow(&info->head->pieces, *c);
-                ++c;
-                continue;
-            }
+    struct obstack *pieces = &info->head->pieces;
+    char *end = data + dlen;
+    char *c = info->parse_vars ? find_special(data, end) : end;
+    if(c < end && *c == '\\' && !memchr(c, '$', end - c)) {
+        c = end;
+    }
+    if(c == end) {
+        *result = obstack_copy0(pieces, data, dlen);
+        *rlen = dlen;
+        return 0;
+    }
+    obstack_blank(pieces, 0);
+    obstack_grow(pieces, data, c - data);
+    while(c < end) {
+        if(*c == '\\') {
+            SYNTAX_ERROR(++c < end);
+            obstack_1grow(pieces, *c);
+            ++c;
+        } else if(++c < end && *c == '{') {
+            char *name = c + 1;
+            c = memchr(name, '}', end - name);
+            SYNTAX_ERROR(c);
+            char *value;
+            int vlen;
+            SYNTAX_ERROR(!evaluate(info, name, c - name, &value, &vlen));
+            obstack_grow(pieces, value, vlen);
             ++c;
+        } else {
             char *name = c;
-            int nlen;
-            if(*c == '{') {
-                ++c;
-                ++name;
-                while(*++c && *c != '}');
-                nlen = c - name;
-                SYNTAX_ERROR(*c++ == '}');
-                variable_t *var = evaluate(info, name, nlen);
-                SYNTAX_ERROR(var);
-                if(var_to_string(&var)) {
-                    free(var);
-                    SYNTAX_ERROR(0);
-                }
-                obstack_grow(&info->head->pieces,
-                    var->data.str.value, var->data.str.length);
-                free(var);
+            while(c < end && (isalnum(*c) || *c == '_')) ++c;
+            int nlen = c - name;
+            if(nlen == 0) {
+                obstack_1grow(pieces, '$');
             } else {
-                while(*c && (isalnum(*c) || *c == '_')) ++c;
-                nlen = c - name;
-                if(nlen == 0) {
-                    obstack_1grow(&info->head->pieces, '$');
-                    continue;
-                }
                 char *value = find_var(info, name, nlen);
                 if(value) {
-                    obstack_grow(&info->head->pieces, value, strlen(value));
+                    obstack_grow(pieces, value, strlen(value));
                 } else {
                     COYAML_DEBUG("Not found variable ``%.*s''", nlen, name);
                 }
             }
         }
-        obstack_1grow(&info->head->pieces, 0);
-        *rlen = obstack_object_size(&info->head->pieces)-1;
-        *result = obstack_finish(&info->head->pieces);
-    } else {
-        *result = obstack_copy0(&info->head->pieces, data, dlen);
-        *rlen = dlen;
+        char *next = find_special(c, end);
+        obstack_grow(pieces, c, next - c);
+        c = next;
     }
+    obstack_1grow(pieces, 0);
+    *rlen = obstack_object_size(pieces)-1;
+    *result = obstack_finish(pieces);
     return 0;
 }
@@ -9,5 +9,6 @@ int coyaml_eval_float(coyaml_parseinfo_t *info,
     char *value, size_t vlen, double *result);
 int coyaml_eval_str(coyaml_parseinfo_t *info,
     char *value, size_t vlen, char **result, int *rlen);
+void coyaml_eval_free(coyaml_parseinfo_t *info);
 
 #endif // _H_EVAL
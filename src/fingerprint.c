@@ -0,0 +1,183 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "fingerprint.h"
+#include "vars.h"
+
+static void fill_input(coyaml_input_t *inp, struct stat *finfo) {
+    inp->dev = finfo->st_dev;
+    inp->ino = finfo->st_ino;
+    inp->size = finfo->st_size;
+    inp->mtime = finfo->st_mtim.tv_sec;
+    inp->mtime_nsec = finfo->st_mtim.tv_nsec;
+}
+
+// Returns index of the input among the inputs of the same kind
+int coyaml_input_add(coyaml_context_t *ctx, char *filename,
+    coyaml_input_kind kind) {
+    struct stat finfo;
+    if(stat(filename, &finfo) < 0) return -1;
+    int nlen = strlen(filename);
+    coyaml_input_t *inp = obstack_alloc(&ctx->pieces,
+        sizeof(coyaml_input_t) + nlen + 1);
+    inp->next = NULL;
+    inp->kind = kind;
+    fill_input(inp, &finfo);
+    memcpy(inp->filename, filename, nlen+1);
+    int index = 0;
+    coyaml_input_t **last = &ctx->inputs;
+    while(*last) {
+        if((*last)->kind == kind) index += 1;
+        last = &(*last)->next;
+    }
+    *last = inp;
+    return index;
+}
+
+size_t coyaml_inputs_size(coyaml_context_t *ctx, int kindmask) {
+    size_t res = 0;
+    for(coyaml_input_t *inp = ctx->inputs; inp; inp = inp->next) {
+        if(!(kindmask & COYAML_INPUT_BIT(inp->kind))) continue;
+        res += COYAML_ALIGN(sizeof(coyaml_input_rec_t)
+            + strlen(inp->filename) + 1, 8);
+    }
+    return res;
+}
+
+int coyaml_inputs_pack(coyaml_context_t *ctx, int kindmask, char *buf) {
+    int count = 0;
+    for(coyaml_input_t *inp = ctx->inputs; inp; inp = inp->next) {
+        if(!(kindmask & COYAML_INPUT_BIT(inp->kind))) continue;
+        coyaml_input_rec_t *rec = (coyaml_input_rec_t *)buf;
+        size_t nlen = strlen(inp->filename);
+        size_t rsize = COYAML_ALIGN(sizeof(coyaml_input_rec_t) + nlen + 1, 8);
+        memset(rec, 0, rsize);
+        rec->dev = inp->dev;
+        rec->ino = inp->ino;
+        rec->size = inp->size;
+        rec->mtime = inp->mtime;
+        rec->mtime_nsec = inp->mtime_nsec;
+        rec->kind = inp->kind;
+        rec->name_len = nlen;
+        memcpy(rec->name, inp->filename, nlen);
+        buf += rsize;
+        count += 1;
+    }
+    return count;
+}
+
+// Checks that packed inputs are unchanged on disk and the first one is
+// the root file of the context. Returns -1 with errno ESTALE otherwise
+int coyaml_inputs_check(coyaml_context_t *ctx, char *buf, size_t size,
+    size_t count) {
+    char *end = buf + size;
+    for(size_t i = 0; i < count; ++i) {
+        coyaml_input_rec_t *rec = (coyaml_input_rec_t *)buf;
+        if(buf + sizeof(coyaml_input_rec_t) > end
+            || buf + sizeof(coyaml_input_rec_t) + rec->name_len + 1 > end
+            || rec->name[rec->name_len]) {
+            errno = EINVAL;
+            return -1;
+        }
+        if(!i && strcmp(rec->name, ctx->root_filename)) {
+            errno = ESTALE;
+            return -1;
+        }
+        struct stat finfo;
+        coyaml_input_t cur;
+        if(stat(rec->name, &finfo) < 0) {
+            errno = ESTALE;
+            return -1;
+        }
+        fill_input(&cur, &finfo);
+        if(cur.dev != rec->dev || cur.ino != rec->ino
+            || cur.size != rec->size || cur.mtime != rec->mtime
+            || cur.mtime_nsec != rec->mtime_nsec) {
+            errno = ESTALE;
+            return -1;
+        }
+        buf += COYAML_ALIGN(sizeof(coyaml_input_rec_t) + rec->name_len + 1, 8);
+    }
+    return 0;
+}
+
+int coyaml_write_all(int fd, void *data, size_t size) {
+    while(size) {
+        ssize_t res = write(fd, data, size);
+        if(res < 0) {
+            if(errno == EINTR) continue;
+            return -1;
+        }
+        data = (char *)data + res;
+        size -= res;
+    }
+    return 0;
+}
+
+// Writes cache file to temporary file and renames it, so that readers
+// never see partially written data
+int coyaml_write_atomic(char *filename, struct iovec *parts, int nparts) {
+    char tmpname[strlen(filename) + 32];
+    sprintf(tmpname, "%s.%d.tmp", filename, (int)getpid());
+    int fd = open(tmpname, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    if(fd < 0) return -1;
+    int res = 0;
+    for(int i = 0; i < nparts && !res; ++i) {
+        res = coyaml_write_all(fd, parts[i].iov_base, parts[i].iov_len);
+    }
+    if(close(fd) < 0) {
+        res = -1;
+    }
+    if(!res) {
+        res = rename(tmpname, filename);
+    }
+    if(res < 0) {
+        int err = errno;
+        unlink(tmpname);
+        errno = err;
+    }
+    return res;
+}
+
+// FNV-1a
+uint64_t coyaml_hash(uint64_t hash, const void *data, size_t len) {
+    const unsigned char *c = data;
+    for(size_t i = 0; i < len; ++i) {
+        hash ^= c[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static uint64_t hash_var(uint64_t hash, coyaml_variable_t *var) {
+    if(!var) return hash;
+    hash = hash_var(hash, var->left);
+    hash = coyaml_hash(hash, var->name, var->name_len + 1);
+    switch(var->type) {
+        case COYAML_VAR_STRING:
+            hash = coyaml_hash(hash, var->data.string.value,
+                var->data.string.value_len);
+            break;
+        case COYAML_VAR_INTEGER:
+            hash = coyaml_hash(hash, &var->data.integer.value,
+                sizeof(var->data.integer.value));
+            break;
+        default:
+            break;
+    }
+    hash = coyaml_hash(hash, "", 1);
+    return hash_var(hash, var->right);
+}
+
+// Hash of everything besides files which influences result of parsing
+uint64_t coyaml_vars_hash(coyaml_context_t *ctx) {
+    uint64_t hash = coyaml_hash(COYAML_HASH_INIT,
+        &ctx->parse_vars, sizeof(ctx->parse_vars));
+    return hash_var(hash, ctx->variables);
+}
@@ -0,0 +1,52 @@
+#ifndef _H_FINGERPRINT
+#define _H_FINGERPRINT
+
+#include <stdint.h>
+#include <sys/uio.h>
+#include <coyaml_src.h>
+
+typedef enum {
+    COYAML_INPUT_YAML,  // root file and !Include'd files
+    COYAML_INPUT_RAW,   // files read by !FromFile
+} coyaml_input_kind;
+
+// Identity of the input file, used to find out if cached data is stale
+typedef struct coyaml_input_s {
+    struct coyaml_input_s *next;
+    coyaml_input_kind kind;
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t mtime;
+    uint64_t mtime_nsec;
+    char filename[];
+} coyaml_input_t;
+
+// Serialized form of the `coyaml_input_t`, padded to 8 bytes
+typedef struct coyaml_input_rec_s {
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t size;
+    uint64_t mtime;
+    uint64_t mtime_nsec;
+    uint32_t kind;
+    uint32_t name_len;
+    char name[];
+} coyaml_input_rec_t;
+
+int coyaml_input_add(coyaml_context_t *ctx, char *filename,
+    coyaml_input_kind kind);
+size_t coyaml_inputs_size(coyaml_context_t *ctx, int kindmask);
+int coyaml_inputs_pack(coyaml_context_t *ctx, int kindmask, char *buf);
+int coyaml_inputs_check(coyaml_context_t *ctx, char *buf, size_t size,
+    size_t count);
+int coyaml_write_all(int fd, void *data, size_t size);
+int coyaml_write_atomic(char *filename, struct iovec *parts, int nparts);
+uint64_t coyaml_hash(uint64_t hash, const void *data, size_t len);
+uint64_t coyaml_vars_hash(coyaml_context_t *ctx);
+
+#define COYAML_HASH_INIT 0xcbf29ce484222325ULL
+#define COYAML_INPUT_BIT(kind) (1 << (kind))
+#define COYAML_ALIGN(val, align) (((val) + (align) - 1) & ~((align) - 1))
+
+#endif // _H_FINGERPRINT
@@ -0,0 +1,186 @@
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "hashset.h"
+#include "fingerprint.h"
+
+// Buckets are filled with two keys on average, the bigger ones are placed
+// first while the table is still empty
+#define BUCKET_KEYS 2
+// Only reached if two different strings have the same 64-bit hash
+#define MAX_DISPLACE (1u << 24)
+
+typedef struct bucket_s {
+    coyaml_hashnode_t *keys;  // linked by `chain`
+    size_t len;
+    size_t index;
+} bucket_t;
+
+static size_t bucket_of(uint64_t hash, size_t mask) {
+    return (hash ^ hash >> 32) & mask;
+}
+
+static size_t slot_of(uint64_t hash, uint32_t displace, size_t count) {
+    uint64_t x = hash + displace * 0x9e3779b97f4a7c15ULL;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return ((x & 0xffffffffULL) * count) >> 32;
+}
+
+void coyaml_hashbuild_init(coyaml_hashbuild_t *build, struct obstack *tmp) {
+    memset(build, 0, sizeof(coyaml_hashbuild_t));
+    build->tmp = tmp;
+}
+
+static void rehash(coyaml_hashbuild_t *build) {
+    size_t size = build->tablesize ? build->tablesize*2 : 16;
+    coyaml_hashnode_t **table = obstack_alloc(build->tmp,
+        size*sizeof(coyaml_hashnode_t *));
+    memset(table, 0, size*sizeof(coyaml_hashnode_t *));
+    for(coyaml_hashnode_t *node = build->first; node; node = node->next) {
+        size_t idx = node->hash & (size - 1);
+        node->chain = table[idx];
+        table[idx] = node;
+    }
+    build->table = table;
+    build->tablesize = size;
+}
+
+// Returns 1 and doesn't add the string if it's already there
+int coyaml_hashbuild_add(coyaml_hashbuild_t *build,
+    const char *value, size_t len)
+{
+    uint64_t hash = coyaml_hash(COYAML_HASH_INIT, value, len);
+    if(build->tablesize) {
+        coyaml_hashnode_t *node = build->table[hash & (build->tablesize-1)];
+        for(; node; node = node->chain) {
+            if(node->hash == hash && node->item.len == len
+                && !memcmp(node->item.value, value, len)) {
+                return 1;
+            }
+        }
+    }
+    coyaml_hashnode_t *node = obstack_alloc(build->tmp,
+        sizeof(coyaml_hashnode_t));
+    node->next = NULL;
+    node->hash = hash;
+    node->item.value = value;
+    node->item.len = len;
+    if(build->last) {
+        build->last->next = node;
+    } else {
+        build->first = node;
+    }
+    build->last = node;
+    build->count += 1;
+    if(build->count > build->tablesize) {
+        rehash(build);
+    } else {
+        size_t idx = hash & (build->tablesize-1);
+        node->chain = build->table[idx];
+        build->table[idx] = node;
+    }
+    return 0;
+}
+
+static int bucket_cmp(const void *a, const void *b) {
+    const bucket_t *ba = a, *bb = b;
+    if(ba->len != bb->len) {
+        return ba->len < bb->len ? 1 : -1;
+    }
+    return ba->index < bb->index ? -1 : ba->index > bb->index;
+}
+
+// Hash and displace: for each bucket, starting from the biggest, finds
+// the displacement which puts all its keys into free slots. There are as
+// many slots as keys, so the table has no holes
+int coyaml_hashset_build(coyaml_head_t *head, coyaml_hashbuild_t *build,
+    coyaml_hashset_t *set)
+{
+    memset(set, 0, sizeof(coyaml_hashset_t));
+    size_t count = build->count;
+    if(!count) return 0;
+    size_t nbuckets = 1;
+    while(nbuckets * BUCKET_KEYS < count) {
+        nbuckets <<= 1;
+    }
+    bucket_t *buckets = obstack_alloc(build->tmp,
+        nbuckets*sizeof(bucket_t));
+    for(size_t i = 0; i < nbuckets; ++i) {
+        buckets[i].keys = NULL;
+        buckets[i].len = 0;
+        buckets[i].index = i;
+    }
+    for(coyaml_hashnode_t *node = build->first; node; node = node->next) {
+        bucket_t *bucket = &buckets[bucket_of(node->hash, nbuckets-1)];
+        node->chain = bucket->keys;
+        bucket->keys = node;
+        bucket->len += 1;
+    }
+    qsort(buckets, nbuckets, sizeof(bucket_t), bucket_cmp);
+
+    uint32_t *displace = obstack_alloc(&head->pieces,
+        nbuckets*sizeof(uint32_t));
+    memset(displace, 0, nbuckets*sizeof(uint32_t));
+    char *taken = obstack_alloc(build->tmp, count);
+    memset(taken, 0, count);
+    size_t *slots = obstack_alloc(build->tmp, buckets[0].len*sizeof(size_t));
+    for(bucket_t *bucket = buckets; bucket < buckets + nbuckets
+        && bucket->len; ++bucket)
+    {
+        uint32_t d;
+        for(d = 0; d < MAX_DISPLACE; ++d) {
+            size_t n = 0;
+            coyaml_hashnode_t *node;
+            for(node = bucket->keys; node; node = node->chain) {
+                size_t slot = slot_of(node->hash, d, count);
+                if(taken[slot]) break;
+                taken[slot] = 1;
+                slots[n++] = slot;
+            }
+            if(!node) break;
+            while(n) {
+                taken[slots[--n]] = 0;
+            }
+        }
+        if(d == MAX_DISPLACE) {
+            errno = ECOYAML_VALUE_ERROR;
+            return -1;
+        }
+        displace[bucket->index] = d;
+    }
+
+    coyaml_hashitem_t *items = obstack_alloc(&head->pieces,
+        count*sizeof(coyaml_hashitem_t));
+    uint32_t *tags = obstack_alloc(&head->pieces, count*sizeof(uint32_t));
+    uint32_t *order = obstack_alloc(&head->pieces, count*sizeof(uint32_t));
+    size_t i = 0;
+    for(coyaml_hashnode_t *node = build->first; node; node = node->next) {
+        size_t slot = slot_of(node->hash,
+            displace[bucket_of(node->hash, nbuckets-1)], count);
+        items[slot] = node->item;
+        tags[slot] = node->hash >> 32;
+        order[i++] = slot;
+    }
+    set->count = count;
+    set->mask = nbuckets - 1;
+    set->displace = displace;
+    set->tags = tags;
+    set->items = items;
+    set->order = order;
+    return 0;
+}
+
+bool coyaml_hashset_contains(const coyaml_hashset_t *set,
+    const char *str, size_t len)
+{
+    if(!set->count) return FALSE;
+    uint64_t hash = coyaml_hash(COYAML_HASH_INIT, str, len);
+    size_t slot = slot_of(hash,
+        set->displace[bucket_of(hash, set->mask)], set->count);
+    if(set->tags[slot] != (uint32_t)(hash >> 32)) return FALSE;
+    const coyaml_hashitem_t *item = &set->items[slot];
+    return item->len == len && !memcmp(item->value, str, len);
+}
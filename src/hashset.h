@@ -0,0 +1,30 @@
+#ifndef _H_HASHSET
+#define _H_HASHSET
+
+#include <coyaml_src.h>
+
+typedef struct coyaml_hashnode_s {
+    struct coyaml_hashnode_s *next;  // in the order of adding
+    struct coyaml_hashnode_s *chain;  // in the bucket of `table`
+    uint64_t hash;
+    coyaml_hashitem_t item;
+} coyaml_hashnode_t;
+
+// Strings of the set being read, all the memory is in `tmp` obstack,
+// strings themselves must outlive the set
+typedef struct coyaml_hashbuild_s {
+    struct obstack *tmp;
+    coyaml_hashnode_t *first;
+    coyaml_hashnode_t *last;
+    size_t count;
+    size_t tablesize;  // power of two
+    coyaml_hashnode_t **table;
+} coyaml_hashbuild_t;
+
+void coyaml_hashbuild_init(coyaml_hashbuild_t *build, struct obstack *tmp);
+int coyaml_hashbuild_add(coyaml_hashbuild_t *build,
+    const char *value, size_t len);
+int coyaml_hashset_build(coyaml_head_t *head, coyaml_hashbuild_t *build,
+    coyaml_hashset_t *set);
+
+#endif // _H_HASHSET
@@ -0,0 +1,232 @@
+#include <string.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "mapindex.h"
+#include "fingerprint.h"
+
+#define KEY_STR(el, off) (*(char **)((char *)(el) + (off)))
+#define KEY_LEN(el, off) (*(int *)((char *)(el) + (off) + sizeof(char *)))
+#define KEY_INT(el, off) (*(long *)((char *)(el) + (off)))
+
+// Dense table is chosen when it's at most that many times larger than the
+// hash table would be
+#define DENSE_FACTOR 2
+
+static uint64_t hash_int(long key) {
+    uint64_t h = (uint64_t)key * 0x9E3779B97F4A7C15ULL;
+    return h ^ (h >> 29);
+}
+
+static void **slot_str(coyaml_index_t *idx, const char *key, size_t len) {
+    size_t mask = idx->nslots - 1;
+    size_t i = coyaml_hash(COYAML_HASH_INIT, key, len) & mask;
+    for(;; i = (i + 1) & mask) {
+        void *el = idx->slots[i];
+        if(!el || ((size_t)KEY_LEN(el, idx->keyoffset) == len
+            && (!len || !memcmp(KEY_STR(el, idx->keyoffset), key, len))))
+            return &idx->slots[i];
+    }
+}
+
+static void **slot_int(coyaml_index_t *idx, long key) {
+    if(idx->kind == COYAML_INDEX_DENSE) {
+        unsigned long i = (unsigned long)key - (unsigned long)idx->base;
+        return i < idx->nslots ? &idx->slots[i] : NULL;
+    }
+    size_t mask = idx->nslots - 1;
+    size_t i = hash_int(key) & mask;
+    for(;; i = (i + 1) & mask) {
+        void *el = idx->slots[i];
+        if(!el || KEY_INT(el, idx->keyoffset) == key)
+            return &idx->slots[i];
+    }
+}
+
+static void **slot_el(coyaml_index_t *idx, void *el) {
+    if(idx->keytype == COYAML_STRING) {
+        return slot_str(idx, KEY_STR(el, idx->keyoffset),
+            KEY_LEN(el, idx->keyoffset));
+    }
+    return slot_int(idx, KEY_INT(el, idx->keyoffset));
+}
+
+static coyaml_type_enum key_type(coyaml_placeholder_t *prop) {
+    switch(prop->type->ident) {
+        case COYAML_STRING:
+        case COYAML_FILE:
+        case COYAML_DIR:
+            return COYAML_STRING;
+        case COYAML_INT:
+        case COYAML_UINT:
+            return COYAML_INT;
+        default:
+            return COYAML_TYPE_SENTINEL;
+    }
+}
+
+// Builds index over the linked list starting at `first`. Elements are not
+// moved, so iteration order is kept. When `duplicate` is not NULL it's set
+// to the first element whose key is already in the index
+coyaml_index_t *coyaml_index_build(struct obstack *pieces, void *first,
+    coyaml_type_enum keytype, size_t keyoffset, void **duplicate) {
+    if(duplicate) *duplicate = NULL;
+    size_t count = 0;
+    long min = 0, max = 0;
+    for(coyaml_arrayel_head_t *el = first; el; el = el->next) {
+        if(keytype == COYAML_INT) {
+            long key = KEY_INT(el, keyoffset);
+            if(!count || key < min) min = key;
+            if(!count || key > max) max = key;
+        }
+        count += 1;
+    }
+    size_t nslots = 4;
+    while(nslots < count*2) nslots *= 2;
+    coyaml_index_kind kind = COYAML_INDEX_HASH;
+    if(keytype == COYAML_INT
+        && (unsigned long)max - (unsigned long)min < nslots*DENSE_FACTOR) {
+        kind = COYAML_INDEX_DENSE;
+        nslots = (unsigned long)max - (unsigned long)min + 1;
+    }
+    size_t size = sizeof(coyaml_index_t) + nslots*sizeof(void *);
+    coyaml_index_t *idx = obstack_alloc(pieces, size);
+    memset(idx, 0, size);
+    idx->kind = kind;
+    idx->keytype = keytype;
+    idx->keyoffset = keyoffset;
+    idx->base = min;
+    idx->nslots = nslots;
+    for(coyaml_arrayel_head_t *el = first; el; el = el->next) {
+        void **slot = slot_el(idx, el);
+        // On duplicate keys the first one wins, same as with linear search
+        if(!*slot) {
+            *slot = el;
+        } else if(duplicate && !*duplicate) {
+            *duplicate = el;
+        }
+    }
+    return idx;
+}
+
+int coyaml_mapping_index(struct obstack *pieces, coyaml_mapping_t *def,
+    void *target) {
+    if(!def->indexoffset) return 0;
+    coyaml_index_t **index =
+        (coyaml_index_t **)((char *)target + def->indexoffset);
+    *index = NULL;
+    coyaml_mappingel_head_t *first =
+        *(coyaml_mappingel_head_t **)((char *)target + def->baseoffset);
+    if(!first) return 0;
+    coyaml_type_enum keytype = key_type(def->key_prop);
+    if(keytype == COYAML_TYPE_SENTINEL) return 0;
+    *index = coyaml_index_build(pieces, first, keytype,
+        def->key_prop->baseoffset, NULL);
+    return 0;
+}
+
+// Builds all indexes declared for the array. Uniqueness is checked only
+// when `dup` is not NULL
+int coyaml_array_index(struct obstack *pieces, coyaml_array_t *def,
+    void *target, coyaml_index_dup_t *dup) {
+    if(!def->indexes) return 0;
+    coyaml_index_t ***target_indexes =
+        (coyaml_index_t ***)((char *)target + def->indexoffset);
+    *target_indexes = NULL;
+    coyaml_arrayel_head_t *first =
+        *(coyaml_arrayel_head_t **)((char *)target + def->baseoffset);
+    if(!first) return 0;
+    size_t count = 0;
+    while(def->indexes[count].name) ++count;
+    coyaml_index_t **indexes = obstack_alloc(pieces,
+        (count+1)*sizeof(coyaml_index_t *));
+    for(size_t i = 0; i < count; ++i) {
+        coyaml_arrayindex_t *adef = &def->indexes[i];
+        void *el;
+        indexes[i] = coyaml_index_build(pieces, first,
+            adef->keytype, adef->keyoffset, dup ? &el : NULL);
+        if(dup && adef->unique && el) {
+            dup->index = adef;
+            dup->element = el;
+            dup->position = 0;
+            for(coyaml_arrayel_head_t *cur = first; cur != el;
+                cur = cur->next) {
+                dup->position += 1;
+            }
+            errno = ECOYAML_VALUE_ERROR;
+            return -1;
+        }
+    }
+    indexes[count] = NULL;
+    *target_indexes = indexes;
+    return 0;
+}
+
+// Returns slot where the element is stored, or -1 if the element is
+// shadowed by an earlier one with the same key
+ssize_t coyaml_index_position(coyaml_index_t *idx, void *el) {
+    void **slot = slot_el(idx, el);
+    if(!slot || *slot != el) return -1;
+    return slot - idx->slots;
+}
+
+static void *find_str(void *list, coyaml_index_t *idx, size_t keyoffset,
+    const char *key, size_t keylen) {
+    if(idx) {
+        return *slot_str(idx, key, keylen);
+    }
+    // Lists in baked configs have no index
+    for(coyaml_arrayel_head_t *el = list; el; el = el->next) {
+        if((size_t)KEY_LEN(el, keyoffset) == keylen
+            && (!keylen || !memcmp(KEY_STR(el, keyoffset), key, keylen)))
+            return el;
+    }
+    return NULL;
+}
+
+static void *find_int(void *list, coyaml_index_t *idx, size_t keyoffset,
+    long key) {
+    if(idx) {
+        void **slot = slot_int(idx, key);
+        return slot ? *slot : NULL;
+    }
+    for(coyaml_arrayel_head_t *el = list; el; el = el->next) {
+        if(KEY_INT(el, keyoffset) == key)
+            return el;
+    }
+    return NULL;
+}
+
+void *coyaml_mapping_find_str(void *map, coyaml_index_t *index,
+    size_t keyoffset, const char *key, size_t keylen) {
+    if(!map) return NULL;
+    return find_str(map, index, keyoffset, key, keylen);
+}
+
+void *coyaml_mapping_find_int(void *map, coyaml_index_t *index,
+    size_t keyoffset, long key) {
+    if(!map) return NULL;
+    return find_int(map, index, keyoffset, key);
+}
+
+static coyaml_index_t *array_index(coyaml_index_t **indexes,
+    size_t keyoffset) {
+    for(; indexes && *indexes; ++indexes) {
+        if((*indexes)->keyoffset == keyoffset) return *indexes;
+    }
+    return NULL;
+}
+
+void *coyaml_array_find_str(void *array, coyaml_index_t **indexes,
+    size_t keyoffset, const char *key, size_t keylen) {
+    if(!array) return NULL;
+    return find_str(array, array_index(indexes, keyoffset),
+        keyoffset, key, keylen);
+}
+
+void *coyaml_array_find_int(void *array, coyaml_index_t **indexes,
+    size_t keyoffset, long key) {
+    if(!array) return NULL;
+    return find_int(array, array_index(indexes, keyoffset), keyoffset, key);
+}
@@ -0,0 +1,37 @@
+#ifndef _H_MAPINDEX
+#define _H_MAPINDEX
+
+#include <sys/types.h>
+#include <obstack.h>
+#include <coyaml_src.h>
+
+typedef enum {
+    COYAML_INDEX_HASH = 1,  // open addressing with linear probing
+    COYAML_INDEX_DENSE,     // slot is `key - base`, for integer keys
+} coyaml_index_kind;
+
+typedef struct coyaml_index_s {
+    coyaml_index_kind kind;
+    coyaml_type_enum keytype;  // COYAML_STRING or COYAML_INT
+    size_t keyoffset;
+    long base;
+    size_t nslots;  // power of two for hash index
+    void *slots[];
+} coyaml_index_t;
+
+// Element which violates unique index
+typedef struct coyaml_index_dup_s {
+    coyaml_arrayindex_t *index;
+    void *element;
+    size_t position;
+} coyaml_index_dup_t;
+
+coyaml_index_t *coyaml_index_build(struct obstack *pieces, void *first,
+    coyaml_type_enum keytype, size_t keyoffset, void **duplicate);
+int coyaml_mapping_index(struct obstack *pieces, coyaml_mapping_t *def,
+    void *target);
+int coyaml_array_index(struct obstack *pieces, coyaml_array_t *def,
+    void *target, coyaml_index_dup_t *dup);
+ssize_t coyaml_index_position(coyaml_index_t *idx, void *el);
+
+#endif // _H_MAPINDEX
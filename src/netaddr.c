@@ -0,0 +1,262 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/un.h>
+
+#include "netaddr.h"
+#include "columns.h"
+#include "util.h"
+
+#define REF(obj, off, typ) (*(typ*)((char *)(obj) + (off)))
+// Longest textual address, `[v6]:port` or unix socket path
+#define MAX_ADDRESS 128
+
+static int parse_port(const char *value, int *port) {
+    char *end;
+    if(!*value) return -1;
+    long val = strtol(value, &end, 10);
+    if(*end || val < 0 || val > 65535) return -1;
+    *port = val;
+    return 0;
+}
+
+// Only literals are accepted, names are never resolved. Forms are:
+// `1.2.3.4:80`, `[::1]:80`, `*:80` for any IPv4 address, `/path` or
+// `./path` for unix socket, and `&3` for inherited file descriptor. Port
+// may be omitted if `default_port` is not negative. Returns message of
+// the error, or NULL
+const char *coyaml_sockaddr_parse(coyaml_sockaddr_t *res,
+    const char *value, size_t len, int default_port)
+{
+    char buf[MAX_ADDRESS];
+    memset(res, 0, sizeof(coyaml_sockaddr_t));
+    if(len >= sizeof(buf)) return "Address is too long";
+    memcpy(buf, value, len);
+    buf[len] = 0;
+    if(buf[0] == '&') {
+        char *end;
+        long fd = strtol(buf+1, &end, 10);
+        if(!buf[1] || *end || fd < 0 || fd > 65535) {
+            return "Bad file descriptor";
+        }
+        res->kind = COYAML_SOCKADDR_FD;
+        res->fd = fd;
+        return NULL;
+    }
+    res->fd = -1;
+    if(buf[0] == '/' || (buf[0] == '.' && buf[1] == '/')) {
+        struct sockaddr_un *un = (struct sockaddr_un *)&res->addr;
+        if(len >= sizeof(un->sun_path)) return "Socket path is too long";
+        un->sun_family = AF_UNIX;
+        memcpy(un->sun_path, buf, len+1);
+        res->kind = COYAML_SOCKADDR_UNIX;
+        res->addrlen = offsetof(struct sockaddr_un, sun_path) + len + 1;
+        return NULL;
+    }
+    char *host = buf;
+    char *port = NULL;
+    if(buf[0] == '[') {
+        char *end = strchr(buf, ']');
+        if(!end) return "Unterminated ``[''";
+        host = buf + 1;
+        *end = 0;
+        if(end[1] == ':') {
+            port = end + 2;
+        } else if(end[1]) {
+            return "Colon expected after ``]''";
+        }
+    } else {
+        port = strrchr(buf, ':');
+        if(port) {
+            *port++ = 0;
+        }
+    }
+    int portnum = default_port;
+    if(port) {
+        if(parse_port(port, &portnum) < 0) return "Bad port";
+    } else if(default_port < 0) {
+        return "Port expected";
+    }
+    if(host != buf) {
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&res->addr;
+        if(inet_pton(AF_INET6, host, &in6->sin6_addr) != 1) {
+            return "Bad IPv6 address";
+        }
+        in6->sin6_family = AF_INET6;
+        in6->sin6_port = htons(portnum);
+        res->kind = COYAML_SOCKADDR_INET6;
+        res->addrlen = sizeof(struct sockaddr_in6);
+        return NULL;
+    }
+    struct sockaddr_in *in = (struct sockaddr_in *)&res->addr;
+    if(!strcmp(host, "*")) {
+        in->sin_addr.s_addr = htonl(INADDR_ANY);
+    } else if(inet_pton(AF_INET, host, &in->sin_addr) != 1) {
+        return "Bad IPv4 address";
+    }
+    in->sin_family = AF_INET;
+    in->sin_port = htons(portnum);
+    res->kind = COYAML_SOCKADDR_INET;
+    res->addrlen = sizeof(struct sockaddr_in);
+    return NULL;
+}
+
+int coyaml_sockaddr_format(const coyaml_sockaddr_t *addr,
+    char *buf, size_t len)
+{
+    char host[INET6_ADDRSTRLEN];
+    switch(addr->kind) {
+        case COYAML_SOCKADDR_INET: {
+            struct sockaddr_in *in = (struct sockaddr_in *)&addr->addr;
+            inet_ntop(AF_INET, &in->sin_addr, host, sizeof(host));
+            return snprintf(buf, len, "%s:%d", host, ntohs(in->sin_port));
+            }
+        case COYAML_SOCKADDR_INET6: {
+            struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&addr->addr;
+            inet_ntop(AF_INET6, &in6->sin6_addr, host, sizeof(host));
+            return snprintf(buf, len, "[%s]:%d", host,
+                ntohs(in6->sin6_port));
+            }
+        case COYAML_SOCKADDR_UNIX:
+            return snprintf(buf, len, "%s",
+                ((struct sockaddr_un *)&addr->addr)->sun_path);
+        case COYAML_SOCKADDR_FD:
+            return snprintf(buf, len, "&%d", addr->fd);
+        default:
+            return snprintf(buf, len, "%s", "");
+    }
+}
+
+// Accepts `10.0.0.0/8`, `fe80::/10` or a single address, which is a
+// network of itself. Host bits are cleared
+const char *coyaml_network_parse(coyaml_network_t *res,
+    const char *value, size_t len)
+{
+    char buf[MAX_ADDRESS];
+    memset(res, 0, sizeof(coyaml_network_t));
+    if(len >= sizeof(buf)) return "Network is too long";
+    memcpy(buf, value, len);
+    buf[len] = 0;
+    char *slash = strchr(buf, '/');
+    if(slash) {
+        *slash = 0;
+    }
+    int bits;
+    if(inet_pton(AF_INET, buf, res->addr) == 1) {
+        res->family = AF_INET;
+        bits = 32;
+    } else if(inet_pton(AF_INET6, buf, res->addr) == 1) {
+        res->family = AF_INET6;
+        bits = 128;
+    } else {
+        return "Bad IP address";
+    }
+    res->prefixlen = bits;
+    if(slash) {
+        char *end;
+        long val = strtol(slash+1, &end, 10);
+        if(!slash[1] || *end || val < 0 || val > bits) {
+            return "Bad prefix length";
+        }
+        res->prefixlen = val;
+    }
+    for(int i = res->prefixlen; i < bits; ++i) {
+        res->addr[i >> 3] &= ~(0x80 >> (i & 7));
+    }
+    return NULL;
+}
+
+int coyaml_network_format(const coyaml_network_t *net,
+    char *buf, size_t len)
+{
+    char host[INET6_ADDRSTRLEN];
+    if(!net->family) {
+        return snprintf(buf, len, "%s", "");
+    }
+    inet_ntop(net->family, net->addr, host, sizeof(host));
+    return snprintf(buf, len, "%s/%d", host, net->prefixlen);
+}
+
+#define BIT(addr, i) (((addr)[(i) >> 3] >> (7 - ((i) & 7))) & 1)
+
+// Builds radix tree from the networks of the array, must be called each
+// time the array is changed, like coyaml_array_columns(). When the same
+// network is listed twice, the first element is found
+int coyaml_cidrset_build(coyaml_head_t *head, coyaml_array_t *def,
+    void *target)
+{
+    if(!def->setoffset || def->element_prop->type->ident != COYAML_CIDR) {
+        return 0;
+    }
+    size_t len = coyaml_array_length(def, target);
+    coyaml_cidrset_t *set = obstack_alloc(&head->pieces,
+        sizeof(coyaml_cidrset_t));
+    memset(set, 0, sizeof(coyaml_cidrset_t));
+    char *base = (char *)target + def->baseoffset;
+    char *item = def->capacity ? base : REF(base, 0, char *);
+    for(size_t i = 0; i < len; ++i) {
+        coyaml_network_t *net = &REF(item, def->element_prop->baseoffset,
+            coyaml_network_t);
+        coyaml_cidrnode_t **node = net->family == AF_INET
+            ? &set->inet : &set->inet6;
+        for(int bit = 0;; ++bit) {
+            if(!*node) {
+                *node = obstack_alloc(&head->pieces,
+                    sizeof(coyaml_cidrnode_t));
+                memset(*node, 0, sizeof(coyaml_cidrnode_t));
+            }
+            if(bit == net->prefixlen) break;
+            node = &(*node)->child[BIT(net->addr, bit)];
+        }
+        if(!(*node)->element) {
+            (*node)->element = item;
+        }
+        if(def->capacity) {
+            item += def->element_size;
+        } else {
+            item = ((coyaml_arrayel_head_t *)item)->next;
+        }
+    }
+    REF(target, def->setoffset, coyaml_cidrset_t *) = set;
+    return 0;
+}
+
+void *coyaml_cidr_match(const coyaml_cidrset_t *set,
+    const struct sockaddr *addr)
+{
+    if(!set) return NULL;
+    const unsigned char *bytes;
+    const coyaml_cidrnode_t *node;
+    int bits;
+    if(addr->sa_family == AF_INET) {
+        bytes = (unsigned char *)&((struct sockaddr_in *)addr)->sin_addr;
+        node = set->inet;
+        bits = 32;
+    } else if(addr->sa_family == AF_INET6) {
+        const struct in6_addr *a6 = &((struct sockaddr_in6 *)addr)->sin6_addr;
+        if(IN6_IS_ADDR_V4MAPPED(a6)) {
+            bytes = a6->s6_addr + 12;
+            node = set->inet;
+            bits = 32;
+        } else {
+            bytes = a6->s6_addr;
+            node = set->inet6;
+            bits = 128;
+        }
+    } else {
+        return NULL;
+    }
+    void *res = NULL;
+    for(int bit = 0; node; ++bit) {
+        if(node->element) {
+            res = node->element;
+        }
+        if(bit == bits) break;
+        node = node->child[BIT(bytes, bit)];
+    }
+    return res;
+}
@@ -0,0 +1,17 @@
+#ifndef _H_NETADDR
+#define _H_NETADDR
+
+#include <coyaml_src.h>
+
+const char *coyaml_sockaddr_parse(coyaml_sockaddr_t *res,
+    const char *value, size_t len, int default_port);
+int coyaml_sockaddr_format(const coyaml_sockaddr_t *addr,
+    char *buf, size_t len);
+const char *coyaml_network_parse(coyaml_network_t *res,
+    const char *value, size_t len);
+int coyaml_network_format(const coyaml_network_t *net,
+    char *buf, size_t len);
+int coyaml_cidrset_build(coyaml_head_t *head, coyaml_array_t *def,
+    void *target);
+
+#endif // _H_NETADDR
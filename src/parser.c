@@ -2,13 +2,16 @@
 #include <yaml.h>
 #include <errno.h>
 #include <obstack.h>
+#include <string.h>
 #include <strings.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/fcntl.h>
+#include <sys/mman.h>
 #include <unistd.h>
 #include <alloca.h>
 #include <ctype.h>
+#include <stdarg.h>
 
 #include <coyaml_src.h>
 #include "vars.h"
@@ -16,6 +19,15 @@
 #include "util.h"
 #include "copy.h"
 #include "eval.h"
+#include "fingerprint.h"
+#include "tape.h"
+#include "mapindex.h"
+#include "columns.h"
+#include "scalars.h"
+#include "patterns.h"
+#include "netaddr.h"
+#include "hashset.h"
+#include "convert.h"
 
 #define SYNTAX_ERROR(cond) if(!(cond)) { \
     fprintf(stderr, "COYAML: Syntax error in config file ``%s'' " \
@@ -52,6 +64,12 @@
     return -1; }
 #define COYAML_DEBUG(message, ...) if(info->debug) { \
     fprintf(stderr, "COYAML: " message "\n", ##__VA_ARGS__); }
+#define LIMIT_CHECK(counter, limit, name) \
+    if((limit) && (counter) > (limit)) { \
+    limit_error(info, (name), (counter), (limit)); \
+    errno = ECOYAML_LIMIT_EXCEEDED; \
+    return -1; }
+#define ARENA_CHECK_INTERVAL 256
 #define SETFLAG(info, def) if((info)->top_mark && (def)->flagoffset) { \
     COYAML_ASSERT(!((info)->top_mark->filled[(def)->flagoffset])); \
     (info)->top_mark->filled[(def)->flagoffset] = 1; \
@@ -80,6 +98,37 @@ static char zero[sizeof(yaml_event_t)] = {0}; // compiler should make this zero
 static int coyaml_next(coyaml_parseinfo_t *info);
 static int topmost_next(coyaml_parseinfo_t *info);
 
+static void limit_error(coyaml_parseinfo_t *info, char *name,
+    size_t value, size_t limit) {
+    coyaml_counters_t *cnt = &info->context->counters;
+    cnt->arena_bytes = obstack_memory_used(&info->head->pieces);
+    fprintf(stderr, "COYAML: Limit exceeded in config file ``%s'' "
+        "at line %ld column %ld: %s is %zu, limit is %zu\n"
+        "COYAML: Counters: input-bytes: %zu, events: %zu, depth: %d, "
+        "arena-bytes: %zu, includes: %d\n",
+        info->current_file->filename, info->event.start_mark.line+1,
+        info->event.start_mark.column, name, value, limit,
+        cnt->input_bytes, cnt->events, cnt->depth,
+        cnt->arena_bytes, cnt->includes);
+}
+
+static int check_arena(coyaml_parseinfo_t *info) {
+    coyaml_context_t *ctx = info->context;
+    if(!ctx->limits.max_arena_bytes) return 0;
+    ctx->counters.arena_bytes = obstack_memory_used(&info->head->pieces);
+    LIMIT_CHECK(ctx->counters.arena_bytes, ctx->limits.max_arena_bytes,
+        "arena-bytes");
+    return 0;
+}
+
+static int count_input(coyaml_parseinfo_t *info, size_t size) {
+    coyaml_context_t *ctx = info->context;
+    ctx->counters.input_bytes += size;
+    LIMIT_CHECK(ctx->counters.input_bytes, ctx->limits.max_input_bytes,
+        "input-bytes");
+    return 0;
+}
+
 static void my_event_delete(yaml_event_t *event) {
     event->data.scalar.tag = NULL;
     yaml_event_delete(event);
@@ -117,6 +166,36 @@ static coyaml_anchor_t *find_anchor(coyaml_parseinfo_t *info, char *name) {
     return NULL;
 }
 
+void coyaml_set_basedir(coyaml_context_t *ctx, coyaml_stack_t *file) {
+    char *suffix = strrchr(file->filename, '/');
+    if(suffix) {
+        file->basedir_len = suffix - file->filename + 1;
+        file->basedir = obstack_alloc(&ctx->pieces, file->basedir_len+1);
+        strncpy(file->basedir, file->filename, file->basedir_len);
+        file->basedir[file->basedir_len] = 0;
+    } else {
+        file->basedir = "";
+        file->basedir_len = 0;
+    }
+}
+
+// Counts bytes as they are read, since stat() size is zero for pipes and
+// terminals. Stops the parser (it reports a reader error) when input is over
+// the limit, plain_next() tells that from a syntax error by the counter
+static int read_file(void *data, unsigned char *buffer, size_t size,
+    size_t *size_read) {
+    coyaml_stack_t *file = data;
+    coyaml_context_t *ctx = file->context;
+    *size_read = fread(buffer, 1, size, file->file);
+    file->size += *size_read;
+    ctx->counters.input_bytes += *size_read;
+    if(ctx->limits.max_input_bytes
+        && ctx->counters.input_bytes > ctx->limits.max_input_bytes) {
+        return 0;
+    }
+    return !ferror(file->file);
+}
+
 static coyaml_stack_t *open_file(coyaml_parseinfo_t *info, char *filename) {
     coyaml_stack_t *res = malloc(sizeof(coyaml_stack_t)+strlen(filename)+1);
     if(!res) return NULL;
@@ -126,20 +205,19 @@ static coyaml_stack_t *open_file(coyaml_parseinfo_t *info, char *filename) {
         free(res);
         return NULL;
     }
+    res->size = 0;
+    res->context = info->context;
+    res->index = coyaml_input_add(info->context, filename, COYAML_INPUT_YAML);
+    if(res->index < 0) {
+        fclose(res->file);
+        free(res);
+        return NULL;
+    }
     yaml_parser_initialize(&res->parser);
-    yaml_parser_set_input_file(&res->parser, res->file);
+    yaml_parser_set_input(&res->parser, read_file, res);
     res->filename = (char *)res + sizeof(coyaml_stack_t);
     strcpy(res->filename, filename);
-    char *suffix = strrchr(filename, '/');
-    if(suffix) {
-        res->basedir_len = suffix - filename + 1;
-        res->basedir = obstack_alloc(&info->context->pieces,res->basedir_len+1);
-        strncpy(res->basedir, filename, res->basedir_len);
-        res->basedir[res->basedir_len] = 0;
-    } else {
-        res->basedir = "";
-        res->basedir_len = 0;
-    }
+    coyaml_set_basedir(info->context, res);
     res->next = NULL;
     res->prev = NULL;
     return res;
@@ -148,7 +226,10 @@ static coyaml_stack_t *open_file(coyaml_parseinfo_t *info, char *filename) {
 static int mapping_next(coyaml_parseinfo_t *info);
 static int anchor_next(coyaml_parseinfo_t *info);
 static int alias_next(coyaml_parseinfo_t *info);
+static int count_event(coyaml_parseinfo_t *info);
 
+// Replayed events are counted here, when the anchor runs out the next
+// event is counted by `alias_next` which reads it
 static int unpack_anchor(coyaml_parseinfo_t *info) {
     memcpy(&info->event, &info->anchor_unpacking->events[info->anchor_pos],
         sizeof(info->event));
@@ -158,6 +239,7 @@ static int unpack_anchor(coyaml_parseinfo_t *info) {
         return mapping_next(info);
     } else {
         info->anchor_pos += 1;
+        CHECK(count_event(info));
         if(info->event.type == YAML_SCALAR_EVENT) {
             COYAML_DEBUG("Unpacked %s[%d] (%.*s)",
                 yaml_event_names[info->event.type], info->event.type,
@@ -179,6 +261,8 @@ static int plain_next(coyaml_parseinfo_t *info) {
         my_event_delete(&info->event);
     }
     if(!yaml_parser_parse(&info->current_file->parser, &info->event)) {
+        LIMIT_CHECK(info->context->counters.input_bytes,
+            info->context->limits.max_input_bytes, "input-bytes");
         SYNTAX_ERROR_AT(oldline, oldcol);
         return -1;
     }
@@ -216,6 +300,9 @@ static int include_next(coyaml_parseinfo_t *info) {
                     strcpy(fn + info->current_file->basedir_len,
                         (char *)info->event.data.scalar.value);
                 }
+                info->context->counters.includes += 1;
+                LIMIT_CHECK(info->context->counters.includes,
+                    info->context->limits.max_includes, "includes");
                 coyaml_stack_t *cur = open_file(info, fn);
                 VALUE_ERROR(cur, "Can't open file ``%s''", fn);
                 cur->prev = info->current_file;
@@ -239,7 +326,8 @@ static int include_next(coyaml_parseinfo_t *info) {
                 info->current_file = cur->prev;
                 info->current_file->next = NULL;
                 free(cur);
-                return plain_next(info);
+                // Next event may be an include too, e.g. in a sequence
+                return include_next(info);
             }
             break;
         default:
@@ -248,11 +336,22 @@ static int include_next(coyaml_parseinfo_t *info) {
     return 0;
 }
 
+static int count_event(coyaml_parseinfo_t *info) {
+    coyaml_context_t *ctx = info->context;
+    ctx->counters.events += 1;
+    LIMIT_CHECK(ctx->counters.events, ctx->limits.max_events, "events");
+    if(!(ctx->counters.events % ARENA_CHECK_INTERVAL)) {
+        CHECK(check_arena(info));
+    }
+    return 0;
+}
+
 static int alias_next(coyaml_parseinfo_t *info) {
     if(info->anchor_unpacking) {
         return unpack_anchor(info);
     }
     CHECK(include_next(info));
+    CHECK(count_event(info));
     if(info->event.type == YAML_ALIAS_EVENT) {
         coyaml_anchor_t *anch = find_anchor(info,
             (char *)info->event.data.alias.anchor);
@@ -338,6 +437,9 @@ static int anchor_next(coyaml_parseinfo_t *info) {
                 info->anchor_first = info->anchor_last = cur;
             }
             cur->next = NULL;
+            if(info->tape_record) {
+                coyaml_tape_record_anchor(info, cur);
+            }
         }
     }
     return 0;
@@ -456,7 +558,11 @@ static int duplicate_next(coyaml_parseinfo_t *info) {
                         COYAML_DEBUG("Skipping duplicate ``%.*s''",
                             (int)info->event.data.scalar.length,
                             info->event.data.scalar.value);
-                        CHECK(coyaml_skip(info));
+                        // Skipped events are not recorded to the tape
+                        info->tape_skipping += 1;
+                        int res = coyaml_skip(info);
+                        info->tape_skipping -= 1;
+                        CHECK(res);
                         mapping->state = 0;
                         return duplicate_next(info);
                     } else {
@@ -532,11 +638,32 @@ static int duplicate_next(coyaml_parseinfo_t *info) {
     return 0;
 }
 static int topmost_next(coyaml_parseinfo_t *info) {
+    if(info->tape) {
+        CHECK(coyaml_tape_next(info));
+        return count_event(info);
+    }
     return duplicate_next(info);
 }
 
 static int coyaml_next(coyaml_parseinfo_t *info) {
     CHECK(topmost_next(info));
+    if(info->tape_record && !info->tape_skipping) {
+        coyaml_tape_record_event(info);
+    }
+    switch(info->event.type) {
+        case YAML_MAPPING_START_EVENT:
+        case YAML_SEQUENCE_START_EVENT:
+            info->context->counters.depth += 1;
+            LIMIT_CHECK(info->context->counters.depth,
+                info->context->limits.max_depth, "depth");
+            break;
+        case YAML_MAPPING_END_EVENT:
+        case YAML_SEQUENCE_END_EVENT:
+            info->context->counters.depth -= 1;
+            break;
+        default:
+            break;
+    }
     if(info->event.type == YAML_SCALAR_EVENT) {
         COYAML_DEBUG("Event %s[%d]%s (%.*s)",
             yaml_event_names[info->event.type], info->event.type,
@@ -572,6 +699,20 @@ void *config;
 }
 
 int coyaml_readfile(coyaml_context_t *ctx) {
+    bool use_snapshot = ctx->snapshot_filename && !ctx->print_vars;
+    if(use_snapshot) {
+        if(!coyaml_snapshot_map(ctx, ctx->snapshot_filename)) {
+            if(ctx->debug) {
+                fprintf(stderr, "COYAML: Config loaded from snapshot ``%s''\n",
+                    ctx->snapshot_filename);
+            }
+            return 0;
+        }
+        if(ctx->debug) {
+            fprintf(stderr, "COYAML: Can't use snapshot ``%s'': %s\n",
+                ctx->snapshot_filename, strerror(errno));
+        }
+    }
     coyaml_parseinfo_t sinfo;
     sinfo.context = ctx;
     sinfo.debug = ctx->debug;
@@ -587,20 +728,71 @@ int coyaml_readfile(coyaml_context_t *ctx) {
     sinfo.last_mark = NULL;
     sinfo.top_mark = NULL;
     sinfo.event.type = YAML_NO_EVENT;
+    sinfo.tape = NULL;
+    sinfo.tape_record = FALSE;
+    sinfo.tape_skipping = 0;
+    sinfo.tape_count = 0;
+    sinfo.expr_table = NULL;
+    sinfo.expr_tablesize = 0;
+    sinfo.expr_count = 0;
+    sinfo.symbols = NULL;
+    sinfo.nsymbols = 0;
+    sinfo.symbols_size = 0;
+    memset(&ctx->counters, 0, sizeof(ctx->counters));
+    ctx->inputs = NULL;
     obstack_init(&sinfo.anchors);
     obstack_init(&sinfo.mappieces);
+    obstack_init(&sinfo.exprs);
 
     coyaml_parseinfo_t *info = &sinfo;
 
-    sinfo.root_file = sinfo.current_file = open_file(info, ctx->root_filename);
+    char *tapename = NULL;
+    if(ctx->event_cache) {
+        tapename = alloca(strlen(ctx->root_filename)
+            + sizeof(COYAML_TAPE_SUFFIX));
+        strcpy(tapename, ctx->root_filename);
+        strcat(tapename, COYAML_TAPE_SUFFIX);
+        if(!coyaml_tape_open(info, tapename)) {
+            COYAML_DEBUG("Replaying event tape ``%s''", tapename);
+        } else {
+            COYAML_DEBUG("Can't use event tape ``%s'': %s",
+                tapename, strerror(errno));
+            sinfo.tape_record = TRUE;
+            obstack_init(&sinfo.tape_events);
+            obstack_init(&sinfo.tape_anchors);
+        }
+    }
+
+    if(sinfo.tape) {
+        sinfo.root_file = sinfo.current_file = &sinfo.tape->files[0];
+    } else {
+        sinfo.root_file = sinfo.current_file = open_file(info,
+            ctx->root_filename);
+    }
     if(!sinfo.root_file) {
         obstack_free(&sinfo.anchors, NULL);
         obstack_free(&sinfo.mappieces, NULL);
+        coyaml_eval_free(info);
+        if(sinfo.tape_record) {
+            obstack_free(&sinfo.tape_events, NULL);
+            obstack_free(&sinfo.tape_anchors, NULL);
+        }
         return -1;
     }
 
     ctx->parseinfo = &sinfo;
-    int result = coyaml_root(info, ctx->root_group, ctx->target);
+    int result = 0;
+    if(sinfo.tape) {
+        for(size_t i = 0; i < sinfo.tape->nfiles && !result; ++i) {
+            result = count_input(info, sinfo.tape->files[i].size);
+        }
+    }
+    if(!result) {
+        result = coyaml_root(info, ctx->root_group, ctx->target);
+    }
+    if(!result) {
+        result = check_arena(info);
+    }
     if(ctx->print_vars) {
         coyaml_print_variables(ctx);
     }
@@ -613,28 +805,58 @@ int coyaml_readfile(coyaml_context_t *ctx) {
         }
     }
 
-    for(coyaml_anchor_t *a = sinfo.anchor_first; a; a = a->next) {
-        for(yaml_event_t *ev = a->events; ev->type != YAML_NO_EVENT; ++ev) {
-            my_event_delete(ev);
+    if(sinfo.tape_record) {
+        if(!result && coyaml_tape_write(info, tapename) < 0) {
+            COYAML_DEBUG("Can't write event tape ``%s'': %s",
+                tapename, strerror(errno));
+        }
+        obstack_free(&sinfo.tape_events, NULL);
+        obstack_free(&sinfo.tape_anchors, NULL);
+    }
+
+    if(sinfo.tape) {
+        // Anchors and files point into the tape
+        coyaml_tape_close(info);
+    } else {
+        for(coyaml_anchor_t *a = sinfo.anchor_first; a; a = a->next) {
+            for(yaml_event_t *ev = a->events; ev->type != YAML_NO_EVENT; ++ev) {
+                my_event_delete(ev);
+            }
+        }
+        for(coyaml_stack_t *t = info->current_file, *n; t; t = n) {
+            yaml_parser_delete(&t->parser);
+            fclose(t->file);
+            n = t->prev;
+            free(t);
         }
     }
     obstack_free(&sinfo.anchors, NULL);
     obstack_free(&sinfo.mappieces, NULL);
+    coyaml_eval_free(info);
 
-    for(coyaml_stack_t *t = info->current_file, *n; t; t = n) {
-        yaml_parser_delete(&t->parser);
-        fclose(t->file);
-        n = t->prev;
-        free(t);
-    }
     COYAML_DEBUG("Done %s", result ? "ERROR" : "OK");
+    if(!result && use_snapshot) {
+        if(coyaml_snapshot_write(ctx, ctx->snapshot_filename) < 0) {
+            COYAML_DEBUG("Can't write snapshot ``%s'': %s",
+                ctx->snapshot_filename, strerror(errno));
+        }
+    }
     return result;
 }
 
-int coyaml_group(coyaml_parseinfo_t *info, coyaml_group_t *def, void *target) {
-    COYAML_DEBUG("Entering Group");
+int coyaml_event_next(coyaml_parseinfo_t *info) {
+    return coyaml_next(info);
+}
+
+int coyaml_group_start(coyaml_parseinfo_t *info) {
     SYNTAX_ERROR(info->event.type == YAML_MAPPING_START_EVENT);
     CHECK(coyaml_next(info));
+    return 0;
+}
+
+// Returns 1 if current event is a key, value is the next event. Returns 0
+// and skips the end of mapping when there are no more keys
+int coyaml_group_key(coyaml_parseinfo_t *info, const char **key, size_t *len) {
     while(info->event.type == YAML_SCALAR_EVENT) {
         if(info->event.data.scalar.value[0] == '_') {
             // Hidden keys, user's can use that for their own reusable anchors
@@ -642,55 +864,119 @@ int coyaml_group(coyaml_parseinfo_t *info, coyaml_group_t *def, void *target) {
             CHECK(coyaml_next(info));
             continue;
         }
-        coyaml_transition_t *tran;
-        char *key = (char *)info->event.data.scalar.value;
-        if(!strcmp(key, "=")) {
-            key = "value";
+        *key = (char *)info->event.data.scalar.value;
+        *len = info->event.data.scalar.length;
+        if(!strcmp(*key, "=")) {
+            *key = "value";
+            *len = strlen("value");
+        }
+        return 1;
+    }
+    SYNTAX_ERROR(info->event.type == YAML_MAPPING_END_EVENT);
+    CHECK(coyaml_next(info));
+    return 0;
+}
+
+int coyaml_group_unknown(coyaml_parseinfo_t *info, coyaml_group_t *def) {
+    if(info->debug) {
+        COYAML_DEBUG("Expected keys:");
+        for(coyaml_transition_t *tran = def->transitions;
+            tran && tran->symbol; ++tran) {
+            COYAML_DEBUG("    %s", tran->symbol);
         }
+    }
+    SYNTAX_ERROR2("Unexpected key ``%s''", info->event.data.scalar.value);
+}
+
+int coyaml_group(coyaml_parseinfo_t *info, coyaml_group_t *def, void *target) {
+    if(def->parser && !info->debug && !info->context->table_driven) {
+        // Debugging output is only written by tables
+        return def->parser(info, def, target);
+    }
+    COYAML_DEBUG("Entering Group");
+    CHECK(coyaml_group_start(info));
+    const char *key;
+    size_t len;
+    int res;
+    while((res = coyaml_group_key(info, &key, &len)) > 0) {
+        coyaml_transition_t *tran;
         for(tran = def->transitions;
             tran && tran->symbol; ++tran) {
             if(!strcmp(tran->symbol, key)) {
                 break;
             }
         }
-        if(tran && tran->symbol) {
-            COYAML_DEBUG("Matched key ``%s''", tran->symbol);
-            CHECK(coyaml_next(info));
-            CHECK(tran->prop->type->yaml_parse(info, tran->prop, target));
-        } else {
-            if(info->debug) {
-                COYAML_DEBUG("Expected keys:");
-                for(coyaml_transition_t *tran = def->transitions;
-                    tran && tran->symbol; ++tran) {
-                    COYAML_DEBUG("    %s", tran->symbol);
-                }
-            }
-            SYNTAX_ERROR2("Unexpected key ``%s''",
-                info->event.data.scalar.value);
+        if(!tran || !tran->symbol) {
+            return coyaml_group_unknown(info, def);
         }
+        COYAML_DEBUG("Matched key ``%s''", tran->symbol);
+        CHECK(coyaml_next(info));
+        CHECK(tran->prop->type->yaml_parse(info, tran->prop, target));
     }
-    SYNTAX_ERROR(info->event.type == YAML_MAPPING_END_EVENT);
-    CHECK(coyaml_next(info));
+    CHECK(res);
     COYAML_DEBUG("Leaving Group");
     return 0;
 }
 
-int coyaml_int(coyaml_parseinfo_t *info, coyaml_int_t *def, void *target) {
-    COYAML_DEBUG("Entering Int");
-    SETFLAG(info, def);
+int coyaml_scalar_int(coyaml_parseinfo_t *info, long *val) {
     SYNTAX_ERROR(info->event.type == YAML_SCALAR_EVENT);
-
-    long val = 0;
+    *val = 0;
     if(coyaml_eval_int(info, (char *)info->event.data.scalar.value,
-        info->event.data.scalar.length, &val)) {
+        info->event.data.scalar.length, val)) {
         SYNTAX_ERROR(0);
     }
+    return 0;
+}
+
+int coyaml_scalar_float(coyaml_parseinfo_t *info, double *val) {
+    SYNTAX_ERROR(info->event.type == YAML_SCALAR_EVENT);
+    if(coyaml_eval_float(info, (char *)info->event.data.scalar.value,
+        info->event.data.scalar.length, val)) {
+        SYNTAX_ERROR(0);
+    }
+    return 0;
+}
+
+int coyaml_scalar_bool(coyaml_parseinfo_t *info, int *val) {
+    SYNTAX_ERROR(info->event.type == YAML_SCALAR_EVENT);
+    char *value = (char *)info->event.data.scalar.value;
+    *val = coyaml_parse_bool(value, info->event.data.scalar.length);
+    VALUE_ERROR(*val >= 0, "Option value ``%s'' is not boolean", value);
+    return 0;
+}
+
+int coyaml_value_error(coyaml_parseinfo_t *info, const char *format, ...) {
+    va_list args;
+    fprintf(stderr, "COYAML: Error at %s:%ld[%ld]: ",
+        info->current_file->filename, info->event.start_mark.line+1,
+        info->event.start_mark.column);
+    va_start(args, format);
+    vfprintf(stderr, format, args);
+    va_end(args);
+    fputc('\n', stderr);
+    errno = ECOYAML_VALUE_ERROR;
+    return -1;
+}
+
+int coyaml_mark_filled(coyaml_parseinfo_t *info, int flag) {
+    if(info->top_mark) {
+        COYAML_ASSERT(!info->top_mark->filled[flag]);
+        info->top_mark->filled[flag] = 1;
+    }
+    return 0;
+}
+
+int coyaml_int(coyaml_parseinfo_t *info, coyaml_int_t *def, void *target) {
+    COYAML_DEBUG("Entering Int");
+    SETFLAG(info, def);
+    long val;
+    CHECK(coyaml_scalar_int(info, &val));
 
     VALUE_ERROR(!(def->bitmask&2) || val <= def->max,
-        "Value must be less than or equal to %d", def->max);
+        "Value must be less than or equal to %ld", def->max);
     VALUE_ERROR(!(def->bitmask&1) || val >= def->min,
-        "Value must be greater than or equal to %d", def->min);
-    *(long *)(((char *)target)+def->baseoffset) = val;
+        "Value must be greater than or equal to %ld", def->min);
+    coyaml_int_set(def, target, val);
     CHECK(coyaml_next(info));
     COYAML_DEBUG("Leaving Int");
     return 0;
@@ -699,13 +985,8 @@ int coyaml_int(coyaml_parseinfo_t *info, coyaml_int_t *def, void *target) {
 int coyaml_float(coyaml_parseinfo_t *info, coyaml_float_t *def, void *target) {
     COYAML_DEBUG("Entering Float");
     SETFLAG(info, def);
-    SYNTAX_ERROR(info->event.type == YAML_SCALAR_EVENT);
-
     double val;
-    if(coyaml_eval_float(info, (char *)info->event.data.scalar.value,
-        info->event.data.scalar.length, &val)) {
-        SYNTAX_ERROR(0);
-    }
+    CHECK(coyaml_scalar_float(info, &val));
 
     VALUE_ERROR(!(def->bitmask&2) || val <= def->max,
         "Value must be less than or equal to %lf", def->max);
@@ -720,25 +1001,9 @@ int coyaml_float(coyaml_parseinfo_t *info, coyaml_float_t *def, void *target) {
 int coyaml_bool(coyaml_parseinfo_t *info, coyaml_bool_t *def, void *target) {
     COYAML_DEBUG("Entering Bool");
     SETFLAG(info, def);
-    SYNTAX_ERROR(info->event.type == YAML_SCALAR_EVENT);
-    char *value = (char *)info->event.data.scalar.value;
-    if(
-        !strcasecmp(value, "true")
-        || !strcasecmp(value, "y")
-        || !strcasecmp(value, "yes")
-        || !strcasecmp(value, "on")
-        ) {
-        *(bool *)(((char *)target)+def->baseoffset) = TRUE;
-    } else if(
-        !strcasecmp(value, "false")
-        || !strcasecmp(value, "n")
-        || !strcasecmp(value, "no")
-        || !strcasecmp(value, "off")
-        ) {
-        *(bool *)(((char *)target)+def->baseoffset) = FALSE;
-    } else {
-        VALUE_ERROR(FALSE, "Option value ``%s'' is not boolean", value);
-    }
+    int val;
+    CHECK(coyaml_scalar_bool(info, &val));
+    coyaml_bool_set(def, target, val);
     CHECK(coyaml_next(info));
     COYAML_DEBUG("Leaving Bool");
     return 0;
@@ -747,25 +1012,173 @@ int coyaml_bool(coyaml_parseinfo_t *info, coyaml_bool_t *def, void *target) {
 int coyaml_uint(coyaml_parseinfo_t *info, coyaml_uint_t *def, void *target) {
     COYAML_DEBUG("Entering UInt");
     SETFLAG(info, def);
-    SYNTAX_ERROR(info->event.type == YAML_SCALAR_EVENT);
-    long tval = 0;
-    if(coyaml_eval_int(info, (char *)info->event.data.scalar.value,
-        info->event.data.scalar.length, &tval)) {
-        SYNTAX_ERROR(0);
-    }
+    long tval;
+    CHECK(coyaml_scalar_int(info, &tval));
     unsigned long val = (unsigned long) tval;
     VALUE_ERROR(!(def->bitmask&2) || val <= def->max,
-        "Value must be less than or equal to %d", def->max);
+        "Value must be less than or equal to %lu", def->max);
     VALUE_ERROR(!(def->bitmask&1) || val >= def->min,
-        "Value must be greater than or equal to %d", def->min);
+        "Value must be greater than or equal to %lu", def->min);
     VALUE_ERROR(tval >= 0,
         "Value must be greater or equal to zero");
-    *(unsigned long *)(((char *)target)+def->baseoffset) = val;
+    coyaml_uint_set(def, target, val);
     CHECK(coyaml_next(info));
     COYAML_DEBUG("Leaving UInt");
     return 0;
 }
 
+static int choice_scalar(coyaml_parseinfo_t *info, coyaml_choice_t *def,
+    int *val) {
+    SYNTAX_ERROR(info->event.type == YAML_SCALAR_EVENT);
+    *val = coyaml_choice_find(def, (char *)info->event.data.scalar.value,
+        info->event.data.scalar.length);
+    VALUE_ERROR(*val >= 0, "Unknown choice ``%s''",
+        info->event.data.scalar.value);
+    return 0;
+}
+
+int coyaml_choice(coyaml_parseinfo_t *info, coyaml_choice_t *def,
+    void *target) {
+    COYAML_DEBUG("Entering Choice");
+    SETFLAG(info, def);
+    int val;
+    CHECK(choice_scalar(info, def, &val));
+    *(int *)((char *)target + def->baseoffset) = val;
+    CHECK(coyaml_next(info));
+    COYAML_DEBUG("Leaving Choice");
+    return 0;
+}
+
+int coyaml_flags(coyaml_parseinfo_t *info, coyaml_flags_t *def,
+    void *target) {
+    COYAML_DEBUG("Entering Flags");
+    SETFLAG(info, def);
+    SYNTAX_ERROR(info->event.type == YAML_SEQUENCE_START_EVENT);
+    CHECK(coyaml_next(info));
+    uint32_t mask = 0;
+    while(info->event.type != YAML_SEQUENCE_END_EVENT) {
+        int val;
+        CHECK(choice_scalar(info, def, &val));
+        mask |= 1u << val;
+        CHECK(coyaml_next(info));
+    }
+    *(uint32_t *)((char *)target + def->baseoffset) = mask;
+    CHECK(coyaml_next(info));
+    COYAML_DEBUG("Leaving Flags");
+    return 0;
+}
+
+int coyaml_regex(coyaml_parseinfo_t *info, coyaml_regex_t *def,
+    void *target) {
+    COYAML_DEBUG("Entering Regex");
+    SETFLAG(info, def);
+    SYNTAX_ERROR(info->event.type == YAML_SCALAR_EVENT);
+    // Variables are not substituted, as `$` is an anchor in the pattern
+    *(char **)(((char *)target)+def->baseoffset) = obstack_copy0(
+        &info->head->pieces,
+        info->event.data.scalar.value, info->event.data.scalar.length);
+    *(size_t *)(((char *)target)+def->baseoffset+sizeof(char*)) =
+        info->event.data.scalar.length;
+    CHECK(check_arena(info));
+    char err[256];
+    VALUE_ERROR(!coyaml_regex_compile(info->head, def, target,
+        err, sizeof(err)), "Bad regular expression ``%s'': %s",
+        info->event.data.scalar.value, err);
+    CHECK(coyaml_next(info));
+    COYAML_DEBUG("Leaving Regex");
+    return 0;
+}
+
+int coyaml_address(coyaml_parseinfo_t *info, coyaml_address_t *def,
+    void *target) {
+    COYAML_DEBUG("Entering Address");
+    SETFLAG(info, def);
+    SYNTAX_ERROR(info->event.type == YAML_SCALAR_EVENT);
+    const char *err = coyaml_sockaddr_parse(
+        (coyaml_sockaddr_t *)((char *)target + def->baseoffset),
+        (char *)info->event.data.scalar.value,
+        info->event.data.scalar.length, def->default_port);
+    VALUE_ERROR(!err, "%s in ``%s''", err, info->event.data.scalar.value);
+    CHECK(coyaml_next(info));
+    COYAML_DEBUG("Leaving Address");
+    return 0;
+}
+
+int coyaml_cidr(coyaml_parseinfo_t *info, coyaml_cidr_t *def,
+    void *target) {
+    COYAML_DEBUG("Entering CIDR");
+    SETFLAG(info, def);
+    SYNTAX_ERROR(info->event.type == YAML_SCALAR_EVENT);
+    const char *err = coyaml_network_parse(
+        (coyaml_network_t *)((char *)target + def->baseoffset),
+        (char *)info->event.data.scalar.value,
+        info->event.data.scalar.length);
+    VALUE_ERROR(!err, "%s in ``%s''", err, info->event.data.scalar.value);
+    CHECK(coyaml_next(info));
+    COYAML_DEBUG("Leaving CIDR");
+    return 0;
+}
+
+int coyaml_format(coyaml_parseinfo_t *info, coyaml_format_t *def,
+    void *target) {
+    COYAML_DEBUG("Entering Format");
+    SETFLAG(info, def);
+    SYNTAX_ERROR(info->event.type == YAML_SCALAR_EVENT);
+    char *data = (char *)info->event.data.scalar.value;
+    int dlen = info->event.data.scalar.length;
+    if(coyaml_eval_str(info, data, dlen, &data, &dlen)) {
+        SYNTAX_ERROR(0);
+    }
+    *(char **)(((char *)target)+def->baseoffset) = data;
+    *(size_t *)(((char *)target)+def->baseoffset+sizeof(char*)) = dlen;
+    char err[256];
+    VALUE_ERROR(!coyaml_format_compile(info->head, def, target,
+        err, sizeof(err)), "%s in format ``%s''", err, data);
+    CHECK(check_arena(info));
+    CHECK(coyaml_next(info));
+    COYAML_DEBUG("Leaving Format");
+    return 0;
+}
+
+static int stringset_items(coyaml_parseinfo_t *info, coyaml_stringset_t *def,
+    void *target, coyaml_hashbuild_t *build) {
+    while(info->event.type != YAML_SEQUENCE_END_EVENT) {
+        SYNTAX_ERROR(info->event.type == YAML_SCALAR_EVENT);
+        char *data = (char *)info->event.data.scalar.value;
+        int dlen = info->event.data.scalar.length;
+        if(coyaml_eval_str(info, data, dlen, &data, &dlen)) {
+            SYNTAX_ERROR(0);
+        }
+        VALUE_ERROR(!coyaml_hashbuild_add(build, data, dlen),
+            "Duplicate ``%s'' in the set", data);
+        CHECK(coyaml_next(info));
+    }
+    CHECK(check_arena(info));
+    VALUE_ERROR(!coyaml_hashset_build(info->head, build,
+        (coyaml_hashset_t *)((char *)target + def->baseoffset)),
+        "Can't build hash of the set");
+    return 0;
+}
+
+int coyaml_stringset(coyaml_parseinfo_t *info, coyaml_stringset_t *def,
+    void *target) {
+    COYAML_DEBUG("Entering StringSet");
+    SETFLAG(info, def);
+    SYNTAX_ERROR(info->event.type == YAML_SEQUENCE_START_EVENT);
+    CHECK(coyaml_next(info));
+    // Scratch memory of the build is released on errors too
+    struct obstack tmp;
+    coyaml_hashbuild_t build;
+    obstack_init(&tmp);
+    coyaml_hashbuild_init(&build, &tmp);
+    int rc = stringset_items(info, def, target, &build);
+    obstack_free(&tmp, NULL);
+    CHECK(rc);
+    CHECK(coyaml_next(info));
+    COYAML_DEBUG("Leaving StringSet");
+    return 0;
+}
+
 int coyaml_file(coyaml_parseinfo_t *info, coyaml_file_t *def, void *target) {
     COYAML_DEBUG("Entering File");
     SETFLAG(info, def);
@@ -817,19 +1230,44 @@ int coyaml_string(coyaml_parseinfo_t *info, coyaml_string_t *def, void *target)
             VALUE_ERROR(file >= 0, "Can't open file ``%s''", fn);
             struct stat finfo;
             VALUE_ERROR(!fstat(file, &finfo), "Can't stat ``%s''", fn);
-            void *body = *(char **)(((char *)target)+def->baseoffset) \
-                = obstack_alloc(&info->head->pieces, finfo.st_size);
-            *(int *)(((char *)target)+def->baseoffset+sizeof(char*)) \
-                = finfo.st_size;
-            VALUE_ERROR(read(file, body, finfo.st_size) == finfo.st_size,
-                "Couldn't read file ``%s''", fn);
+            VALUE_ERROR(coyaml_input_add(info->context, fn, COYAML_INPUT_RAW) >= 0,
+                "Can't stat ``%s''", fn);
+            char *body;
+            size_t len;
+            if(S_ISREG(finfo.st_mode)) {
+                if(count_input(info, finfo.st_size) < 0) {
+                    close(file);
+                    return -1;
+                }
+                len = finfo.st_size;
+                body = obstack_alloc(&info->head->pieces, len);
+                VALUE_ERROR(read(file, body, len) == (ssize_t)len,
+                    "Couldn't read file ``%s''", fn);
+            } else {
+                // Size of a pipe is unknown until it's read to the end
+                char buf[4096];
+                ssize_t n;
+                while((n = read(file, buf, sizeof(buf))) > 0) {
+                    obstack_grow(&info->head->pieces, buf, n);
+                    if(count_input(info, n) < 0) {
+                        obstack_free(&info->head->pieces,
+                            obstack_finish(&info->head->pieces));
+                        close(file);
+                        return -1;
+                    }
+                }
+                len = obstack_object_size(&info->head->pieces);
+                body = obstack_finish(&info->head->pieces);
+                VALUE_ERROR(n == 0, "Couldn't read file ``%s''", fn);
+            }
             close(file);
+            coyaml_string_set(def, target, body, len);
+            CHECK(check_arena(info));
         } else if(!strcmp(tag, "!Raw")) {
-            *(char **)(((char *)target)+def->baseoffset) = obstack_copy0(
+            coyaml_string_set(def, target, obstack_copy0(
                 &info->head->pieces, info->event.data.scalar.value,
+                info->event.data.scalar.length),
                 info->event.data.scalar.length);
-            *(int *)(((char *)target)+def->baseoffset+sizeof(char*)) \
-                = info->event.data.scalar.length;
         } else {
             VALUE_ERROR(TRUE, "Unknown tag ``%s''", tag);
         }
@@ -839,8 +1277,7 @@ int coyaml_string(coyaml_parseinfo_t *info, coyaml_string_t *def, void *target)
         if(coyaml_eval_str(info, data, dlen, &data, &dlen)) {
             SYNTAX_ERROR(0);
         }
-        *(char **)(((char *)target)+def->baseoffset) = data;
-        *(int *)(((char *)target)+def->baseoffset+sizeof(char*)) = dlen;
+        coyaml_string_set(def, target, data, dlen);
     }
     CHECK(coyaml_next(info));
     COYAML_DEBUG("Leaving String");
@@ -921,12 +1358,10 @@ int coyaml_mapping(coyaml_parseinfo_t *info, coyaml_mapping_t *def, void *target
     while(info->event.type != YAML_MAPPING_END_EVENT) {
         coyaml_mappingel_head_t *newel = obstack_alloc(&info->head->pieces,
             def->element_size);
-        bzero(newel, def->element_size);
-        if(def->key_defaults) {
-            def->key_defaults((char *)newel + def->key_prop->baseoffset);
-        }
-        if(def->value_defaults) {
-            def->value_defaults((char *)newel + def->value_prop->baseoffset);
+        if(def->element_default) {
+            memcpy(newel, def->element_default, def->element_size);
+        } else {
+            bzero(newel, def->element_size);
         }
         CHECK(def->key_prop->type->yaml_parse(info, def->key_prop, newel));
         CHECK(def->value_prop->type->yaml_parse(info, def->value_prop, newel));
@@ -939,12 +1374,169 @@ int coyaml_mapping(coyaml_parseinfo_t *info, coyaml_mapping_t *def, void *target
         lastel = newel;
     }
     *(size_t*)((char *)target+def->baseoffset+sizeof(void *)) = nelements;
+    CHECK(coyaml_mapping_index(&info->head->pieces, def, target));
     SYNTAX_ERROR(info->event.type == YAML_MAPPING_END_EVENT);
     CHECK(coyaml_next(info));
     COYAML_DEBUG("Leaving Mapping");
     return 0;
 }
 
+static void array_element_init(coyaml_array_t *def, void *el) {
+    if(def->element_default) {
+        memcpy(el, def->element_default, def->element_size);
+    } else {
+        bzero(el, def->element_size);
+    }
+}
+
+// Start marks of the elements, only kept for arrays having indexes, to
+// report where the duplicate is
+typedef struct array_marks_s {
+    yaml_mark_t *marks;
+    size_t alloc;
+} array_marks_t;
+
+static int array_mark(coyaml_parseinfo_t *info, coyaml_array_t *def,
+    array_marks_t *marks, size_t index) {
+    if(!def->indexes) return 0;
+    if(index >= marks->alloc) {
+        size_t nalloc = marks->alloc ? marks->alloc*2 : 16;
+        yaml_mark_t *nmarks = realloc(marks->marks,
+            nalloc*sizeof(yaml_mark_t));
+        if(!nmarks) return -1;
+        marks->marks = nmarks;
+        marks->alloc = nalloc;
+    }
+    marks->marks[index] = info->event.start_mark;
+    return 0;
+}
+
+static int array_list(coyaml_parseinfo_t *info, coyaml_array_t *def,
+    void *target, array_marks_t *marks) {
+    coyaml_arrayel_head_t *lastel = NULL;
+    size_t nelements = 0;
+    while(info->event.type != YAML_SEQUENCE_END_EVENT) {
+        CHECK(array_mark(info, def, marks, nelements));
+        coyaml_arrayel_head_t *newel = obstack_alloc(&info->head->pieces,
+            def->element_size);
+        array_element_init(def, newel);
+        CHECK(def->element_prop->type->yaml_parse(info,
+            def->element_prop, newel));
+        nelements += 1;
+        if(!lastel) {
+            *(void **)((char *)target+def->baseoffset) = newel;
+        } else {
+            lastel->next = newel;
+        }
+        lastel = newel;
+    }
+    *(size_t*)((char *)target+def->baseoffset+sizeof(void *)) = nelements;
+    return 0;
+}
+
+// Inheritance marks keep addresses of the objects, the ones made for
+// elements (and members of elements) since `stop` are moved with them
+static void move_marks(coyaml_parseinfo_t *info, coyaml_marks_t *stop,
+    uintptr_t from, size_t size, char *to) {
+    for(coyaml_marks_t *m = info->last_mark; m != stop; m = m->prev) {
+        uintptr_t off = (uintptr_t)m->object - from;
+        if(off < size) {
+            m->object = to + off;
+        }
+    }
+}
+
+// Elements are parsed into a scratch buffer which is grown as needed, and
+// are copied into the config when size is known
+static int array_vector(coyaml_parseinfo_t *info, coyaml_array_t *def,
+    void *target, array_marks_t *marks) {
+    char *buf = NULL;
+    size_t alloc = 0;
+    size_t nelements = 0;
+    coyaml_marks_t *stop = info->last_mark;
+    while(info->event.type != YAML_SEQUENCE_END_EVENT) {
+        if(nelements >= alloc) {
+            size_t nalloc = alloc ? alloc*2 : 8;
+            uintptr_t old = (uintptr_t)buf;
+            char *nbuf = realloc(buf, nalloc*def->element_size);
+            if(!nbuf) {
+                free(buf);
+                return -1;
+            }
+            move_marks(info, stop, old, nelements*def->element_size, nbuf);
+            buf = nbuf;
+            alloc = nalloc;
+        }
+        char *newel = buf + nelements*def->element_size;
+        array_element_init(def, newel);
+        if(array_mark(info, def, marks, nelements) < 0
+            || def->element_prop->type->yaml_parse(info,
+            def->element_prop, newel) < 0) {
+            free(buf);
+            return -1;
+        }
+        nelements += 1;
+    }
+    char *vec = NULL;
+    if(nelements) {
+        vec = obstack_copy(&info->head->pieces, buf,
+            nelements*def->element_size);
+        move_marks(info, stop, (uintptr_t)buf, nelements*def->element_size,
+            vec);
+    }
+    free(buf);
+    // Linked too, so that code walking the list works for any array
+    for(size_t i = 0; i < nelements; ++i) {
+        ((coyaml_arrayel_head_t *)(vec + i*def->element_size))->next =
+            i+1 < nelements ? vec + (i+1)*def->element_size : NULL;
+    }
+    *(void **)((char *)target+def->baseoffset) = vec;
+    *(size_t*)((char *)target+def->baseoffset+sizeof(void *)) = nelements;
+    return 0;
+}
+
+static int array_inline(coyaml_parseinfo_t *info, coyaml_array_t *def,
+    void *target) {
+    char *vec = (char *)target + def->baseoffset;
+    size_t nelements = 0;
+    while(info->event.type != YAML_SEQUENCE_END_EVENT) {
+        VALUE_ERROR(nelements < def->capacity,
+            "Array can't contain more than %lu elements",
+            (unsigned long)def->capacity);
+        char *newel = vec + nelements*def->element_size;
+        array_element_init(def, newel);
+        CHECK(def->element_prop->type->yaml_parse(info,
+            def->element_prop, newel));
+        nelements += 1;
+    }
+    *(size_t*)(vec + def->capacity*def->element_size) = nelements;
+    return 0;
+}
+
+static int array_index(coyaml_parseinfo_t *info, coyaml_array_t *def,
+    void *target, array_marks_t *marks) {
+    coyaml_index_dup_t dup;
+    if(coyaml_array_index(&info->head->pieces, def, target, &dup) < 0) {
+        if(errno != ECOYAML_VALUE_ERROR) return -1;
+        yaml_mark_t *mark = &marks->marks[dup.position];
+        char *key = (char *)dup.element + dup.index->keyoffset;
+        if(dup.index->keytype == COYAML_STRING) {
+            fprintf(stderr, "COYAML: Error at %s:%ld[%ld]: "
+                "Duplicate %s ``%.*s''\n",
+                info->current_file->filename, mark->line+1, mark->column,
+                dup.index->name, *(int *)(key + sizeof(char *)),
+                *(char **)key);
+        } else {
+            fprintf(stderr, "COYAML: Error at %s:%ld[%ld]: "
+                "Duplicate %s %ld\n",
+                info->current_file->filename, mark->line+1, mark->column,
+                dup.index->name, *(long *)key);
+        }
+        return -1;
+    }
+    return 0;
+}
+
 int coyaml_array(coyaml_parseinfo_t *info, coyaml_array_t *def, void *target) {
     COYAML_DEBUG("Entering Array");
     if(def->inheritance == COYAML_INH_REPLACE_DEFAULT) {
@@ -962,26 +1554,27 @@ int coyaml_array(coyaml_parseinfo_t *info, coyaml_array_t *def, void *target) {
     }
     SYNTAX_ERROR(info->event.type == YAML_SEQUENCE_START_EVENT);
     CHECK(coyaml_next(info));
-    coyaml_arrayel_head_t *lastel = NULL;
-    size_t nelements = 0;
-    while(info->event.type != YAML_SEQUENCE_END_EVENT) {
-        coyaml_arrayel_head_t *newel = obstack_alloc(&info->head->pieces,
-            def->element_size);
-        bzero(newel, def->element_size);
-        if(def->element_defaults) {
-            def->element_defaults((char *)newel + def->element_prop->baseoffset);
-        }
-        CHECK(def->element_prop->type->yaml_parse(info,
-            def->element_prop, newel));
-        nelements += 1;
-        if(!lastel) {
-            *(void **)((char *)target+def->baseoffset) = newel;
+    if(def->capacity) {
+        CHECK(array_inline(info, def, target));
+    } else {
+        array_marks_t marks = {NULL, 0};
+        int rc;
+        if(def->contiguous) {
+            rc = array_vector(info, def, target, &marks);
         } else {
-            lastel->next = newel;
+            rc = array_list(info, def, target, &marks);
         }
-        lastel = newel;
+        if(!rc) {
+            rc = array_index(info, def, target, &marks);
+        }
+        free(marks.marks);
+        CHECK(rc);
     }
-    *(size_t*)((char *)target+def->baseoffset+sizeof(void *)) = nelements;
+    CHECK(coyaml_array_columns(&info->head->pieces, def, target));
+    char err[256];
+    VALUE_ERROR(!coyaml_regexset_build(info->head, def, target,
+        err, sizeof(err)), "Can't combine regular expressions: %s", err);
+    CHECK(coyaml_cidrset_build(info->head, def, target));
     SYNTAX_ERROR(info->event.type == YAML_SEQUENCE_END_EVENT);
     CHECK(coyaml_next(info));
     COYAML_DEBUG("Leaving Array");
@@ -1036,9 +1629,8 @@ int coyaml_tagged_scalar(coyaml_parseinfo_t *info, char *value,
     if(info) {
         tr->prop->type->yaml_parse(info, tr->prop, target);
     } else {
-        *(char **)(((char *)target)+tr->prop->baseoffset) = value; //Dirty hack
-        *(int *)(((char *)target)+tr->prop->baseoffset+sizeof(char*)) =
-            strlen(value);
+        coyaml_string_set((coyaml_string_t *)tr->prop, target,
+            value, strlen(value)); //Dirty hack
     }
     COYAML_DEBUG("Leaving Tagged Scalar");
     return 0;
@@ -1073,6 +1665,14 @@ void coyaml_context_free(coyaml_context_t *ctx) {
 }
 
 void coyaml_config_free(void *ptr) {
+    for(coyaml_cleanup_t *item = ((coyaml_head_t *)ptr)->cleanup;
+        item; item = item->next) {
+        item->fun(item->data);
+    }
+    if(((coyaml_head_t *)ptr)->snapshot) {
+        munmap(((coyaml_head_t *)ptr)->snapshot,
+            ((coyaml_head_t *)ptr)->snapshot_size);
+    }
     obstack_free(&((coyaml_head_t *)ptr)->pieces, NULL);
     if(((coyaml_head_t *)ptr)->free_object) {
         free(ptr);
@@ -10,7 +10,10 @@ typedef struct coyaml_stack_s {
     char *filename;
     char *basedir;
     int basedir_len;
+    int index;
     FILE *file;
+    size_t size;
+    struct coyaml_context_s *context;
     yaml_parser_t parser;
 } coyaml_stack_t;
 
@@ -42,8 +45,8 @@ typedef struct coyaml_marks_s {
     char filled[];
 } coyaml_marks_t;
 
-int coyaml_group(coyaml_parseinfo_t *info,
-    coyaml_group_t *prop, void *target);
+void coyaml_set_basedir(coyaml_context_t *ctx, coyaml_stack_t *file);
+
 int coyaml_int(coyaml_parseinfo_t *info,
     coyaml_int_t *prop, void *target);
 int coyaml_uint(coyaml_parseinfo_t *info,
@@ -52,18 +55,6 @@ int coyaml_bool(coyaml_parseinfo_t *info,
     coyaml_bool_t *prop, void *target);
 int coyaml_float(coyaml_parseinfo_t *info,
     coyaml_float_t *prop, void *target);
-int coyaml_array(coyaml_parseinfo_t *info,
-    coyaml_array_t *prop, void *target);
-int coyaml_mapping(coyaml_parseinfo_t *info,
-    coyaml_mapping_t *prop, void *target);
-int coyaml_file(coyaml_parseinfo_t *info,
-    coyaml_file_t *prop, void *target);
-int coyaml_dir(coyaml_parseinfo_t *info,
-    coyaml_dir_t *prop, void *target);
-int coyaml_string(coyaml_parseinfo_t *info,
-    coyaml_string_t *prop, void *target);
-int coyaml_custom(coyaml_parseinfo_t *info,
-    coyaml_custom_t *prop, void *target);
 int coyaml_usertype(coyaml_parseinfo_t *info,
     coyaml_usertype_t *prop, void *target);
 
@@ -0,0 +1,63 @@
+#include <string.h>
+#include <errno.h>
+
+#include <coyaml_src.h>
+#include "fingerprint.h"
+#include "util.h"
+
+coyaml_path_t *coyaml_path_find(coyaml_pathindex_t *idx,
+    const char *path, size_t len)
+{
+    size_t mask = idx->nslots - 1;
+    size_t i = coyaml_hash(COYAML_HASH_INIT, path, len) & mask;
+    for(;; i = (i + 1) & mask) {
+        int pos = idx->slots[i];
+        if(!pos)
+            return NULL;
+        coyaml_path_t *p = &idx->paths[pos-1];
+        if(p->path_len == len && !memcmp(p->path, path, len))
+            return p;
+    }
+}
+
+static coyaml_path_t *find(coyaml_pathindex_t *idx, const char *path) {
+    coyaml_path_t *p = coyaml_path_find(idx, path, strlen(path));
+    if(!p) {
+        errno = ENOENT;
+    }
+    return p;
+}
+
+// Returns address of the member, for packed booleans it's the word which
+// has the bit
+void *coyaml_get(coyaml_pathindex_t *idx, void *cfg, const char *path) {
+    coyaml_path_t *p = find(idx, path);
+    if(!p)
+        return NULL;
+    return (char *)cfg + p->offset + p->prop->baseoffset;
+}
+
+// Converts value the same way as command-line option does, the `prop` of
+// values having `set` is relative to the root
+int coyaml_set(coyaml_pathindex_t *idx, void *cfg, const char *path,
+    char *value)
+{
+    coyaml_path_t *p = find(idx, path);
+    if(!p)
+        return -1;
+    if(!p->set) {
+        errno = EINVAL;
+        return -1;
+    }
+    COYAML_ASSERT(!p->offset);
+    return p->set(value, p->prop, cfg);
+}
+
+int coyaml_print_path(FILE *output, coyaml_pathindex_t *idx, void *cfg,
+    const char *path, coyaml_print_enum mode)
+{
+    coyaml_path_t *p = find(idx, path);
+    if(!p)
+        return -1;
+    return coyaml_print_prop(output, p->prop, (char *)cfg + p->offset, mode);
+}
@@ -0,0 +1,247 @@
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <errno.h>
+
+#include "patterns.h"
+#include "columns.h"
+#include "scalars.h"
+#include "util.h"
+
+#define REF(obj, off, typ) (*(typ*)((char *)(obj) + (off)))
+
+void coyaml_cleanup_add(coyaml_head_t *head, void (*fun)(void *), void *data)
+{
+    coyaml_cleanup_t *item = obstack_alloc(&head->pieces,
+        sizeof(coyaml_cleanup_t));
+    item->next = head->cleanup;
+    item->fun = fun;
+    item->data = data;
+    head->cleanup = item;
+}
+
+static void free_regex(void *re) {
+    regfree((regex_t *)re);
+}
+
+// Compiles the pattern which is already stored at `target`, on failure
+// returns error code of regcomp() and puts the message into `errbuf`
+int coyaml_regex_compile(coyaml_head_t *head, coyaml_regex_t *def,
+    void *target, char *errbuf, size_t errlen)
+{
+    regex_t *re = obstack_alloc(&head->pieces, sizeof(regex_t));
+    int rc = regcomp(re, REF(target, def->baseoffset, char *), def->cflags);
+    if(rc) {
+        regerror(rc, re, errbuf, errlen);
+        obstack_free(&head->pieces, re);
+        return rc;
+    }
+    coyaml_cleanup_add(head, free_regex, re);
+    REF(target, def->compiledoffset, regex_t *) = re;
+    return 0;
+}
+
+// Compiles patterns of the array into single `(p1)|(p2)|...`, the pattern
+// which matched is found by the first subexpression which is set. Must be
+// called each time the array is changed, like coyaml_array_columns()
+int coyaml_regexset_build(coyaml_head_t *head, coyaml_array_t *def,
+    void *target, char *errbuf, size_t errlen)
+{
+    if(!def->setoffset || def->element_prop->type->ident != COYAML_REGEX) {
+        return 0;
+    }
+    coyaml_regex_t *el = (coyaml_regex_t *)def->element_prop;
+    size_t len = coyaml_array_length(def, target);
+    REF(target, def->setoffset, coyaml_regexset_t *) = NULL;
+    if(!len) return 0;
+    coyaml_regexset_t *set = obstack_alloc(&head->pieces,
+        sizeof(coyaml_regexset_t));
+    set->count = len;
+    set->groups = obstack_alloc(&head->pieces, len*sizeof(size_t));
+    char *base = (char *)target + def->baseoffset;
+    char *item = def->capacity ? base : REF(base, 0, char *);
+    size_t group = 1;
+    for(size_t i = 0; i < len; ++i) {
+        regex_t *re = REF(item, el->compiledoffset, regex_t *);
+        COYAML_ASSERT(re);
+        if(i) {
+            obstack_1grow(&head->pieces, '|');
+        }
+        obstack_1grow(&head->pieces, '(');
+        obstack_grow(&head->pieces, REF(item, el->baseoffset, char *),
+            REF(item, el->baseoffset + sizeof(char *), size_t));
+        obstack_1grow(&head->pieces, ')');
+        set->groups[i] = group;
+        group += 1 + re->re_nsub;
+        if(def->capacity) {
+            item += def->element_size;
+        } else {
+            item = ((coyaml_arrayel_head_t *)item)->next;
+        }
+    }
+    obstack_1grow(&head->pieces, 0);
+    char *pattern = obstack_finish(&head->pieces);
+    int rc = regcomp(&set->regex, pattern, el->cflags);
+    if(rc) {
+        regerror(rc, &set->regex, errbuf, errlen);
+        return rc;
+    }
+    coyaml_cleanup_add(head, free_regex, &set->regex);
+    REF(target, def->setoffset, coyaml_regexset_t *) = set;
+    return 0;
+}
+
+int coyaml_regexset_match(const coyaml_regexset_t *set, const char *str) {
+    if(!set) return -1;
+    regmatch_t match[set->regex.re_nsub + 1];
+    if(regexec(&set->regex, str, set->regex.re_nsub + 1, match, 0)) {
+        return -1;
+    }
+    for(size_t i = 0; i < set->count; ++i) {
+        if(match[set->groups[i]].rm_so >= 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Segments are only counted when `segs` is NULL, text of the literal is
+// grown in `pieces` while it's not finished
+typedef struct split_s {
+    struct obstack *pieces;
+    coyaml_segment_t *segs;
+    size_t count;
+    size_t litlen;
+} split_t;
+
+static void literal_char(split_t *sp, char c) {
+    if(sp->segs) {
+        obstack_1grow(sp->pieces, c);
+    }
+    sp->litlen += 1;
+}
+
+static void literal_end(split_t *sp) {
+    if(!sp->litlen) return;
+    if(sp->segs) {
+        obstack_1grow(sp->pieces, 0);
+        coyaml_segment_t *seg = &sp->segs[sp->count];
+        seg->placeholder = -1;
+        seg->len = sp->litlen;
+        seg->value = obstack_finish(sp->pieces);
+    }
+    sp->count += 1;
+    sp->litlen = 0;
+}
+
+static void placeholder(split_t *sp, int value,
+    const char *text, size_t len)
+{
+    literal_end(sp);
+    if(sp->segs) {
+        coyaml_segment_t *seg = &sp->segs[sp->count];
+        seg->placeholder = value;
+        seg->len = len;
+        seg->value = obstack_copy0(sp->pieces, text, len);
+    }
+    sp->count += 1;
+}
+
+// `{name}` is a placeholder, `{{` and `}}` are literal braces
+static int split_names(split_t *sp, coyaml_format_t *def,
+    const char *c, const char *end, char *errbuf, size_t errlen)
+{
+    while(c < end) {
+        if((*c == '{' || *c == '}') && c + 1 < end && c[1] == *c) {
+            literal_char(sp, *c);
+            c += 2;
+        } else if(*c == '}') {
+            snprintf(errbuf, errlen, "Unmatched ``}''");
+            return -1;
+        } else if(*c == '{') {
+            const char *close = memchr(c + 1, '}', end - c - 1);
+            if(!close) {
+                snprintf(errbuf, errlen, "Unclosed ``{''");
+                return -1;
+            }
+            int idx = coyaml_choice_find((coyaml_choice_t *)def,
+                c + 1, close - c - 1);
+            if(idx < 0) {
+                snprintf(errbuf, errlen, "Unknown placeholder ``%.*s''",
+                    (int)(close - c - 1), c + 1);
+                return -1;
+            }
+            placeholder(sp, idx, c, close + 1 - c);
+            c = close + 1;
+        } else {
+            literal_char(sp, *c++);
+        }
+    }
+    literal_end(sp);
+    return 0;
+}
+
+// Conversion is `%`, flags, width, `E` or `O` modifier and a letter,
+// `%%` is a literal percent sign
+static int split_strftime(split_t *sp,
+    const char *c, const char *end, char *errbuf, size_t errlen)
+{
+    while(c < end) {
+        if(*c != '%') {
+            literal_char(sp, *c++);
+            continue;
+        }
+        const char *p = c + 1;
+        while(p < end && *p && strchr("_-0^#", *p)) ++p;
+        while(p < end && isdigit((unsigned char)*p)) ++p;
+        if(p < end && (*p == 'E' || *p == 'O')) ++p;
+        if(p == c + 1 && p < end && *p == '%') {
+            literal_char(sp, '%');
+            c += 2;
+            continue;
+        }
+        if(p >= end || !isalpha((unsigned char)*p)) {
+            snprintf(errbuf, errlen, "Bad conversion ``%.*s''",
+                (int)(p < end ? p + 1 - c : p - c), c);
+            return -1;
+        }
+        placeholder(sp, (unsigned char)*p, c, p + 1 - c);
+        c = p + 1;
+    }
+    literal_end(sp);
+    return 0;
+}
+
+static int split(split_t *sp, coyaml_format_t *def,
+    const char *src, size_t len, char *errbuf, size_t errlen)
+{
+    if(def->names) {
+        return split_names(sp, def, src, src + len, errbuf, errlen);
+    }
+    return split_strftime(sp, src, src + len, errbuf, errlen);
+}
+
+// Splits the template which is already stored at `target` into segments,
+// on failure puts the message into `errbuf`. Source is checked by the
+// first pass, so the second one, which fills segments, can't fail
+int coyaml_format_compile(coyaml_head_t *head, coyaml_format_t *def,
+    void *target, char *errbuf, size_t errlen)
+{
+    coyaml_template_t *tpl = &REF(target, def->compiledoffset,
+        coyaml_template_t);
+    const char *src = REF(target, def->baseoffset, char *);
+    size_t len = REF(target, def->baseoffset + sizeof(char *), size_t);
+    tpl->count = 0;
+    tpl->segments = NULL;
+    if(!src) return 0;
+    split_t sp = {pieces: &head->pieces, segs: NULL, count: 0, litlen: 0};
+    CHECK(split(&sp, def, src, len, errbuf, errlen));
+    if(!sp.count) return 0;
+    sp.segs = obstack_alloc(&head->pieces,
+        sp.count*sizeof(coyaml_segment_t));
+    sp.count = 0;
+    CHECK(split(&sp, def, src, len, errbuf, errlen));
+    tpl->count = sp.count;
+    tpl->segments = sp.segs;
+    return 0;
+}
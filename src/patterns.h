@@ -0,0 +1,14 @@
+#ifndef _H_PATTERNS
+#define _H_PATTERNS
+
+#include <coyaml_src.h>
+
+void coyaml_cleanup_add(coyaml_head_t *head, void (*fun)(void *), void *data);
+int coyaml_regex_compile(coyaml_head_t *head, coyaml_regex_t *def,
+    void *target, char *errbuf, size_t errlen);
+int coyaml_regexset_build(coyaml_head_t *head, coyaml_array_t *def,
+    void *target, char *errbuf, size_t errlen);
+int coyaml_format_compile(coyaml_head_t *head, coyaml_format_t *def,
+    void *target, char *errbuf, size_t errlen);
+
+#endif // _H_PATTERNS
@@ -0,0 +1,40 @@
+#include <coyaml_src.h>
+#include <string.h>
+
+#define PATH_MAX_LEN 1024
+
+// Writes counters of the members read through `<PREFIX>_GET()` as YAML
+// mapping of dotted paths, which generator accepts as `config_profile`.
+// Members which were never read are omitted
+
+static int dump_group(FILE *out, coyaml_group_t *group,
+    unsigned long *counters, char *path, size_t len)
+{
+    for(coyaml_transition_t *tr = group->transitions;
+        tr && tr->symbol; ++tr) {
+        size_t slen = strlen(tr->symbol);
+        if(len + slen + 2 > PATH_MAX_LEN) continue;
+        char *end = path + len;
+        if(len) *end++ = '.';
+        memcpy(end, tr->symbol, slen + 1);
+        size_t nlen = end - path + slen;
+        if(tr->prop->type->ident == COYAML_GROUP) {
+            if(dump_group(out, (coyaml_group_t *)tr->prop,
+                counters, path, nlen) < 0)
+                return -1;
+        } else if(counters[tr->prop->baseoffset]) {
+            if(fprintf(out, "%s: %lu\n", path,
+                counters[tr->prop->baseoffset]) < 0)
+                return -1;
+        }
+    }
+    path[len] = 0;
+    return 0;
+}
+
+int coyaml_profile_dump(FILE *out, coyaml_group_t *root,
+    unsigned long *counters)
+{
+    char path[PATH_MAX_LEN] = "";
+    return dump_group(out, root, counters, path, 0);
+}
@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "scalars.h"
+#include "fingerprint.h"
+
+#define REF(obj, def, typ) (*(typ*)((char *)(obj) + (def)->baseoffset))
+
+// Integers are stored with the width declared in schema, values are
+// already checked against the range of the width by the caller
+
+long coyaml_int_get(coyaml_int_t *def, void *target) {
+    switch(def->width) {
+        case 8: return REF(target, def, int8_t);
+        case 16: return REF(target, def, int16_t);
+        case 32: return REF(target, def, int32_t);
+        case 64: return REF(target, def, int64_t);
+        default: return REF(target, def, long);
+    }
+}
+
+void coyaml_int_set(coyaml_int_t *def, void *target, long value) {
+    switch(def->width) {
+        case 8: REF(target, def, int8_t) = value; break;
+        case 16: REF(target, def, int16_t) = value; break;
+        case 32: REF(target, def, int32_t) = value; break;
+        case 64: REF(target, def, int64_t) = value; break;
+        default: REF(target, def, long) = value; break;
+    }
+}
+
+unsigned long coyaml_uint_get(coyaml_uint_t *def, void *target) {
+    switch(def->width) {
+        case 8: return REF(target, def, uint8_t);
+        case 16: return REF(target, def, uint16_t);
+        case 32: return REF(target, def, uint32_t);
+        case 64: return REF(target, def, uint64_t);
+        default: return REF(target, def, unsigned long);
+    }
+}
+
+void coyaml_uint_set(coyaml_uint_t *def, void *target, unsigned long value) {
+    switch(def->width) {
+        case 8: REF(target, def, uint8_t) = value; break;
+        case 16: REF(target, def, uint16_t) = value; break;
+        case 32: REF(target, def, uint32_t) = value; break;
+        case 64: REF(target, def, uint64_t) = value; break;
+        default: REF(target, def, unsigned long) = value; break;
+    }
+}
+
+bool coyaml_bool_get(coyaml_bool_t *def, void *target) {
+    if(def->packed) {
+        return (REF(target, def, uint32_t) >> def->bit) & 1;
+    }
+    return REF(target, def, bool);
+}
+
+void coyaml_bool_set(coyaml_bool_t *def, void *target, bool value) {
+    if(def->packed) {
+        if(value) {
+            REF(target, def, uint32_t) |= (uint32_t)1 << def->bit;
+        } else {
+            REF(target, def, uint32_t) &= ~((uint32_t)1 << def->bit);
+        }
+        return;
+    }
+    REF(target, def, bool) = value;
+}
+
+// Strings are a pointer followed by length (written as int, as everywhere
+// else), inline ones have a buffer of `inline_size` bytes after the length
+
+#define INLINE(obj, def) \
+    ((char *)(obj) + (def)->baseoffset + sizeof(char *) + sizeof(size_t))
+
+char *coyaml_string_get(coyaml_string_t *def, void *target, size_t *len) {
+    char *str = REF(target, def, char *);
+    *len = *(int *)((char *)target + def->baseoffset + sizeof(char *));
+    if(!str && def->inline_size) {
+        return INLINE(target, def);
+    }
+    return str;
+}
+
+// The `data` is referenced when it doesn't fit the inline buffer, so it
+// must live as long as the target
+void coyaml_string_set(coyaml_string_t *def, void *target,
+    char *data, size_t len) {
+    if(def->inline_size && len < def->inline_size) {
+        memcpy(INLINE(target, def), data, len);
+        INLINE(target, def)[len] = 0;
+        REF(target, def, char *) = NULL;
+    } else {
+        REF(target, def, char *) = data;
+    }
+    *(int *)((char *)target + def->baseoffset + sizeof(char *)) = len;
+}
+
+int coyaml_choice_find(coyaml_choice_t *def, const char *name, size_t len) {
+    uint64_t hash = coyaml_hash(def->seed, name, len);
+    int pos = def->slots[(hash ^ (hash >> 32)) & def->mask];
+    if(!pos)
+        return -1;
+    char *cand = def->names[pos-1];
+    if(strlen(cand) != len || memcmp(cand, name, len))
+        return -1;
+    return pos-1;
+}
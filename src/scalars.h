@@ -0,0 +1,18 @@
+#ifndef _H_SCALARS
+#define _H_SCALARS
+
+#include <coyaml_src.h>
+
+long coyaml_int_get(coyaml_int_t *def, void *target);
+void coyaml_int_set(coyaml_int_t *def, void *target, long value);
+unsigned long coyaml_uint_get(coyaml_uint_t *def, void *target);
+void coyaml_uint_set(coyaml_uint_t *def, void *target, unsigned long value);
+bool coyaml_bool_get(coyaml_bool_t *def, void *target);
+void coyaml_bool_set(coyaml_bool_t *def, void *target, bool value);
+char *coyaml_string_get(coyaml_string_t *def, void *target, size_t *len);
+void coyaml_string_set(coyaml_string_t *def, void *target,
+    char *data, size_t len);
+// Returns index of the name, -1 if it's not one of the choices
+int coyaml_choice_find(coyaml_choice_t *def, const char *name, size_t len);
+
+#endif // _H_SCALARS
@@ -0,0 +1,406 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+
+#include "snapshot.h"
+#include "fingerprint.h"
+
+#define COYAML_SHARED_MAGIC "COYAMLP1"
+#define SHARED_SEALS (F_SEAL_SHRINK|F_SEAL_GROW|F_SEAL_WRITE|F_SEAL_SEAL)
+#define SHARED_RETRIES 8
+
+// Layout of the published memfd. Pointers in the data are already
+// relocated to `base + data_offset`, which is the address of the slot in
+// every process forked after `coyaml_shared_create`
+typedef struct shared_hdr_s {
+    char magic[8];
+    uint64_t generation;
+    uint64_t base;
+    uint64_t target_size;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t relocs_offset;
+    uint64_t nrelocs;
+    uint64_t total_size;
+} shared_hdr_t;
+
+// Lives in a MAP_SHARED page, written by the master only. `seq` is odd
+// while the master updates other fields
+typedef struct shared_ctl_s {
+    uint64_t seq;
+    uint64_t generation;
+    uint64_t size;
+} shared_ctl_t;
+
+typedef struct shared_map_s {
+    uint64_t generation;
+    char *addr;
+    size_t size;
+    int slot;  // -1 when mapped privately outside of the arena
+    const void *config;
+} shared_map_t;
+
+struct coyaml_shared_s {
+    shared_ctl_t *ctl;
+    size_t ctl_size;
+    char *arena;
+    size_t slot_size;
+    int nslots;
+    pid_t owner;
+    // Datagram socket pair, created before workers are forked. Its only
+    // queued message carries the memfd of the current generation, which is
+    // received by peeking, so every process gets a copy of the descriptor.
+    // Unlike /proc/<pid>/fd it works after workers drop privileges
+    int sock[2];
+    shared_map_t cur;
+    shared_map_t prev;
+};
+
+static size_t page_align(size_t size) {
+    size_t page = sysconf(_SC_PAGESIZE);
+    return COYAML_ALIGN(size, page);
+}
+
+coyaml_shared_t *coyaml_shared_create(size_t slot_size, int nslots) {
+    if(nslots < 3) {
+        // Current and previous generations of every worker must not be
+        // overwritten by the one being mapped
+        errno = EINVAL;
+        return NULL;
+    }
+    coyaml_shared_t *sh = calloc(1, sizeof(coyaml_shared_t));
+    if(!sh) return NULL;
+    if(socketpair(AF_UNIX, SOCK_DGRAM|SOCK_CLOEXEC, 0, sh->sock) < 0) {
+        free(sh);
+        return NULL;
+    }
+    sh->nslots = nslots;
+    sh->slot_size = page_align(slot_size);
+    sh->owner = getpid();
+    sh->cur.slot = sh->prev.slot = -1;
+    sh->ctl_size = page_align(sizeof(shared_ctl_t));
+    sh->ctl = mmap(NULL, sh->ctl_size, PROT_READ|PROT_WRITE,
+        MAP_SHARED|MAP_ANONYMOUS, -1, 0);
+    if(sh->ctl == MAP_FAILED) {
+        int err = errno;
+        close(sh->sock[0]);
+        close(sh->sock[1]);
+        free(sh);
+        errno = err;
+        return NULL;
+    }
+    // Only reserves address space, so that the slots are at the same
+    // address in every worker
+    sh->arena = mmap(NULL, sh->slot_size*nslots, PROT_NONE,
+        MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    if(sh->arena == MAP_FAILED) {
+        int err = errno;
+        munmap(sh->ctl, sh->ctl_size);
+        close(sh->sock[0]);
+        close(sh->sock[1]);
+        free(sh);
+        errno = err;
+        return NULL;
+    }
+    return sh;
+}
+
+// Queues descriptor with the generation number as the payload
+static int send_fd(int sock, int fd, uint64_t generation) {
+    union {
+        struct cmsghdr align;
+        char data[CMSG_SPACE(sizeof(int))];
+    } ctrl;
+    memset(&ctrl, 0, sizeof(ctrl));
+    struct iovec iov = {iov_base: &generation, iov_len: sizeof(generation)};
+    struct msghdr msg = {msg_iov: &iov, msg_iovlen: 1,
+        msg_control: ctrl.data, msg_controllen: sizeof(ctrl.data)};
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+    memcpy(CMSG_DATA(cmsg), &fd, sizeof(int));
+    return sendmsg(sock, &msg, MSG_DONTWAIT) < 0 ? -1 : 0;
+}
+
+// Returns descriptor from the head of the queue, the message is left
+// there if `flags` has MSG_PEEK
+static int recv_fd(int sock, int flags, uint64_t *generation) {
+    union {
+        struct cmsghdr align;
+        char data[CMSG_SPACE(sizeof(int))];
+    } ctrl;
+    struct iovec iov = {iov_base: generation, iov_len: sizeof(*generation)};
+    struct msghdr msg = {msg_iov: &iov, msg_iovlen: 1,
+        msg_control: ctrl.data, msg_controllen: sizeof(ctrl.data)};
+    ssize_t len = recvmsg(sock, &msg, flags|MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
+    if(len < 0) {
+        // Queue may be empty only while the first generation is published
+        if(errno == EWOULDBLOCK) errno = EAGAIN;
+        return -1;
+    }
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if(len != sizeof(*generation) || !cmsg || cmsg->cmsg_level != SOL_SOCKET
+        || cmsg->cmsg_type != SCM_RIGHTS
+        || cmsg->cmsg_len != CMSG_LEN(sizeof(int))) {
+        errno = EINVAL;
+        return -1;
+    }
+    int fd;
+    memcpy(&fd, CMSG_DATA(cmsg), sizeof(int));
+    return fd;
+}
+
+int coyaml_shared_publish(coyaml_shared_t *sh, coyaml_context_t *ctx) {
+    if(getpid() != sh->owner) {
+        errno = EPERM;
+        return -1;
+    }
+    coyaml_image_t img;
+    if(coyaml_image_build(&img, ctx->root_group, ctx->target,
+        ctx->target_size) < 0) return -1;
+
+    uint64_t gen = sh->ctl->generation + 1;
+    int slot = gen % sh->nslots;
+    char *base = sh->arena + slot*sh->slot_size;
+    shared_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, COYAML_SHARED_MAGIC, sizeof(hdr.magic));
+    hdr.generation = gen;
+    hdr.base = (uintptr_t)base;
+    hdr.target_size = ctx->target_size;
+    hdr.data_offset = COYAML_ALIGN(sizeof(hdr), 16);
+    hdr.data_size = img.size;
+    hdr.relocs_offset = COYAML_ALIGN(hdr.data_offset + img.size, 8);
+    hdr.nrelocs = img.nrelocs;
+    hdr.total_size = hdr.relocs_offset + img.nrelocs*sizeof(uint64_t);
+    if(hdr.total_size > sh->slot_size) {
+        coyaml_image_free(&img);
+        errno = EFBIG;
+        return -1;
+    }
+    coyaml_image_relocate(img.data, img.size, img.relocs, img.nrelocs,
+        (uintptr_t)base + hdr.data_offset);
+
+    char name[32];
+    sprintf(name, "coyaml-%llu", (unsigned long long)gen);
+    int fd = memfd_create(name, MFD_CLOEXEC|MFD_ALLOW_SEALING);
+    if(fd < 0) {
+        coyaml_image_free(&img);
+        return -1;
+    }
+    static const char zeros[16];
+    int res = coyaml_write_all(fd, &hdr, sizeof(hdr));
+    if(!res) res = coyaml_write_all(fd, (void *)zeros,
+        hdr.data_offset - sizeof(hdr));
+    if(!res) res = coyaml_write_all(fd, img.data, img.size);
+    if(!res) res = coyaml_write_all(fd, (void *)zeros,
+        hdr.relocs_offset - hdr.data_offset - img.size);
+    if(!res) res = coyaml_write_all(fd, img.relocs,
+        img.nrelocs*sizeof(uint64_t));
+    if(!res) res = fcntl(fd, F_ADD_SEALS, SHARED_SEALS);
+    coyaml_image_free(&img);
+    // Queued message keeps the memfd alive, the descriptor isn't needed
+    if(!res) res = send_fd(sh->sock[0], fd, gen);
+    int err = errno;
+    close(fd);
+    if(res < 0) {
+        errno = err;
+        return -1;
+    }
+
+    shared_ctl_t *ctl = sh->ctl;
+    __atomic_store_n(&ctl->seq, ctl->seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&ctl->size, hdr.total_size, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctl->generation, gen, __ATOMIC_RELAXED);
+    __atomic_store_n(&ctl->seq, ctl->seq + 1, __ATOMIC_RELEASE);
+
+    // Previous generation is dropped only after the new one is queued, so
+    // there is always a message to peek. Processes which have peeked the
+    // old one notice the generation mismatch and retry
+    if(gen > 1) {
+        uint64_t old;
+        int oldfd = recv_fd(sh->sock[1], 0, &old);
+        if(oldfd >= 0) close(oldfd);
+    }
+    return 0;
+}
+
+static void read_ctl(shared_ctl_t *ctl, shared_ctl_t *copy) {
+    for(;;) {
+        uint64_t seq = __atomic_load_n(&ctl->seq, __ATOMIC_ACQUIRE);
+        if(seq & 1) continue;
+        copy->generation = __atomic_load_n(&ctl->generation,
+            __ATOMIC_RELAXED);
+        copy->size = __atomic_load_n(&ctl->size, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if(__atomic_load_n(&ctl->seq, __ATOMIC_RELAXED) == seq) return;
+    }
+}
+
+static void unmap(coyaml_shared_t *sh, shared_map_t *map) {
+    if(!map->addr) return;
+    if(map->slot >= 0) {
+        // Put reservation back, so nobody else gets this address range
+        mmap(map->addr, sh->slot_size, PROT_NONE,
+            MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE|MAP_FIXED, -1, 0);
+    } else {
+        munmap(map->addr, map->size);
+    }
+    memset(map, 0, sizeof(*map));
+    map->slot = -1;
+}
+
+static int check_hdr(shared_hdr_t *hdr, shared_ctl_t *ctl, char *base) {
+    if(memcmp(hdr->magic, COYAML_SHARED_MAGIC, sizeof(hdr->magic))
+        || hdr->generation != ctl->generation
+        || hdr->total_size != ctl->size) {
+        // Newer generation was published while this one was being mapped
+        errno = EAGAIN;
+        return -1;
+    }
+    if(hdr->data_offset + hdr->data_size > hdr->total_size
+        || hdr->relocs_offset + hdr->nrelocs*sizeof(uint64_t)
+            > hdr->total_size
+        || hdr->data_size < hdr->target_size
+        || hdr->relocs_offset % sizeof(uint64_t)
+        || (base && hdr->base != (uintptr_t)base)) {
+        errno = EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+static int map_generation(coyaml_shared_t *sh, shared_ctl_t *ctl,
+    shared_map_t *map) {
+    uint64_t generation;
+    int fd = recv_fd(sh->sock[1], MSG_PEEK, &generation);
+    if(fd < 0) return -1;
+    if(generation != ctl->generation) {
+        close(fd);
+        errno = EAGAIN;
+        return -1;
+    }
+    struct stat finfo;
+    if(fstat(fd, &finfo) < 0) {
+        int err = errno;
+        close(fd);
+        errno = err;
+        return -1;
+    }
+    if((uint64_t)finfo.st_size != ctl->size) {
+        close(fd);
+        errno = EAGAIN;
+        return -1;
+    }
+
+    memset(map, 0, sizeof(*map));
+    map->generation = ctl->generation;
+    map->size = ctl->size;
+    map->slot = ctl->generation % sh->nslots;
+    if(map->slot == sh->cur.slot || map->slot == sh->prev.slot
+        || ctl->size > sh->slot_size) {
+        // Worker has skipped a few generations and still holds one at the
+        // same slot, so we need a private copy with pointers fixed up
+        map->slot = -1;
+        map->addr = mmap(NULL, map->size, PROT_READ|PROT_WRITE,
+            MAP_PRIVATE, fd, 0);
+    } else {
+        map->addr = mmap(sh->arena + map->slot*sh->slot_size, map->size,
+            PROT_READ, MAP_SHARED|MAP_FIXED, fd, 0);
+    }
+    int err = errno;
+    close(fd);
+    if(map->addr == MAP_FAILED) {
+        if(map->slot >= 0) {
+            map->addr = sh->arena + map->slot*sh->slot_size;
+            unmap(sh, map);
+        }
+        map->addr = NULL;
+        errno = err;
+        return -1;
+    }
+
+    shared_hdr_t *hdr = (shared_hdr_t *)map->addr;
+    if(check_hdr(hdr, ctl, map->slot >= 0 ? map->addr : NULL) < 0) {
+        err = errno;
+        unmap(sh, map);
+        errno = err;
+        return -1;
+    }
+    if(map->slot < 0) {
+        char *data = map->addr + hdr->data_offset;
+        uint64_t *relocs = (uint64_t *)(map->addr + hdr->relocs_offset);
+        uintptr_t delta = (uintptr_t)map->addr - hdr->base;
+        for(size_t i = 0; i < hdr->nrelocs; ++i) {
+            if(relocs[i] + sizeof(uintptr_t) > hdr->data_size) {
+                unmap(sh, map);
+                errno = EINVAL;
+                return -1;
+            }
+            *(uintptr_t *)(data + relocs[i]) += delta;
+        }
+        if(mprotect(map->addr, map->size, PROT_READ) < 0) {
+            err = errno;
+            unmap(sh, map);
+            errno = err;
+            return -1;
+        }
+    }
+    map->config = map->addr + hdr->data_offset;
+    return 0;
+}
+
+// Returns the most recent published config. Pointer returned by previous
+// call is kept valid until the next switch of generation
+const void *coyaml_shared_config(coyaml_shared_t *sh) {
+    for(int i = 0; i < SHARED_RETRIES; ++i) {
+        shared_ctl_t ctl;
+        read_ctl(sh->ctl, &ctl);
+        if(!ctl.generation) {
+            errno = ENOENT;
+            return NULL;
+        }
+        if(ctl.generation == sh->cur.generation) {
+            return sh->cur.config;
+        }
+        shared_map_t map;
+        if(map_generation(sh, &ctl, &map) < 0) {
+            if(errno == EAGAIN || errno == ENOENT) continue;
+            return NULL;
+        }
+        unmap(sh, &sh->prev);
+        sh->prev = sh->cur;
+        sh->cur = map;
+        return sh->cur.config;
+    }
+    errno = EAGAIN;
+    return NULL;
+}
+
+uint64_t coyaml_shared_generation(coyaml_shared_t *sh) {
+    return sh->cur.generation;
+}
+
+void coyaml_shared_free(coyaml_shared_t *sh) {
+    close(sh->sock[0]);
+    close(sh->sock[1]);
+    if(sh->cur.slot < 0 && sh->cur.addr) {
+        munmap(sh->cur.addr, sh->cur.size);
+    }
+    if(sh->prev.slot < 0 && sh->prev.addr) {
+        munmap(sh->prev.addr, sh->prev.size);
+    }
+    munmap(sh->arena, sh->slot_size*sh->nslots);
+    munmap(sh->ctl, sh->ctl_size);
+    free(sh);
+}
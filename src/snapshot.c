@@ -0,0 +1,423 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "snapshot.h"
+#include "fingerprint.h"
+#include "mapindex.h"
+#include "columns.h"
+#include "util.h"
+
+#define IMAGE_ALIGN 16
+#define REF(obj, off, typ) (*(typ*)((char *)(obj) + (off)))
+
+static int image_grow(coyaml_image_t *img, size_t size, size_t align,
+    size_t *offset) {
+    size_t start = COYAML_ALIGN(img->size, align);
+    if(start + size > img->alloc) {
+        size_t nalloc = img->alloc ? img->alloc : 4096;
+        while(nalloc < start + size) nalloc *= 2;
+        char *ndata = realloc(img->data, nalloc);
+        if(!ndata) return -1;
+        img->data = ndata;
+        img->alloc = nalloc;
+    }
+    memset(img->data + img->size, 0, start + size - img->size);
+    img->size = start + size;
+    *offset = start;
+    return 0;
+}
+
+// Stores pointer to `target` offset at offset `at`
+static int image_pointer(coyaml_image_t *img, size_t at, size_t target) {
+    if(img->nrelocs >= img->relocs_alloc) {
+        size_t nalloc = img->relocs_alloc ? img->relocs_alloc*2 : 256;
+        uint64_t *nrelocs = realloc(img->relocs, nalloc*sizeof(uint64_t));
+        if(!nrelocs) return -1;
+        img->relocs = nrelocs;
+        img->relocs_alloc = nalloc;
+    }
+    img->relocs[img->nrelocs++] = at;
+    REF(img->data, at, uintptr_t) = target;
+    return 0;
+}
+
+static int image_prop(coyaml_image_t *img, coyaml_placeholder_t *prop,
+    char *src, size_t dst);
+
+// Source is a string, segments and their text are copied after it
+static int image_format(coyaml_image_t *img, coyaml_format_t *def,
+    char *src, size_t dst) {
+    char *str = REF(src, def->baseoffset, char *);
+    if(str) {
+        size_t len = REF(src, def->baseoffset + sizeof(char *), size_t);
+        size_t off;
+        CHECK(image_grow(img, len+1, 1, &off));
+        memcpy(img->data + off, str, len);
+        img->data[off + len] = 0;
+        CHECK(image_pointer(img, dst + def->baseoffset, off));
+    }
+    coyaml_template_t *tpl = &REF(src, def->compiledoffset,
+        coyaml_template_t);
+    if(!tpl->count) return 0;
+    size_t block;
+    CHECK(image_grow(img, tpl->count*sizeof(coyaml_segment_t),
+        IMAGE_ALIGN, &block));
+    memcpy(img->data + block, tpl->segments,
+        tpl->count*sizeof(coyaml_segment_t));
+    CHECK(image_pointer(img, dst + def->compiledoffset
+        + offsetof(coyaml_template_t, segments), block));
+    for(size_t i = 0; i < tpl->count; ++i) {
+        const coyaml_segment_t *seg = &tpl->segments[i];
+        size_t off;
+        CHECK(image_grow(img, seg->len+1, 1, &off));
+        memcpy(img->data + off, seg->value, seg->len+1);
+        CHECK(image_pointer(img, block + i*sizeof(coyaml_segment_t)
+            + offsetof(coyaml_segment_t, value), off));
+    }
+    return 0;
+}
+
+static int image_string(coyaml_image_t *img, coyaml_placeholder_t *prop,
+    char *src, size_t dst) {
+    char *str = REF(src, prop->baseoffset, char *);
+    if(!str) return 0;
+    size_t len = REF(src, prop->baseoffset + sizeof(char *), int);
+    if(!len) {
+        // Custom converters may set only the pointer
+        len = strlen(str);
+    }
+    size_t off;
+    CHECK(image_grow(img, len+1, 1, &off));
+    memcpy(img->data + off, str, len);
+    img->data[off + len] = 0;
+    return image_pointer(img, dst + prop->baseoffset, off);
+}
+
+// Elements are placed into single block, so arrays are contiguous in
+// the image whatever layout they had
+static int image_list(coyaml_image_t *img, coyaml_placeholder_t *prop,
+    size_t element_size, coyaml_placeholder_t *first,
+    coyaml_placeholder_t *second, char *src, size_t dst) {
+    size_t count = 0;
+    for(coyaml_arrayel_head_t *el = REF(src, prop->baseoffset, void *);
+        el; el = el->next) {
+        count += 1;
+    }
+    if(!count) return 0;
+    size_t block;
+    CHECK(image_grow(img, count*element_size, IMAGE_ALIGN, &block));
+    size_t prev = dst + prop->baseoffset;  // where to store next pointer
+    size_t off = block;
+    for(coyaml_arrayel_head_t *el = REF(src, prop->baseoffset, void *);
+        el; el = el->next, off += element_size) {
+        memcpy(img->data + off, el, element_size);
+        REF(img->data, off, void *) = NULL;
+        CHECK(image_pointer(img, prev, off));
+        prev = off;
+    }
+    off = block;
+    for(coyaml_arrayel_head_t *el = REF(src, prop->baseoffset, void *);
+        el; el = el->next, off += element_size) {
+        CHECK(image_prop(img, first, (char *)el, off));
+        if(second) {
+            CHECK(image_prop(img, second, (char *)el, off));
+        }
+    }
+    return 0;
+}
+
+// Index slots point to the elements, so they are relocated along with
+// the rest of the image. Elements are at `block` in the order of the list
+static int image_index(coyaml_image_t *img, coyaml_index_t *idx,
+    void *first, size_t block, size_t element_size, size_t *offset) {
+    size_t size = sizeof(coyaml_index_t) + idx->nslots*sizeof(void *);
+    size_t off;
+    CHECK(image_grow(img, size, IMAGE_ALIGN, &off));
+    memcpy(img->data + off, idx, sizeof(coyaml_index_t));
+    size_t i = 0;
+    for(coyaml_arrayel_head_t *el = first; el; el = el->next, ++i) {
+        ssize_t slot = coyaml_index_position(idx, el);
+        if(slot >= 0) {
+            CHECK(image_pointer(img,
+                off + offsetof(coyaml_index_t, slots) + slot*sizeof(void *),
+                block + i*element_size));
+        }
+    }
+    *offset = off;
+    return 0;
+}
+
+// Must be called after `image_list`, which places the elements
+static int image_mapping_index(coyaml_image_t *img, coyaml_mapping_t *def,
+    char *src, size_t dst) {
+    if(!def->indexoffset) return 0;
+    REF(img->data, dst + def->indexoffset, void *) = NULL;
+    coyaml_mappingel_head_t *first = REF(src, def->baseoffset, void *);
+    coyaml_index_t *index = REF(src, def->indexoffset, coyaml_index_t *);
+    if(!first || !index) return 0;
+    size_t block = REF(img->data, dst + def->baseoffset, uintptr_t);
+    size_t off;
+    CHECK(image_index(img, index, first, block, def->element_size, &off));
+    return image_pointer(img, dst + def->indexoffset, off);
+}
+
+static int image_array_index(coyaml_image_t *img, coyaml_array_t *def,
+    char *src, size_t dst) {
+    if(!def->indexoffset) return 0;
+    REF(img->data, dst + def->indexoffset, void *) = NULL;
+    coyaml_arrayel_head_t *first = REF(src, def->baseoffset, void *);
+    coyaml_index_t **indexes = REF(src, def->indexoffset, coyaml_index_t **);
+    if(!first || !indexes) return 0;
+    size_t block = REF(img->data, dst + def->baseoffset, uintptr_t);
+    size_t count = 0;
+    while(indexes[count]) ++count;
+    size_t table;
+    CHECK(image_grow(img, (count+1)*sizeof(void *), IMAGE_ALIGN, &table));
+    for(size_t i = 0; i < count; ++i) {
+        size_t off;
+        CHECK(image_index(img, indexes[i], first, block,
+            def->element_size, &off));
+        CHECK(image_pointer(img, table + i*sizeof(void *), off));
+    }
+    return image_pointer(img, dst + def->indexoffset, table);
+}
+
+static int image_columns(coyaml_image_t *img, coyaml_array_t *def,
+    char *src, size_t dst) {
+    size_t len = coyaml_array_length(def, src);
+    for(coyaml_column_t *col = def->columns; col->size; ++col) {
+        char *vec = REF(src, def->columnsoffset + col->column, char *);
+        if(!vec) continue;
+        size_t off;
+        CHECK(image_grow(img, len*col->size, COYAML_COLUMN_ALIGN, &off));
+        memcpy(img->data + off, vec, len*col->size);
+        CHECK(image_pointer(img,
+            dst + def->columnsoffset + col->column, off));
+    }
+    return 0;
+}
+
+// Inline elements are already copied with the structure, only things
+// they point to are copied here
+static int image_inline(coyaml_image_t *img, coyaml_array_t *def,
+    char *src, size_t dst) {
+    char *vec = src + def->baseoffset;
+    size_t len = REF(vec, def->capacity*def->element_size, size_t);
+    for(size_t i = 0; i < len; ++i) {
+        CHECK(image_prop(img, def->element_prop,
+            vec + i*def->element_size,
+            dst + def->baseoffset + i*def->element_size));
+    }
+    return 0;
+}
+
+static int image_prop(coyaml_image_t *img, coyaml_placeholder_t *prop,
+    char *src, size_t dst) {
+    switch(prop->type->ident) {
+        case COYAML_GROUP:
+            for(coyaml_transition_t *tr = ((coyaml_group_t *)prop)->transitions;
+                tr && tr->symbol; ++tr) {
+                CHECK(image_prop(img, tr->prop, src, dst));
+            }
+            return 0;
+        case COYAML_CUSTOM: {
+            coyaml_usertype_t *utype = ((coyaml_custom_t *)prop)->usertype;
+            return image_prop(img, (coyaml_placeholder_t *)utype->group,
+                src + prop->baseoffset, dst + prop->baseoffset);
+            }
+        case COYAML_STRING:
+        case COYAML_FILE:
+        case COYAML_DIR:
+            return image_string(img, prop, src, dst);
+        case COYAML_ARRAY: {
+            coyaml_array_t *def = (coyaml_array_t *)prop;
+            if(def->capacity) {
+                CHECK(image_inline(img, def, src, dst));
+            } else {
+                CHECK(image_list(img, prop, def->element_size,
+                    def->element_prop, NULL, src, dst));
+                CHECK(image_array_index(img, def, src, dst));
+            }
+            if(def->columns) {
+                CHECK(image_columns(img, def, src, dst));
+            }
+            if(def->setoffset) {
+                // Sets are trees of pointers, they aren't relocated
+                errno = ENOTSUP;
+                return -1;
+            }
+            return 0;
+            }
+        case COYAML_MAPPING: {
+            coyaml_mapping_t *def = (coyaml_mapping_t *)prop;
+            CHECK(image_list(img, prop, def->element_size,
+                def->key_prop, def->value_prop, src, dst));
+            return image_mapping_index(img, def, src, dst);
+            }
+        case COYAML_REGEX:
+            // Compiled pattern is process-local heap memory
+            errno = ENOTSUP;
+            return -1;
+        case COYAML_FORMAT:
+            return image_format(img, (coyaml_format_t *)prop, src, dst);
+        case COYAML_STRINGSET:
+            // Tables of the hash aren't relocated
+            errno = ENOTSUP;
+            return -1;
+        default:
+            // Scalars are already copied with their container
+            return 0;
+    }
+}
+
+// Copies config, described by `root` group, with everything it points to.
+// Members which are not described by schema (hidden and C types) are
+// copied verbatim
+int coyaml_image_build(coyaml_image_t *img, coyaml_group_t *root,
+    void *cfg, size_t size) {
+    memset(img, 0, sizeof(coyaml_image_t));
+    size_t off;
+    CHECK(image_grow(img, size, IMAGE_ALIGN, &off));
+    memcpy(img->data + off + sizeof(coyaml_head_t),
+        (char *)cfg + sizeof(coyaml_head_t), size - sizeof(coyaml_head_t));
+    if(image_prop(img, (coyaml_placeholder_t *)root, cfg, off) < 0) {
+        coyaml_image_free(img);
+        return -1;
+    }
+    return 0;
+}
+
+void coyaml_image_free(coyaml_image_t *img) {
+    free(img->data);
+    free(img->relocs);
+    img->data = NULL;
+    img->relocs = NULL;
+}
+
+int coyaml_image_relocate(char *data, size_t size,
+    uint64_t *relocs, size_t nrelocs, uintptr_t base) {
+    for(size_t i = 0; i < nrelocs; ++i) {
+        if(relocs[i] > size - sizeof(uintptr_t)
+            || REF(data, relocs[i], uintptr_t) >= size) {
+            errno = EINVAL;
+            return -1;
+        }
+        REF(data, relocs[i], uintptr_t) += base;
+    }
+    return 0;
+}
+
+int coyaml_snapshot_write(coyaml_context_t *ctx, char *filename) {
+    coyaml_image_t img;
+    CHECK(coyaml_image_build(&img, ctx->root_group,
+        ctx->target, ctx->target_size));
+
+    int kinds = COYAML_INPUT_BIT(COYAML_INPUT_YAML)
+              | COYAML_INPUT_BIT(COYAML_INPUT_RAW);
+    coyaml_snapshot_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, COYAML_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+    hdr.schema_hash = ctx->schema_hash;
+    hdr.vars_hash = coyaml_vars_hash(ctx);
+    hdr.target_size = ctx->target_size;
+    hdr.inputs_offset = sizeof(hdr);
+    hdr.inputs_size = coyaml_inputs_size(ctx, kinds);
+    hdr.data_offset = COYAML_ALIGN(hdr.inputs_offset + hdr.inputs_size,
+        IMAGE_ALIGN);
+    hdr.data_size = COYAML_ALIGN(img.size, 8);
+    hdr.relocs_offset = hdr.data_offset + hdr.data_size;
+    hdr.nrelocs = img.nrelocs;
+    hdr.total_size = hdr.relocs_offset + hdr.nrelocs*sizeof(uint64_t);
+
+    char *head = calloc(1, hdr.data_offset);
+    if(!head) {
+        coyaml_image_free(&img);
+        return -1;
+    }
+    memcpy(head, &hdr, sizeof(hdr));
+    hdr.ninputs = coyaml_inputs_pack(ctx, kinds, head + hdr.inputs_offset);
+    memcpy(head, &hdr, sizeof(hdr));
+
+    static char zeros[8];
+    struct iovec parts[] = {
+        { iov_base: head, iov_len: hdr.data_offset },
+        { iov_base: img.data, iov_len: img.size },
+        { iov_base: zeros, iov_len: hdr.data_size - img.size },
+        { iov_base: img.relocs, iov_len: img.nrelocs*sizeof(uint64_t) },
+        };
+    int res = coyaml_write_atomic(filename, parts,
+        sizeof(parts)/sizeof(parts[0]));
+    free(head);
+    coyaml_image_free(&img);
+    return res;
+}
+
+// Maps snapshot written by coyaml_snapshot_write() and fills the config
+// from it. Top-level structure is copied into `ctx->target`, everything
+// it points to stays in read-only mapping, which is unmapped by
+// coyaml_config_free(). Returns -1 with errno ESTALE if snapshot was made
+// from another schema, variables or input files
+int coyaml_snapshot_map(coyaml_context_t *ctx, char *filename) {
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) return -1;
+    struct stat finfo;
+    if(fstat(fd, &finfo) < 0) {
+        close(fd);
+        return -1;
+    }
+    size_t size = finfo.st_size;
+    if(size < sizeof(coyaml_snapshot_hdr_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    char *map = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return -1;
+
+    coyaml_snapshot_hdr_t *hdr = (coyaml_snapshot_hdr_t *)map;
+    int err = 0;
+    if(memcmp(hdr->magic, COYAML_SNAPSHOT_MAGIC, sizeof(hdr->magic))
+        || hdr->total_size != size
+        || hdr->inputs_offset + hdr->inputs_size > size
+        || hdr->data_offset + hdr->data_size > size
+        || hdr->relocs_offset + hdr->nrelocs*sizeof(uint64_t) > size
+        || hdr->data_offset % IMAGE_ALIGN
+        || hdr->relocs_offset % sizeof(uint64_t)) {
+        err = EINVAL;
+    } else if(hdr->schema_hash != ctx->schema_hash
+        || hdr->target_size != ctx->target_size
+        || hdr->data_size < hdr->target_size
+        || hdr->vars_hash != coyaml_vars_hash(ctx)) {
+        err = ESTALE;
+    } else if(coyaml_inputs_check(ctx, map + hdr->inputs_offset,
+            hdr->inputs_size, hdr->ninputs) < 0
+        || coyaml_image_relocate(map + hdr->data_offset, hdr->data_size,
+            (uint64_t *)(map + hdr->relocs_offset), hdr->nrelocs,
+            (uintptr_t)(map + hdr->data_offset)) < 0
+        || mprotect(map, size, PROT_READ) < 0) {
+        err = errno;
+    }
+    if(err) {
+        munmap(map, size);
+        errno = err;
+        return -1;
+    }
+    coyaml_head_t *head = ctx->target;
+    memcpy((char *)head + sizeof(coyaml_head_t),
+        map + hdr->data_offset + sizeof(coyaml_head_t),
+        hdr->target_size - sizeof(coyaml_head_t));
+    if(head->snapshot) {
+        munmap(head->snapshot, head->snapshot_size);
+    }
+    head->snapshot = map;
+    head->snapshot_size = size;
+    return 0;
+}
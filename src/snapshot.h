@@ -0,0 +1,41 @@
+#ifndef _H_SNAPSHOT
+#define _H_SNAPSHOT
+
+#include <stdint.h>
+#include <coyaml_src.h>
+
+#define COYAML_SNAPSHOT_MAGIC "COYAMLS1"
+
+// Position-independent copy of the config. All pointers in `data` are
+// offsets from the start of `data`, positions of them are in `relocs`
+typedef struct coyaml_image_s {
+    char *data;
+    size_t size;
+    size_t alloc;
+    uint64_t *relocs;
+    size_t nrelocs;
+    size_t relocs_alloc;
+} coyaml_image_t;
+
+typedef struct coyaml_snapshot_hdr_s {
+    char magic[8];
+    uint64_t schema_hash;
+    uint64_t vars_hash;
+    uint64_t target_size;
+    uint64_t inputs_offset;
+    uint64_t inputs_size;
+    uint64_t ninputs;
+    uint64_t data_offset;
+    uint64_t data_size;
+    uint64_t relocs_offset;
+    uint64_t nrelocs;
+    uint64_t total_size;
+} coyaml_snapshot_hdr_t;
+
+int coyaml_image_build(coyaml_image_t *img, coyaml_group_t *root,
+    void *cfg, size_t size);
+void coyaml_image_free(coyaml_image_t *img);
+int coyaml_image_relocate(char *data, size_t size,
+    uint64_t *relocs, size_t nrelocs, uintptr_t base);
+
+#endif // _H_SNAPSHOT
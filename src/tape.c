@@ -0,0 +1,280 @@
+#define _GNU_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <obstack.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+#include "tape.h"
+#include "fingerprint.h"
+#include "util.h"
+
+#define TAPE_ALIGN 8
+#define INPUT_KINDS COYAML_INPUT_BIT(COYAML_INPUT_YAML)
+
+// Pads record of `size` bytes, which has been grown, to TAPE_ALIGN
+static void grow_padding(struct obstack *ob, size_t size) {
+    static char zeros[TAPE_ALIGN];
+    obstack_grow(ob, zeros, COYAML_ALIGN(size, TAPE_ALIGN) - size);
+}
+
+static bool has_tag(yaml_event_type_t type) {
+    return type == YAML_SCALAR_EVENT
+        || type == YAML_SEQUENCE_START_EVENT
+        || type == YAML_MAPPING_START_EVENT;
+}
+
+// Records event which is passed to the schema parser
+void coyaml_tape_record_event(coyaml_parseinfo_t *info) {
+    yaml_event_t *ev = &info->event;
+    coyaml_tape_event_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.type = ev->type;
+    rec.file = info->current_file->index;
+    rec.line = ev->start_mark.line;
+    rec.column = ev->start_mark.column;
+    char *tag = has_tag(ev->type) ? (char *)ev->data.scalar.tag : NULL;
+    rec.tag_len = tag ? strlen(tag) : COYAML_TAPE_NOTAG;
+    if(ev->type == YAML_SCALAR_EVENT) {
+        rec.value_len = ev->data.scalar.length;
+    }
+    size_t size = sizeof(rec) + (tag ? rec.tag_len + 1 : 0);
+    if(ev->type == YAML_SCALAR_EVENT) {
+        size += rec.value_len + 1;
+    }
+    obstack_grow(&info->tape_events, &rec, sizeof(rec));
+    if(tag) {
+        obstack_grow0(&info->tape_events, tag, rec.tag_len);
+    }
+    if(ev->type == YAML_SCALAR_EVENT) {
+        obstack_grow0(&info->tape_events, ev->data.scalar.value,
+            rec.value_len);
+    }
+    grow_padding(&info->tape_events, size);
+    info->tape_count += 1;
+}
+
+// Records anchor at the time it's complete, so that it's visible to
+// variable lookups at the same point when replaying
+void coyaml_tape_record_anchor(coyaml_parseinfo_t *info,
+    coyaml_anchor_t *anchor) {
+    yaml_event_t *ev = &anchor->events[0];
+    coyaml_tape_anchor_t rec;
+    memset(&rec, 0, sizeof(rec));
+    rec.index = info->tape_count;
+    rec.type = ev->type;
+    rec.name_len = strlen(anchor->name);
+    if(ev->type == YAML_SCALAR_EVENT) {
+        rec.value_len = ev->data.scalar.length;
+    }
+    obstack_grow(&info->tape_anchors, &rec, sizeof(rec));
+    obstack_grow0(&info->tape_anchors, anchor->name, rec.name_len);
+    if(ev->type == YAML_SCALAR_EVENT) {
+        obstack_grow0(&info->tape_anchors, ev->data.scalar.value,
+            rec.value_len);
+    } else {
+        obstack_1grow(&info->tape_anchors, 0);
+    }
+    grow_padding(&info->tape_anchors,
+        sizeof(rec) + rec.name_len + rec.value_len + 2);
+}
+
+int coyaml_tape_write(coyaml_parseinfo_t *info, char *filename) {
+    coyaml_context_t *ctx = info->context;
+    coyaml_tape_hdr_t hdr;
+    memset(&hdr, 0, sizeof(hdr));
+    memcpy(hdr.magic, COYAML_TAPE_MAGIC, sizeof(hdr.magic));
+    hdr.inputs_offset = sizeof(hdr);
+    hdr.inputs_size = coyaml_inputs_size(ctx, INPUT_KINDS);
+    hdr.events_offset = hdr.inputs_offset + hdr.inputs_size;
+    hdr.events_size = obstack_object_size(&info->tape_events);
+    hdr.anchors_offset = hdr.events_offset + hdr.events_size;
+    hdr.anchors_size = obstack_object_size(&info->tape_anchors);
+    hdr.total_size = hdr.anchors_offset + hdr.anchors_size;
+
+    char *inputs = malloc(hdr.inputs_size);
+    if(!inputs) return -1;
+    hdr.ninputs = coyaml_inputs_pack(ctx, INPUT_KINDS, inputs);
+    struct iovec parts[] = {
+        { iov_base: &hdr, iov_len: sizeof(hdr) },
+        { iov_base: inputs, iov_len: hdr.inputs_size },
+        { iov_base: obstack_base(&info->tape_events),
+          iov_len: hdr.events_size },
+        { iov_base: obstack_base(&info->tape_anchors),
+          iov_len: hdr.anchors_size },
+        };
+    int res = coyaml_write_atomic(filename, parts,
+        sizeof(parts)/sizeof(parts[0]));
+    free(inputs);
+    return res;
+}
+
+static int setup_files(coyaml_parseinfo_t *info, coyaml_tape_t *tape,
+    char *buf, size_t count) {
+    coyaml_context_t *ctx = info->context;
+    tape->nfiles = count;
+    tape->files = obstack_alloc(&ctx->pieces, sizeof(coyaml_stack_t)*count);
+    memset(tape->files, 0, sizeof(coyaml_stack_t)*count);
+    for(size_t i = 0; i < count; ++i) {
+        coyaml_input_rec_t *rec = (coyaml_input_rec_t *)buf;
+        coyaml_stack_t *file = &tape->files[i];
+        file->filename = rec->name;
+        file->size = rec->size;
+        file->index = i;
+        coyaml_set_basedir(ctx, file);
+        // Files are fingerprinted again for snapshots
+        CHECK(coyaml_input_add(ctx, rec->name, COYAML_INPUT_YAML));
+        buf += COYAML_ALIGN(sizeof(coyaml_input_rec_t) + rec->name_len + 1, 8);
+    }
+    return 0;
+}
+
+// Maps the tape, if it was recorded from the same input files as are on
+// disk now. Returns -1 with errno ESTALE if any of them changed
+int coyaml_tape_open(coyaml_parseinfo_t *info, char *filename) {
+    coyaml_context_t *ctx = info->context;
+    int fd = open(filename, O_RDONLY);
+    if(fd < 0) return -1;
+    struct stat finfo;
+    if(fstat(fd, &finfo) < 0) {
+        close(fd);
+        return -1;
+    }
+    size_t size = finfo.st_size;
+    if(size < sizeof(coyaml_tape_hdr_t)) {
+        close(fd);
+        errno = EINVAL;
+        return -1;
+    }
+    char *map = mmap(NULL, size, PROT_READ|PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if(map == MAP_FAILED) return -1;
+
+    coyaml_tape_hdr_t *hdr = (coyaml_tape_hdr_t *)map;
+    coyaml_tape_t *tape = NULL;
+    int err = 0;
+    if(memcmp(hdr->magic, COYAML_TAPE_MAGIC, sizeof(hdr->magic))
+        || hdr->total_size != size
+        || hdr->inputs_offset + hdr->inputs_size > hdr->events_offset
+        || hdr->events_offset + hdr->events_size > hdr->anchors_offset
+        || hdr->anchors_offset + hdr->anchors_size > size
+        || !hdr->ninputs
+        || hdr->events_offset % TAPE_ALIGN
+        || hdr->anchors_offset % TAPE_ALIGN) {
+        err = EINVAL;
+    } else if(coyaml_inputs_check(ctx, map + hdr->inputs_offset,
+            hdr->inputs_size, hdr->ninputs) < 0) {
+        err = errno;
+    } else {
+        tape = obstack_alloc(&ctx->pieces, sizeof(coyaml_tape_t));
+        tape->map = map;
+        tape->size = size;
+        tape->pos = map + hdr->events_offset;
+        tape->end = tape->pos + hdr->events_size;
+        tape->count = 0;
+        tape->next_anchor = map + hdr->anchors_offset;
+        tape->anchors_end = tape->next_anchor + hdr->anchors_size;
+        if(setup_files(info, tape, map + hdr->inputs_offset,
+            hdr->ninputs) < 0) {
+            err = errno;
+            ctx->inputs = NULL;
+        }
+    }
+    if(err) {
+        munmap(map, size);
+        errno = err;
+        return -1;
+    }
+    info->tape = tape;
+    return 0;
+}
+
+static int tape_corrupt(coyaml_parseinfo_t *info) {
+    fprintf(stderr, "COYAML: Event tape for ``%s'' is corrupt\n",
+        info->context->root_filename);
+    errno = EINVAL;
+    return -1;
+}
+
+static int replay_anchor(coyaml_parseinfo_t *info, coyaml_tape_anchor_t *rec) {
+    coyaml_tape_t *tape = info->tape;
+    size_t size = sizeof(*rec) + rec->name_len + rec->value_len + 2;
+    if(tape->next_anchor + size > tape->anchors_end) {
+        return tape_corrupt(info);
+    }
+    size_t asize = sizeof(coyaml_anchor_t) + 2*sizeof(yaml_event_t);
+    coyaml_anchor_t *anch = obstack_alloc(&info->context->pieces, asize);
+    memset(anch, 0, asize);
+    anch->name = rec->data;
+    // Only first event is looked at by variables, complex anchors are
+    // already unpacked in the tape
+    anch->events[0].type = rec->type;
+    if(rec->type == YAML_SCALAR_EVENT) {
+        anch->events[0].data.scalar.value =
+            (yaml_char_t *)rec->data + rec->name_len + 1;
+        anch->events[0].data.scalar.length = rec->value_len;
+    }
+    anch->events[1].type = YAML_NO_EVENT;
+    if(info->anchor_last) {
+        info->anchor_last->next = anch;
+        info->anchor_last = anch;
+    } else {
+        info->anchor_first = info->anchor_last = anch;
+    }
+    tape->next_anchor += COYAML_ALIGN(size, TAPE_ALIGN);
+    return 0;
+}
+
+// Replays next event, making anchors visible in the same order as they
+// were when the tape was recorded
+int coyaml_tape_next(coyaml_parseinfo_t *info) {
+    coyaml_tape_t *tape = info->tape;
+    while(tape->next_anchor + sizeof(coyaml_tape_anchor_t)
+        <= tape->anchors_end) {
+        coyaml_tape_anchor_t *rec = (coyaml_tape_anchor_t *)tape->next_anchor;
+        if(rec->index > tape->count) break;
+        CHECK(replay_anchor(info, rec));
+    }
+    if(tape->pos + sizeof(coyaml_tape_event_t) > tape->end) {
+        return tape_corrupt(info);
+    }
+    coyaml_tape_event_t *rec = (coyaml_tape_event_t *)tape->pos;
+    size_t size = sizeof(*rec);
+    if(rec->tag_len != COYAML_TAPE_NOTAG) {
+        size += rec->tag_len + 1;
+    }
+    if(rec->type == YAML_SCALAR_EVENT) {
+        size += rec->value_len + 1;
+    }
+    if(tape->pos + size > tape->end || rec->file >= tape->nfiles
+        || rec->type <= YAML_NO_EVENT || rec->type > YAML_MAPPING_END_EVENT) {
+        return tape_corrupt(info);
+    }
+    memset(&info->event, 0, sizeof(info->event));
+    info->event.type = rec->type;
+    info->event.start_mark.line = rec->line;
+    info->event.start_mark.column = rec->column;
+    info->event.end_mark = info->event.start_mark;
+    char *data = rec->data;
+    if(rec->tag_len != COYAML_TAPE_NOTAG) {
+        info->event.data.scalar.tag = (yaml_char_t *)data;
+        data += rec->tag_len + 1;
+    }
+    if(rec->type == YAML_SCALAR_EVENT) {
+        info->event.data.scalar.value = (yaml_char_t *)data;
+        info->event.data.scalar.length = rec->value_len;
+    }
+    info->current_file = &tape->files[rec->file];
+    tape->pos += COYAML_ALIGN(size, TAPE_ALIGN);
+    tape->count += 1;
+    return 0;
+}
+
+void coyaml_tape_close(coyaml_parseinfo_t *info) {
+    munmap(info->tape->map, info->tape->size);
+    info->tape = NULL;
+}
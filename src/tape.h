@@ -0,0 +1,68 @@
+#ifndef _H_TAPE
+#define _H_TAPE
+
+#include <stdint.h>
+#include <coyaml_src.h>
+#include "parser.h"
+
+#define COYAML_TAPE_MAGIC "COYAMLT1"
+#define COYAML_TAPE_SUFFIX ".tape"
+#define COYAML_TAPE_NOTAG UINT32_MAX
+
+typedef struct coyaml_tape_hdr_s {
+    char magic[8];
+    uint64_t inputs_offset;
+    uint64_t inputs_size;
+    uint64_t ninputs;
+    uint64_t events_offset;
+    uint64_t events_size;
+    uint64_t anchors_offset;
+    uint64_t anchors_size;
+    uint64_t total_size;
+} coyaml_tape_hdr_t;
+
+// Event as seen by schema parser, followed by tag and value, both zero
+// terminated, padded to 8 bytes
+typedef struct coyaml_tape_event_s {
+    uint32_t type;
+    uint32_t file;
+    uint32_t line;
+    uint32_t column;
+    uint32_t tag_len;
+    uint32_t value_len;
+    char data[];
+} coyaml_tape_event_t;
+
+// Anchor, which becomes visible before event number `index` is replayed.
+// Followed by name and value of the first event, padded to 8 bytes
+typedef struct coyaml_tape_anchor_s {
+    uint64_t index;
+    uint32_t type;
+    uint32_t name_len;
+    uint32_t value_len;
+    uint32_t padding;
+    char data[];
+} coyaml_tape_anchor_t;
+
+// Tape being replayed, `pos` points to the next event
+typedef struct coyaml_tape_s {
+    char *map;
+    size_t size;
+    char *pos;
+    char *end;
+    size_t count;
+    char *next_anchor;
+    char *anchors_end;
+    coyaml_stack_t *files;
+    size_t nfiles;
+} coyaml_tape_t;
+
+int coyaml_tape_open(coyaml_parseinfo_t *info, char *filename);
+int coyaml_tape_next(coyaml_parseinfo_t *info);
+void coyaml_tape_close(coyaml_parseinfo_t *info);
+void coyaml_tape_record_event(coyaml_parseinfo_t *info);
+void coyaml_tape_record_anchor(coyaml_parseinfo_t *info,
+    coyaml_anchor_t *anchor);
+int coyaml_tape_write(coyaml_parseinfo_t *info, char *filename);
+
+#endif // _H_TAPE
@@ -112,3 +112,66 @@ coyaml_valuetype_t coyaml_string_type = {
     copy: (coyaml_copy_fun)coyaml_string_copy
 };
 
+
+coyaml_valuetype_t coyaml_choice_type = {
+    ident: COYAML_CHOICE,
+    name: "choice",
+    yaml_parse: (coyaml_state_fun)coyaml_choice,
+    cli_parse: (coyaml_option_fun)coyaml_choice_o,
+    emit: (coyaml_emit_fun)coyaml_choice_emit,
+    copy: (coyaml_copy_fun)coyaml_choice_copy
+};
+
+coyaml_valuetype_t coyaml_flags_type = {
+    ident: COYAML_FLAGS,
+    name: "flags",
+    yaml_parse: (coyaml_state_fun)coyaml_flags,
+    cli_parse: (coyaml_option_fun)coyaml_flags_o,
+    emit: (coyaml_emit_fun)coyaml_flags_emit,
+    copy: (coyaml_copy_fun)coyaml_flags_copy
+};
+
+coyaml_valuetype_t coyaml_regex_type = {
+    ident: COYAML_REGEX,
+    name: "regex",
+    yaml_parse: (coyaml_state_fun)coyaml_regex,
+    cli_parse: (coyaml_option_fun)coyaml_regex_o,
+    emit: (coyaml_emit_fun)coyaml_regex_emit,
+    copy: (coyaml_copy_fun)coyaml_regex_copy
+};
+
+coyaml_valuetype_t coyaml_address_type = {
+    ident: COYAML_ADDRESS,
+    name: "address",
+    yaml_parse: (coyaml_state_fun)coyaml_address,
+    cli_parse: (coyaml_option_fun)coyaml_address_o,
+    emit: (coyaml_emit_fun)coyaml_address_emit,
+    copy: (coyaml_copy_fun)coyaml_address_copy
+};
+
+coyaml_valuetype_t coyaml_cidr_type = {
+    ident: COYAML_CIDR,
+    name: "cidr",
+    yaml_parse: (coyaml_state_fun)coyaml_cidr,
+    cli_parse: (coyaml_option_fun)coyaml_cidr_o,
+    emit: (coyaml_emit_fun)coyaml_cidr_emit,
+    copy: (coyaml_copy_fun)coyaml_cidr_copy
+};
+
+coyaml_valuetype_t coyaml_stringset_type = {
+    ident: COYAML_STRINGSET,
+    name: "stringset",
+    yaml_parse: (coyaml_state_fun)coyaml_stringset,
+    cli_parse: (coyaml_option_fun)coyaml_stringset_o,
+    emit: (coyaml_emit_fun)coyaml_stringset_emit,
+    copy: (coyaml_copy_fun)coyaml_stringset_copy
+};
+
+coyaml_valuetype_t coyaml_format_type = {
+    ident: COYAML_FORMAT,
+    name: "format",
+    yaml_parse: (coyaml_state_fun)coyaml_format,
+    cli_parse: (coyaml_option_fun)coyaml_format_o,
+    emit: (coyaml_emit_fun)coyaml_format_emit,
+    copy: (coyaml_copy_fun)coyaml_format_copy
+};
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <arpa/inet.h>
 
 #include <coyaml_src.h> // needed for convert function
 #include "comprehensive.h"
@@ -98,12 +99,144 @@ int main(int argc, char **argv) {
     coyaml_env_parse_or_exit(ctx);
     coyaml_cli_parse_or_exit(ctx, argc, argv);
     coyaml_context_free(ctx);
-    printf("TAG: %d\n", config.SimpleHTTPServer.intvalue.tag);
+    printf("TAG: %d\n", CFG_GET(&config, SimpleHTTPServer.intvalue.tag));
     CFG_STRING_LOOP(item, config.SimpleHTTPServer.directory_indexes) {
         printf("INDEX: \"%s\"\n", item->value);
     }
     CFG_STRING_STRING_LOOP(item, config.SimpleHTTPServer.extra_headers) {
         printf("HEADER: \"%s\": \"%s\"\n", item->key, item->value);
     }
+    const char *lookup[] = {"X-Integer", "X-Cli", "X-Missing"};
+    for(int i = 0; i < 3; ++i) {
+        cfg_m_string_string_t *hdr = cfg_string_string_find(
+            config.SimpleHTTPServer.extra_headers,
+            config.SimpleHTTPServer.extra_headers_index,
+            lookup[i], strlen(lookup[i]));
+        printf("LOOKUP: \"%s\": \"%s\"\n", lookup[i],
+            hdr ? hdr->value : "(none)");
+    }
+    CFG_CONNECTADDR_EACH(item, config.SimpleHTTPServer.http_forward,
+        config.SimpleHTTPServer.http_forward_len) {
+        printf("FORWARD: \"%s\" %ld\n", item->value.host, item->value.port);
+    }
+    printf("THIRD FORWARD PORT: %ld\n",
+        config.SimpleHTTPServer.http_forward[2].value.port);
+    cfg_a_connectaddr_t *fwd = cfg_connectaddr_find_by_host(
+        config.SimpleHTTPServer.http_forward,
+        config.SimpleHTTPServer.http_forward_indexes, "192.168.0.3", 11);
+    printf("FORWARD BY HOST: %ld\n", fwd ? fwd->value.port : -1);
+    fwd = cfg_connectaddr_find_by_port(
+        config.SimpleHTTPServer.http_forward,
+        config.SimpleHTTPServer.http_forward_indexes, 80);
+    printf("FORWARD BY PORT: \"%s\"\n", fwd ? fwd->value.host : "(none)");
+    fwd = cfg_connectaddr_find_by_port(
+        config.SimpleHTTPServer.http_forward,
+        config.SimpleHTTPServer.http_forward_indexes, 1);
+    printf("FORWARD BY PORT: \"%s\"\n", fwd ? fwd->value.host : "(none)");
+    CFG_MOVEMENT_EACH(item, config.SimpleHTTPServer.movements,
+        config.SimpleHTTPServer.movements_len) {
+        printf("MOVEMENT: %d %ld\n", item->value.tag, item->value.distance);
+    }
+    long distance = 0;
+    double speed = 0;
+    long *distances = CFG_MOVEMENT_COLUMN(
+        config.SimpleHTTPServer.movements_columns, distance);
+    double *speeds = CFG_MOVEMENT_COLUMN(
+        config.SimpleHTTPServer.movements_columns, speed);
+    CFG_MOVEMENT_COLUMNS_LOOP(i, config.SimpleHTTPServer.movements_len) {
+        distance += distances[i];
+        speed += speeds[i];
+    }
+    printf("MOVEMENT TOTAL: %ld %.2f\n", distance, speed);
+    printf("STATUS: \"%s\" \"%s\"\n",
+        COYAML_STR(config.SimpleHTTPServer.responses.default_, status),
+        COYAML_STR(config.SimpleHTTPServer.responses.not_found, status));
+    printf("LOG FORMAT: %s\n",
+        config.SimpleHTTPServer.log_format == CFG_LOG_FORMAT_JSON
+        ? "json" : "other");
+    printf("FEATURES:%s%s%s%s\n",
+        config.SimpleHTTPServer.features & CFG_FEATURES_GZIP ? " gzip" : "",
+        config.SimpleHTTPServer.features & CFG_FEATURES_KEEPALIVE
+        ? " keepalive" : "",
+        config.SimpleHTTPServer.features & CFG_FEATURES_RANGE ? " range" : "",
+        config.SimpleHTTPServer.features & CFG_FEATURES_ETAG ? " etag" : "");
+    const char *files[] = {".htaccess", "index.html", "index.html~"};
+    for(int i = 0; i < 3; ++i) {
+        printf("HIDDEN: \"%s\" %s\n", files[i],
+            regexec(config.SimpleHTTPServer.hidden_files_re, files[i],
+                0, NULL, 0) ? "no" : "yes");
+    }
+    const char *agents[] = {"curl/7.1", "Mozilla/5.0 (BingBot)",
+        "Mozilla/5.0 (X11)", "GoogleBot/2.1"};
+    for(int i = 0; i < 4; ++i) {
+        printf("BOT: \"%s\" %d\n", agents[i], coyaml_regexset_match(
+            config.SimpleHTTPServer.bot_agents_set, agents[i]));
+    }
+    struct sockaddr_in *admin = (struct sockaddr_in *)
+        &config.SimpleHTTPServer.admin_listen.addr;
+    printf("ADMIN: %s %d\n", inet_ntoa(admin->sin_addr),
+        ntohs(admin->sin_port));
+    const char *ips[] = {"10.1.2.3", "10.2.0.1", "192.168.0.77",
+        "::ffff:10.1.0.1", "2001:db8::1", "::1", "8.8.8.8"};
+    for(int i = 0; i < 7; ++i) {
+        struct sockaddr_storage addr;
+        memset(&addr, 0, sizeof(addr));
+        struct sockaddr_in *in = (struct sockaddr_in *)&addr;
+        struct sockaddr_in6 *in6 = (struct sockaddr_in6 *)&addr;
+        if(inet_pton(AF_INET, ips[i], &in->sin_addr) == 1) {
+            in->sin_family = AF_INET;
+        } else {
+            inet_pton(AF_INET6, ips[i], &in6->sin6_addr);
+            in6->sin6_family = AF_INET6;
+        }
+        cfg_a_cidr_t *net = cfg_cidr_match(
+            config.SimpleHTTPServer.allow_set, (struct sockaddr *)&addr);
+        printf("ALLOW: \"%s\" %d\n", ips[i],
+            net ? net->value.prefixlen : -1);
+    }
+    const char *hosts[] = {"example.com", "static.CLI.example.com",
+        "example.org", "localhost", "local"};
+    for(int i = 0; i < 5; ++i) {
+        printf("VHOST: \"%s\" %s\n", hosts[i], cfg_contains(
+            &config.SimpleHTTPServer.virtual_hosts, hosts[i],
+            strlen(hosts[i])) ? "yes" : "no");
+    }
+    coyaml_template_t *templates[] = {
+        &config.SimpleHTTPServer.access_log_tpl,
+        &config.SimpleHTTPServer.access_date_tpl};
+    for(int i = 0; i < 2; ++i) {
+        printf("TEMPLATE:");
+        for(size_t j = 0; j < templates[i]->count; ++j) {
+            const coyaml_segment_t *seg = &templates[i]->segments[j];
+            if(seg->placeholder < 0) {
+                printf(" \"%s\"", seg->value);
+            } else {
+                printf(" %d", seg->placeholder);
+            }
+        }
+        printf("\n");
+    }
+    long *port = cfg_get(&config, "SimpleHTTPServer.listen.port");
+    printf("PATH PORT: %ld\n", port ? *port : -1);
+    printf("PATH MISSING: %s\n",
+        cfg_get(&config, "SimpleHTTPServer.listen.nothing") ? "yes" : "no");
+    printf("PATH SET RANGE: %d\n",
+        cfg_set(&config, "SimpleHTTPServer.listen.port", "70000"));
+    printf("PATH SET ARRAY: %d\n",
+        cfg_set(&config, "SimpleHTTPServer.http-forward", "x"));
+    char host[] = "example.org", code[] = "410";
+    cfg_set(&config, "SimpleHTTPServer.listen.host", host);
+    cfg_set(&config, "SimpleHTTPServer.responses.not-found.code", code);
+    printf("PATH HOST: \"%s\"\n", config.SimpleHTTPServer.listen.host);
+    char features[] = "etag,gzip", format[] = "csv";
+    cfg_set(&config, "SimpleHTTPServer.features", features);
+    printf("PATH SET CHOICE: %d\n",
+        cfg_set(&config, "SimpleHTTPServer.log-format", format));
+    cfg_print_path(stdout, &config, "SimpleHTTPServer.features",
+        COYAML_PRINT_FULL);
+    cfg_print_path(stdout, &config, "SimpleHTTPServer.responses.not-found",
+        COYAML_PRINT_FULL);
+    cfg_print_path(stdout, &config, "SimpleHTTPServer.listen.port",
+        COYAML_PRINT_FULL);
     cfg_free(&config);
 }
@@ -0,0 +1,4 @@
+# Dumped by compr built with -DCOYAML_PROFILE, trimmed by hand
+SimpleHTTPServer.request-timeout: 120
+SimpleHTTPServer.max-request-size: 120
+SimpleHTTPServer.server-string: 40
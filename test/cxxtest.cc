@@ -0,0 +1,116 @@
+#include <cstdio>
+#include <cstring>
+#include <cstdlib>
+
+extern "C" {
+#include <coyaml_src.h> // needed for convert function
+}
+#include "comprehensive.hpp"
+
+static cfg_main_t config;
+
+static char *copy(coyaml_parseinfo_t *info, const char *value, size_t len) {
+    return static_cast<char *>(obstack_copy0(&info->head->pieces,
+        value, len));
+}
+
+extern "C" int convert_connectaddr(coyaml_parseinfo_t *info, char *value,
+    coyaml_group_t *group, cfg_connectaddr_t *target) {
+    if(!info || !value || !*value)
+        return -1;
+    if(value[0] == '/' || (value[0] == '.' && value[1] == '/')) {
+        target->unix_socket = copy(info, value, strlen(value));
+        target->unix_socket_len = strlen(value);
+        return 0;
+    }
+    const char *pos = strchr(value, ':');
+    size_t len = pos ? size_t(pos - value) : strlen(value);
+    target->host = copy(info, value, len);
+    target->host_len = len;
+    if(pos)
+        target->port = atoi(pos+1);
+    return 0;
+}
+
+extern "C" int convert_listenaddr(coyaml_parseinfo_t *info, char *value,
+    coyaml_group_t *group, cfg_listenaddr_t *target) {
+    if(!info || !value || !*value)
+        return -1;
+    target->host = copy(info, value, strlen(value));
+    target->host_len = strlen(value);
+    return 0;
+}
+
+// Inlined to loads of the C structure, so usable in constant expressions
+static_assert(cfg::main_SimpleHTTPServer::log_level_max == 7, "max");
+static_assert(cfg::response::status_default == "OK", "default");
+static_assert(sizeof(cfg::main) == sizeof(void *), "view size");
+
+static void print(std::string_view str) {
+    printf("\"%.*s\"", int(str.size()), str.data());
+}
+
+int main(int argc, char **argv) {
+    coyaml_context_t *ctx = cfg_context(NULL, &config);
+    if(!ctx) {
+        perror(argv[0]);
+        return 1;
+    }
+    coyaml_cli_prepare_or_exit(ctx, argc, argv);
+    char hello[] = "hello", example[] = "example", intvar[] = "intvar";
+    coyaml_set_string(ctx, hello, example, strlen(example));
+    coyaml_set_integer(ctx, intvar, 123);
+    coyaml_readfile_or_exit(ctx);
+    coyaml_env_parse_or_exit(ctx);
+    coyaml_cli_parse_or_exit(ctx, argc, argv);
+    coyaml_context_free(ctx);
+
+    auto srv = cfg::main(config).SimpleHTTPServer();
+    printf("LOG LEVEL: %d\n", srv.log_level());
+    printf("LISTEN: ");
+    print(srv.listen().host());
+    printf("\n");
+    printf("TAG: %s\n", srv.intvalue().tag() == cfg::taggedint_tag::mbytes
+        ? "mbytes" : "other");
+    for(auto index : srv.directory_indexes()) {
+        printf("INDEX: ");
+        print(index);
+        printf("\n");
+    }
+    printf("HEADERS: %zu\n", srv.extra_headers().size());
+    for(auto [key, value] : srv.extra_headers()) {
+        if(key.substr(0, 6) != "X-Test")
+            continue;
+        printf("HEADER: ");
+        print(key);
+        printf(": ");
+        print(value);
+        printf("\n");
+    }
+    auto forward = srv.http_forward();
+    for(auto addr : forward) {
+        printf("FORWARD: ");
+        print(addr.host());
+        printf(" %ld\n", addr.port());
+    }
+    printf("THIRD FORWARD PORT: %ld\n", forward[2].port());
+    printf("LAST FORWARD: ");
+    print(forward[forward.size() - 1].unix_socket());
+    printf("\n");
+    for(auto mov : srv.movements()) {
+        printf("MOVEMENT: %d %ld %.2f\n", int(mov.tag()),
+            mov.distance(), mov.speed());
+    }
+    for(auto addr : srv.zmq_forward().value()) {
+        printf("ZMQ: %s ", addr.kind() == cfg::zmqaddr_tag::zmq_Bind
+            ? "bind" : "connect");
+        print(addr.value());
+        printf("\n");
+    }
+    printf("STATUS: ");
+    print(srv.responses().default_().status());
+    printf(" ");
+    print(srv.responses().not_found().status());
+    printf(" %d\n", srv.responses().not_found().code());
+    cfg_free(&config);
+}
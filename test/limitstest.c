@@ -0,0 +1,25 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <getopt.h>
+
+#include "limitsconfig.h"
+
+config_main_t config;
+
+int main(int argc, char **argv) {
+    coyaml_context_t *ctx = config_context(NULL, &config);
+    if(!ctx) {
+        perror(argv[0]);
+        return 1;
+    }
+    ctx->event_cache = getenv("LIMITSTEST_EVENT_CACHE") != NULL;
+    coyaml_cli_prepare_or_exit(ctx, argc, argv);
+    coyaml_readfile_or_exit(ctx);
+    coyaml_env_parse_or_exit(ctx);
+    coyaml_cli_parse_or_exit(ctx, argc, argv);
+    coyaml_context_free(ctx);
+    for(int i = optind; i < argc; ++i) {
+        printf("option: %s\n", argv[i]);
+    }
+    config_free(&config);
+}
@@ -0,0 +1,67 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <coyaml_src.h>
+#include "bench.h"
+
+// Parses file with generated group parsers and with transition tables,
+// checks that results are the same and prints time per parse of both
+
+static int parse(char *filename, bool table_driven, char **printed) {
+    coyaml_context_t *ctx = bench_context(NULL, NULL);
+    if(!ctx) return -1;
+    ctx->root_filename = filename;
+    ctx->table_driven = table_driven;
+    int res = coyaml_readfile(ctx);
+    if(!res && printed) {
+        size_t size;
+        FILE *out = open_memstream(printed, &size);
+        coyaml_print(out, ctx->root_group, ctx->target, COYAML_PRINT_FULL);
+        fclose(out);
+    }
+    bench_free((bench_main_t *)ctx->target);
+    coyaml_context_free(ctx);
+    return res;
+}
+
+static double run(char *filename, bool table_driven, int count) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for(int i = 0; i < count; ++i) {
+        if(parse(filename, table_driven, NULL) < 0) {
+            perror(filename);
+            exit(1);
+        }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    return ((end.tv_sec - start.tv_sec)*1e9
+        + (end.tv_nsec - start.tv_nsec)) / count;
+}
+
+int main(int argc, char **argv) {
+    if(argc < 2) {
+        fprintf(stderr, "Usage: %s config.yaml [count]\n", argv[0]);
+        return 1;
+    }
+    int count = argc > 2 ? atoi(argv[2]) : 1000;
+    char *generated = NULL, *tables = NULL;
+    if(parse(argv[1], FALSE, &generated) < 0
+        || parse(argv[1], TRUE, &tables) < 0) {
+        perror(argv[1]);
+        return 1;
+    }
+    if(strcmp(generated, tables)) {
+        fprintf(stderr, "Results of generated and table parsers differ\n");
+        return 1;
+    }
+    free(generated);
+    free(tables);
+    double gen = run(argv[1], FALSE, count);
+    double tbl = run(argv[1], TRUE, count);
+    printf("generated: %10.0f ns/parse\n", gen);
+    printf("tables:    %10.0f ns/parse\n", tbl);
+    return 0;
+}
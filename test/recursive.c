@@ -1,10 +1,21 @@
 #include <stdio.h>
+#include <stdlib.h>
 
 #include "recconfig.h"
 
 cfg_main_t config;
 
 int main(int argc, char **argv) {
-    cfg_load(&config, argc, argv);
+    coyaml_context_t *ctx = cfg_context(NULL, &config);
+    if(!ctx) {
+        perror(argv[0]);
+        return 1;
+    }
+    ctx->event_cache = getenv("RECURSIVE_EVENT_CACHE") != NULL;
+    coyaml_cli_prepare_or_exit(ctx, argc, argv);
+    coyaml_readfile_or_exit(ctx);
+    coyaml_env_parse_or_exit(ctx);
+    coyaml_cli_parse_or_exit(ctx, argc, argv);
+    coyaml_context_free(ctx);
     cfg_free(&config);
 }
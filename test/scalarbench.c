@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+
+#include <coyaml_src.h>
+#include "convert.h"
+
+// Compares conversion kernels with the strtol/strtod/strcasecmp code they
+// replaced, checks that results are the same and prints time per value
+
+static struct unit_s {
+    char *unit;
+    size_t value;
+} units[] = {
+    {"k", 1000L},
+    {"ki", 1L << 10},
+    {"M", 1000000L},
+    {"Mi", 1L << 20},
+    {"G", 1000000000L},
+    {"Gi", 1L << 30},
+    {"T", 1000000000000L},
+    {"Ti", 1L << 40},
+    {"P", 1000000000000000L},
+    {"Pi", 1L << 50},
+    {"E", 1000000000000000000L},
+    {"Ei", 1L << 60},
+    {NULL, 0},
+    };
+
+static char *old_long(char *value, long *result) {
+    char *end;
+    long val = strtol(value, &end, 0);
+    if(*end) {
+        for(struct unit_s *unit = units; unit->unit; ++unit) {
+            if(!strcmp(end, unit->unit)) {
+                val *= unit->value;
+                end += strlen(unit->unit);
+                break;
+            }
+        }
+    }
+    *result = val;
+    return end;
+}
+
+static char *old_double(char *value, double *result) {
+    char *end;
+    double val = strtod(value, &end);
+    if(*end) {
+        for(struct unit_s *unit = units; unit->unit; ++unit) {
+            if(!strcmp(end, unit->unit)) {
+                val *= unit->value;
+                end += strlen(unit->unit);
+                break;
+            }
+        }
+    }
+    *result = val;
+    return end;
+}
+
+static int old_bool(char *value) {
+    if(!strcasecmp(value, "true") || !strcasecmp(value, "y")
+        || !strcasecmp(value, "yes") || !strcasecmp(value, "on")) {
+        return TRUE;
+    } else if(!strcasecmp(value, "false") || !strcasecmp(value, "n")
+        || !strcasecmp(value, "no") || !strcasecmp(value, "off")) {
+        return FALSE;
+    }
+    return -1;
+}
+
+static char *ints[] = {
+    "0", "1", "42", "-17", "+8", "0x1F", "0755", "65535", "10k", "4ki",
+    "512Mi", "2G", "1Ti", "3E", "123456789", "1234567890123",
+    "9223372036854775807", "-9223372036854775808", "12x", "",
+    NULL};
+static char *floats[] = {
+    "0", "0.5", "-0.0", "3.14159", "1e10", "2.5k", "-0.001", "123456.789",
+    "1.7976931348623157e308", "0.1", "1e-300", "4.9e-324", "1.5Gi",
+    "12345678901234567890.5", "0x1.8p1", "inf", "-nan", "1e", "1.", ".5",
+    "99999999.99999999", "7e22", "7e23", "x", NULL};
+static char *bools[] = {
+    "true", "y", "yes", "on", "false", "n", "no", "off", "TRUE", "Yes",
+    "oFF", "t", "", "nope", "truth", "false!", NULL};
+
+static int check(void) {
+    int res = 0;
+    for(char **s = ints; *s; ++s) {
+        long a = 0, b = 0;
+        char *ea = old_long(*s, &a);
+        const char *eb = coyaml_parse_long(*s, *s + strlen(*s), &b);
+        if((!*ea) != (eb == *s + strlen(*s)) || (!*ea && a != b)) {
+            fprintf(stderr, "Integer ``%s'': %ld != %ld\n", *s, a, b);
+            res = -1;
+        }
+    }
+    for(char **s = floats; *s; ++s) {
+        double a = 0, b = 0;
+        char *ea = old_double(*s, &a);
+        const char *eb = coyaml_parse_double(*s, *s + strlen(*s), &b);
+        if((!*ea) != (eb == *s + strlen(*s))
+            || (!*ea && memcmp(&a, &b, sizeof(double)))) {
+            fprintf(stderr, "Float ``%s'': %.17g != %.17g\n", *s, a, b);
+            res = -1;
+        }
+    }
+    for(char **s = bools; *s; ++s) {
+        if(old_bool(*s) != coyaml_parse_bool(*s, strlen(*s))) {
+            fprintf(stderr, "Boolean ``%s'' differs\n", *s);
+            res = -1;
+        }
+    }
+    // Random decimals of different length, both fast and slow path
+    char buf[64];
+    srand(1);
+    for(int i = 0; i < 100000; ++i) {
+        snprintf(buf, sizeof(buf), "%.*g", 1 + i % 17,
+            (double)rand() / (1 + rand() % 100000) * (i % 2 ? 1e-5 : 1e5));
+        double a = strtod(buf, NULL), b = 0;
+        coyaml_parse_double(buf, buf + strlen(buf), &b);
+        if(memcmp(&a, &b, sizeof(double))) {
+            fprintf(stderr, "Float ``%s'': %.17g != %.17g\n", buf, a, b);
+            res = -1;
+        }
+    }
+    return res;
+}
+
+static double now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static size_t count(char **values) {
+    size_t n = 0;
+    while(values[n]) ++n;
+    return n;
+}
+
+int main(int argc, char **argv) {
+    int rounds = argc > 1 ? atoi(argv[1]) : 100000;
+    if(check() < 0) {
+        fprintf(stderr, "Results of old and new conversions differ\n");
+        return 1;
+    }
+    volatile long lsum = 0;
+    volatile double dsum = 0;
+    size_t nints = count(ints), nfloats = count(floats), nbools = count(bools);
+    long lval;
+    double dval;
+
+    double start = now();
+    for(int r = 0; r < rounds; ++r)
+        for(char **s = ints; *s; ++s) {
+            old_long(*s, &lval);
+            lsum += lval;
+        }
+    double old_int = (now() - start) / rounds / nints;
+    start = now();
+    for(int r = 0; r < rounds; ++r)
+        for(char **s = ints; *s; ++s) {
+            coyaml_parse_long(*s, *s + strlen(*s), &lval);
+            lsum += lval;
+        }
+    double new_int = (now() - start) / rounds / nints;
+
+    start = now();
+    for(int r = 0; r < rounds; ++r)
+        for(char **s = floats; *s; ++s) {
+            old_double(*s, &dval);
+            dsum += dval;
+        }
+    double old_float = (now() - start) / rounds / nfloats;
+    start = now();
+    for(int r = 0; r < rounds; ++r)
+        for(char **s = floats; *s; ++s) {
+            coyaml_parse_double(*s, *s + strlen(*s), &dval);
+            dsum += dval;
+        }
+    double new_float = (now() - start) / rounds / nfloats;
+
+    start = now();
+    for(int r = 0; r < rounds; ++r)
+        for(char **s = bools; *s; ++s)
+            lsum += old_bool(*s);
+    double old_boolean = (now() - start) / rounds / nbools;
+    start = now();
+    for(int r = 0; r < rounds; ++r)
+        for(char **s = bools; *s; ++s)
+            lsum += coyaml_parse_bool(*s, strlen(*s));
+    double new_boolean = (now() - start) / rounds / nbools;
+
+    printf("int:   strtol %6.1f ns, kernel %6.1f ns\n", old_int, new_int);
+    printf("float: strtod %6.1f ns, kernel %6.1f ns\n", old_float, new_float);
+    printf("bool:  strcasecmp %6.1f ns, kernel %6.1f ns\n",
+        old_boolean, new_boolean);
+    return 0;
+}
@@ -0,0 +1,139 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "vars.h"
+
+// Master publishes config and forks a worker, which drops privileges when
+// run as root. Worker is asked to check a generation after each publish,
+// except a few in a row which it skips, so it has to map the generation
+// privately when the slot is occupied by the one it holds
+
+#define SLOT_SIZE 65536
+#define NSLOTS 3
+#define NOBODY 65534
+
+config_main_t config;
+
+static int check(coyaml_shared_t *sh, uint64_t generation) {
+    const config_main_t *cfg = coyaml_shared_config(sh);
+    if(!cfg) {
+        perror("coyaml_shared_config");
+        return -1;
+    }
+    if(coyaml_shared_generation(sh) != generation
+        || cfg->Data.int1 != (long)generation
+        || strcmp(cfg->Data.str6, config.Data.str6)) {
+        fprintf(stderr, "Generation %llu: got %llu with int1 %ld, "
+            "str6 ``%s''\n", (unsigned long long)generation,
+            (unsigned long long)coyaml_shared_generation(sh),
+            cfg->Data.int1, cfg->Data.str6);
+        return -1;
+    }
+    return 0;
+}
+
+static int worker(coyaml_shared_t *sh, int in, int out) {
+    if(!getuid()) {
+        if(setgid(NOBODY) < 0 || setuid(NOBODY) < 0) {
+            perror("setuid");
+            return 1;
+        }
+    }
+    uint64_t generation;
+    while(read(in, &generation, sizeof(generation)) == sizeof(generation)
+        && generation) {
+        if(check(sh, generation) < 0) return 1;
+        if(write(out, &generation, sizeof(generation)) < 0) return 1;
+    }
+    return 0;
+}
+
+static int publish(coyaml_shared_t *sh, coyaml_context_t *ctx,
+    uint64_t generation) {
+    config.Data.int1 = generation;
+    if(coyaml_shared_publish(sh, ctx) < 0) {
+        perror("coyaml_shared_publish");
+        return -1;
+    }
+    return 0;
+}
+
+static int ask(int out, int in, uint64_t generation) {
+    uint64_t ack = 0;
+    if(write(out, &generation, sizeof(generation)) < 0
+        || read(in, &ack, sizeof(ack)) != sizeof(ack)
+        || ack != generation) {
+        fprintf(stderr, "Worker failed to check generation %llu\n",
+            (unsigned long long)generation);
+        return -1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    coyaml_context_t *ctx = config_context(NULL, &config);
+    if(!ctx) {
+        perror(argv[0]);
+        return 1;
+    }
+    coyaml_cli_prepare_or_exit(ctx, argc, argv);
+    coyaml_readfile_or_exit(ctx);
+    coyaml_shared_t *sh = coyaml_shared_create(SLOT_SIZE, NSLOTS);
+    if(!sh) {
+        perror("coyaml_shared_create");
+        return 1;
+    }
+    if(publish(sh, ctx, 1) < 0) return 1;
+
+    int down[2], up[2];
+    if(pipe(down) < 0 || pipe(up) < 0) {
+        perror("pipe");
+        return 1;
+    }
+    pid_t pid = fork();
+    if(pid < 0) {
+        perror("fork");
+        return 1;
+    }
+    if(!pid) {
+        close(down[1]);
+        close(up[0]);
+        int res = worker(sh, down[0], up[1]);
+        coyaml_shared_free(sh);
+        _exit(res);
+    }
+    close(down[0]);
+    close(up[1]);
+    // Failed worker is reported by its exit status
+    signal(SIGPIPE, SIG_IGN);
+
+    int res = ask(down[1], up[0], 1);
+    uint64_t generation = 1;
+    // Generations 3 to 6 are skipped by the worker
+    uint64_t checked[] = {2, 7, 8};
+    for(int i = 0; !res && i < 3; ++i) {
+        while(!res && generation < checked[i]) {
+            res = publish(sh, ctx, ++generation);
+        }
+        if(!res) res = ask(down[1], up[0], generation);
+    }
+    uint64_t stop = 0;
+    if(write(down[1], &stop, sizeof(stop)) < 0) res = -1;
+    int status;
+    if(waitpid(pid, &status, 0) < 0 || !WIFEXITED(status)
+        || WEXITSTATUS(status)) {
+        fprintf(stderr, "Worker failed\n");
+        res = -1;
+    }
+    if(!res) res = check(sh, generation);
+    coyaml_shared_free(sh);
+    coyaml_context_free(ctx);
+    config_free(&config);
+    return res ? 1 : 0;
+}
@@ -1,4 +1,5 @@
 #include <stdio.h>
+#include <stdlib.h>
 #include <getopt.h>
 
 #include "vars.h"
@@ -6,7 +7,23 @@
 config_main_t config;
 
 int main(int argc, char **argv) {
-    config_load(&config, argc, argv);
+    coyaml_context_t *ctx = config_context(NULL, &config);
+    if(!ctx) {
+        perror(argv[0]);
+        return 1;
+    }
+    // Snapshot is used if it's up to date and is written otherwise
+    ctx->snapshot_filename = getenv("VARTEST_SNAPSHOT");
+    ctx->event_cache = getenv("VARTEST_EVENT_CACHE") != NULL;
+    coyaml_cli_prepare_or_exit(ctx, argc, argv);
+    coyaml_readfile_or_exit(ctx);
+    if(ctx->snapshot_filename) {
+        fprintf(stderr, "SNAPSHOT: %s\n",
+            config.head.snapshot ? "mapped" : "parsed");
+    }
+    coyaml_env_parse_or_exit(ctx);
+    coyaml_cli_parse_or_exit(ctx, argc, argv);
+    coyaml_context_free(ctx);
     for(int i = optind; i < argc; ++i) {
         printf("option: %s\n", argv[i]);
     }